@@ -26,6 +26,14 @@ CFLAGS += $(foreach p,$(PKGS),$(shell pkg-config --cflags $(p)))
 CXXFLAGS += $(foreach p,$(PKGS),$(shell pkg-config --cflags $(p)))
 LDLIBS += $(foreach p,$(PKGS),$(shell pkg-config --libs $(p)))
 
+PKGS_TST += cmocka
+TST_CFLAGS += $(foreach p,$(PKGS_TST),$(shell pkg-config --cflags $(p)))
+TST_LDLIBS += $(foreach p,$(PKGS_TST),$(shell pkg-config --libs $(p)))
+
+PKGS_COMPOSITOR += wayland-server
+COMPOSITOR_CFLAGS += $(foreach p,$(PKGS_COMPOSITOR),$(shell pkg-config --cflags $(p)))
+COMPOSITOR_LDLIBS += $(foreach p,$(PKGS_COMPOSITOR),$(shell pkg-config --libs $(p))) -lm
+
 CC = gcc
 CXX = g++
 
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,32 +7,44 @@
 
 #include "convert.h"
 #include "ipc.h"
+#include "marshalling.h"
 #include "process.h"
 #include "sockets.h"
 
-void execute(enum IpcRequestCommand command, char *request) {
-	int fd;
+bool binary = false;
 
-	if ((fd = create_fd_ipc_client()) == -1) {
+// the request is framed, in the compact binary encoding when binary; responses are decoded and their messages logged
+void execute(enum IpcRequestCommand command, char *request) {
+	struct IpcRequest *ipc_request = unmarshal_ipc_request(request);
+	if (!ipc_request) {
 		exit(1);
 	}
 
-	log_debug("========%s request=================\n%s\n----------------------------------------", ipc_request_command_name(command), request);
-	if (socket_write(fd, request, strlen(request)) == -1) {
+	const char *encoding = binary ? " binary" : "";
+
+	log_debug("========%s%s request==========\n%s\n----------------------------------------", ipc_request_command_name(command), encoding, request);
+	int fd = ipc_request_send(ipc_request, binary ? IPC_ENCODING_BINARY : IPC_ENCODING_YAML);
+	free_ipc_request(ipc_request);
+	if (fd == -1) {
 		exit(1);
 	}
 
+	struct IpcConnection connection = { .fd = fd, };
 	for (;;) {
-		char *response = NULL;
-		if (!(response = socket_read(fd))) { // yup, that's a memory leak
+		struct IpcResponse *response = ipc_response_receive(&connection);
+		if (!response) {
 			exit(1);
 		}
-		log_debug("========%s response================\n%s\n----------------------------------------", ipc_request_command_name(command), response);
-		if (strstr(response, "DONE: TRUE")) {
+		log_debug("========%s%s response=========\nDONE: %s\nRC: %d\n----------------------------------------", ipc_request_command_name(command), encoding, response->done ? "TRUE" : "FALSE", response->rc);
+		bool done = response->done;
+		free_ipc_response(response);
+		if (done) {
 			break;
 		}
 	}
 
+	free(connection.buf);
+
 	close(fd);
 }
 
@@ -105,7 +118,7 @@ CFG:\n\
 }
 
 void usage(void) {
-	fprintf(stderr, "Usage: example_client <GET | CFG_WRITE | CFG_SET | CFG_DEL>\n");
+	fprintf(stderr, "Usage: example_client <GET | CFG_WRITE | CFG_SET | CFG_DEL> [BINARY]\n");
 	exit(1);
 }
 
@@ -113,10 +126,18 @@ int
 main(int argc, char **argv) {
 	log_set_threshold(DEBUG, true);
 
-	if (argc != 2) {
+	if (argc != 2 && argc != 3) {
 		usage();
 	}
 
+	if (argc == 3) {
+		if (strcmp(argv[2], "BINARY") == 0) {
+			binary = true;
+		} else {
+			usage();
+		}
+	}
+
 	void (*fn)(void);
 	if (strcmp(argv[1], ipc_request_command_name(GET)) == 0) {
 		fn = get;
@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <wayland-client-protocol.h>
+#include <wayland-util.h>
+
+#include "list.h"
+
+// layouts are persisted, least recently converged dropped first
+#define CACHE_LAYOUTS_MAX 32
+
+// a head's desired state at convergence
+struct CachedHead {
+	char *head_identity;
+	bool enabled;
+	int32_t width;
+	int32_t height;
+	int32_t refresh_mhz;
+	wl_fixed_t scale;
+	int32_t x;
+	int32_t y;
+	enum wl_output_transform transform;
+};
+
+// the converged layout for a set of heads, cfg and lid
+struct CachedLayout {
+	uint64_t fingerprint;
+	time_t recorded;
+	struct SList *heads;
+};
+
+bool cache_path(const char *name, char *path, size_t npath);
+
+uint64_t cache_layout_fingerprint(void);
+
+bool cache_layout_desire(void);
+
+void cache_layout_store(void);
+
+void cache_layouts_load(void);
+
+void cache_layouts_destroy(void);
+
+#endif // CACHE_H
+
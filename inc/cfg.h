@@ -54,6 +54,12 @@ struct Cfg {
 
 	bool written;
 
+	// bumped each time a changed cfg becomes active
+	unsigned long generation;
+
+	// distinct for every cfg constructed; keys heads' bindings and marshalled forms, which a reused address or generation would not
+	unsigned long instance;
+
 	char *laptop_display_prefix;
 	struct SList *order_name_desc;
 	enum Arrange arrange;
@@ -65,6 +71,7 @@ struct Cfg {
 	struct SList *max_preferred_refresh_name_desc;
 	struct SList *disabled_name_desc;
 	enum LogThreshold log_threshold;
+	enum LogFormat log_format;
 };
 
 enum CfgElement {
@@ -80,6 +87,7 @@ enum CfgElement {
 	LOG_THRESHOLD,
 	DISABLED,
 	ARRANGE_ALIGN,
+	LOG_FORMAT,
 };
 
 void cfg_init(void);
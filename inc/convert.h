@@ -4,6 +4,7 @@
 #include "cfg.h"
 #include "ipc.h"
 #include "log.h"
+#include "pool.h"
 
 enum CfgElement cfg_element_val(const char *name);
 const char *cfg_element_name(enum CfgElement cfg_element);
@@ -21,8 +22,16 @@ enum IpcRequestCommand ipc_request_command_val(const char *name);
 const char *ipc_request_command_name(enum IpcRequestCommand ipc_request_command);
 const char *ipc_request_command_friendly(enum IpcRequestCommand ipc_request_command);
 
+enum IpcEvent ipc_event_val(const char *name);
+const char *ipc_event_name(enum IpcEvent ipc_event);
+
 enum LogThreshold log_threshold_val(const char *name);
 const char *log_threshold_name(enum LogThreshold log_threshold);
 
+enum LogFormat log_format_val(const char *name);
+const char *log_format_name(enum LogFormat log_format);
+
+const char *pool_type_name(enum PoolType pool_type);
+
 #endif // CONVERT_H
 
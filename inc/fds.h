@@ -1,25 +1,34 @@
 #ifndef FDS_H
 #define FDS_H
 
-#include <poll.h>
 #include <stdbool.h>
 
 extern int fd_signal;
 extern int fd_ipc;
 extern int fd_cfg_dir;
 
-extern nfds_t npfds;
-extern struct pollfd pfds[5];
+// create the epoll instance and the signal, ipc and cfg dir fds
+void fds_init(void);
 
-extern struct pollfd *pfd_signal;
-extern struct pollfd *pfd_ipc;
-extern struct pollfd *pfd_wayland;
-extern struct pollfd *pfd_lid;
-extern struct pollfd *pfd_cfg_dir;
+// handler is called when fd is readable; NULL to only wake the loop
+bool fds_register(int fd, void (*handler)(int fd, void *data), void *data);
 
-void init_pfds(void);
+// handler is called when fd is writable, alongside any readable handler; level triggered so unregister once nothing remains
+bool fds_register_writable(int fd, void (*handler)(int fd, void *data), void *data);
 
-void destroy_pfds(void);
+// both handlers; safe to call from within a handler
+void fds_unregister(int fd);
+
+// the writable handler only, leaving any readable
+void fds_unregister_writable(int fd);
+
+// block until at least one registered fd is ready; returns the number ready or -1
+int fds_wait(int timeout);
+
+// call the handlers of the fds made ready by the last fds_wait
+void fds_dispatch(void);
+
+void fds_destroy(void);
 
 bool cfg_file_modified(char *file_name);
 
@@ -12,6 +12,9 @@ extern struct SList *heads;
 extern struct SList *heads_arrived;
 extern struct SList *heads_departed;
 
+// bumped on head arrival and departure
+extern unsigned long heads_generation;
+
 struct HeadState {
 	struct Mode *mode;
 	wl_fixed_t scale;
@@ -30,7 +33,7 @@ struct Head {
 
 	struct zwlr_output_configuration_head_v1 *zwlr_config_head;
 
-	struct SList *modes;
+	struct SListHeader modes;
 
 	char *name;
 	char *description;
@@ -41,21 +44,61 @@ struct Head {
 	char *model;
 	char *serial_number;
 
+	// see head_identity
+	char *identity;
+
 	struct HeadState current;
 	struct HeadState desired;
 
 	struct SList *modes_failed;
 
+	struct ModeTable mode_table;
+
+	// ModesResRefresh, built on demand
+	struct SList *mrrs;
+
 	struct {
 		int32_t width;
 		int32_t height;
 	} scaled;
 
+	// bumped on any change to this head or its modes
+	unsigned long generation;
+	// generation at which desired was last computed
+	unsigned long desired_generation;
+
+	// state_revision at which this head last changed, see state_revise
+	unsigned long revision;
+	// generation and desired at that revision
+	unsigned long revised_generation;
+	struct HeadState revised_desired;
+
+	// marshalled forms, reused in responses until state_revise drops them
+	struct {
+		char *yaml;
+		char *tlv;
+		size_t tlv_len;
+	} serialized;
+
+	// cfg elements matching this head, see head_bind
+	struct {
+		unsigned long cfg_instance;
+		unsigned long generation;
+		// position of the first matching ORDER, UINT_MAX when none
+		unsigned int order;
+		struct UserScale *user_scale;
+		struct UserMode *user_mode;
+		struct UserTransform *user_transform;
+		bool max_preferred_refresh;
+		bool disabled;
+		bool laptop;
+	} bindings;
+
 	bool warned_no_preferred;
 	bool warned_no_mode;
 };
 
-bool head_matches_name_desc(const void *name_desc, const void *head);
+void head_bind(struct Head *head);
 
 wl_fixed_t head_auto_scale(struct Head *head);
 
@@ -71,6 +114,20 @@ bool head_current_mode_not_desired(const void *head);
 
 void head_release_mode(struct Head *head, struct Mode *mode);
 
+void head_modes_changed(struct Head *head);
+
+void head_index_modes(struct Head *head);
+
+struct SList *head_modes_res_refresh(struct Head *head);
+
+void head_fail_mode(struct Head *head, struct Mode *mode);
+
+void head_forget_failed_modes(struct Head *head);
+
+const char *head_identity(struct Head *head);
+
+void head_identity_changed(struct Head *head);
+
 void head_free(void *head);
 
 void heads_release_head(struct Head *head);
@@ -5,7 +5,9 @@
 #include <stddef.h>
 
 #include "cfg.h"
+#include "displ.h"
 #include "head.h"
+#include "lid.h"
 #include "list.h"
 #include "log.h"
 #include "mode.h"
@@ -23,6 +25,11 @@ void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head);
 
 void print_heads(enum LogThreshold t, enum InfoEvent event, struct SList *heads);
 
+void print_lid(enum LogThreshold t, struct Lid *lid);
+
+// result of a configuration
+void print_changes(enum ConfigState state);
+
 void print_mode(enum LogThreshold t, struct Mode *mode);
 
 void print_head_desired_mode_fallback(enum LogThreshold t, struct Head *head);
@@ -31,5 +38,17 @@ void print_user_mode(enum LogThreshold t, struct UserMode *user_mode, bool del);
 
 void info_user_mode_string(struct UserMode *user_mode, char *buf, size_t nbuf);
 
+// revision of the STATE, bumped by state_revise when anything changes
+extern unsigned long state_revision;
+
+// revisions at which heads last arrived or departed, and the lid last changed
+extern unsigned long state_revision_heads;
+extern unsigned long state_revision_lid;
+
+void state_revise(void);
+
+// whether the changes since a client's revision can be sent without the full STATE
+bool state_delta_since(unsigned long since);
+
 #endif // INFO_H
 
@@ -2,6 +2,12 @@
 #define IPC_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "list.h"
 
 #define IPC_RC_SUCCESS 0
 #define IPC_RC_WARN 1
@@ -10,39 +16,148 @@
 #define IPC_RC_BAD_RESPONSE 12
 #define IPC_RC_REQUEST_IN_PROGRESS 13
 
+// framed messages: magic, encoding, 3 reserved, payload length in network order, payload
+// anything else is an unframed, newline terminated, YAML request
+#define IPC_FRAME_MAGIC "WDIF"
+#define IPC_FRAME_MAGIC_SIZE 4
+#define IPC_FRAME_HEADER_SIZE 12
+
+enum IpcEncoding {
+	IPC_ENCODING_YAML = 1,
+	IPC_ENCODING_BINARY,
+};
+
 enum IpcRequestCommand {
 	GET = 1,
 	CFG_SET,
 	CFG_DEL,
 	CFG_WRITE,
+	SUBSCRIBE,
+	MODES_FORGET,
 };
 
+// pushed to subscribers
+enum IpcEvent {
+	IPC_EVENT_HEADS = 1,
+	IPC_EVENT_LID,
+	IPC_EVENT_CFG,
+	IPC_EVENT_SUCCEEDED,
+	IPC_EVENT_FAILED,
+	IPC_EVENT_MAX = IPC_EVENT_FAILED,
+};
+
+#define IPC_EVENT_BIT(e) (1u << (e))
+
 struct IpcRequest {
 	enum IpcRequestCommand command;
 	struct Cfg *cfg;
 	int fd;
 	bool bad;
+
+	// STATE changes only, since the client's revision
+	bool delta;
+	unsigned long since;
+};
+
+enum IpcConnectionState {
+	IPC_READING = 1,
+	IPC_QUEUED,
+	IPC_ACTIVE,
+	IPC_SUBSCRIBED,
+	IPC_CLOSING,
+	IPC_CLOSED,
+};
+
+// server side client connection
+struct IpcConnection {
+	int fd;
+	enum IpcConnectionState state;
+
+	// bytes received so far
+	char *buf;
+	size_t len;
+
+	bool eof;
+
+	// request arrived in a frame, respond likewise
+	bool framed;
+	enum IpcEncoding encoding;
+
+	struct IpcRequest *request;
+
+	// lines captured for this connection while it is not the active one
+	struct LogCap *messages;
+
+	// bytes queued for the client, written as its socket allows
+	char *out;
+	size_t out_len;
+
+	// last read or write progress
+	struct timespec active_at;
 };
 
 struct IpcResponse {
 	bool done;
 	int rc;
-	int fd;
+	// server side, queued on its output
+	struct IpcConnection *connection;
 	bool messages;
 	bool status;
+	bool framed;
+	enum IpcEncoding encoding;
+
+	// IPC_EVENT_BIT of what happened; only the affected CFG and STATE are sent
+	unsigned int events;
+
+	// STATE changes only, since the revision, advanced on each send
+	bool delta;
+	unsigned long since;
+
+	// received by clients, when present
+	struct Cfg *cfg;
+	struct Lid *lid;
+	struct SList *heads;
+	unsigned long revision;
 };
 
-int ipc_request_send(struct IpcRequest *request);
+int ipc_request_send(struct IpcRequest *request, enum IpcEncoding encoding);
 
 void ipc_response_send(struct IpcResponse *response);
 
-struct IpcRequest *ipc_request_receive(int fd_sock);
+struct IpcConnection *ipc_connection_accept(int fd_sock);
+
+// queue after anything already waiting and write what the socket will take; false on failure or when the client is not keeping up
+bool ipc_connection_write(struct IpcConnection *connection, const char *data, size_t len);
+
+// write what the socket will take of the queued output; false on failure
+bool ipc_connection_flush(struct IpcConnection *connection);
 
-struct IpcResponse *ipc_response_receive(int fd);
+// milliseconds until the connection has stalled for too long, 0 when it has
+long ipc_connection_idle_remaining_ms(struct IpcConnection *connection);
+
+bool ipc_connection_read(struct IpcConnection *connection);
+
+void ipc_frame_header(char *header, enum IpcEncoding encoding, uint32_t length);
+
+ssize_t ipc_frame_length(const char *buf, size_t len, enum IpcEncoding *encoding);
+
+struct IpcResponse *ipc_response_receive(struct IpcConnection *connection);
+
+bool ipc_response_has_cfg(struct IpcResponse *response);
+
+bool ipc_response_has_state(struct IpcResponse *response);
+
+// whether this STATE is a delta, otherwise full
+bool ipc_response_state_delta(struct IpcResponse *response);
+
+// whether to include the head, lid etc. last changed at revision
+bool ipc_response_state_includes(struct IpcResponse *response, unsigned long revision);
 
 void free_ipc_request(struct IpcRequest *request);
 
 void free_ipc_response(struct IpcResponse *response);
 
+void free_ipc_connection(void *connection);
+
 #endif // IPC_H
 
@@ -0,0 +1,43 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// JSON written into a caller's fixed buffer, never allocating
+struct Json {
+	char *buf;
+	size_t size;
+	size_t len;
+
+	// a value precedes at the current depth
+	bool comma;
+
+	// ran out of space; buf holds a terminated prefix
+	bool truncated;
+};
+
+void json_init(struct Json *json, char *buf, size_t size);
+
+// key is ignored within arrays and for the root; pass NULL
+void json_object_begin(struct Json *json, const char *key);
+
+void json_object_end(struct Json *json);
+
+void json_array_begin(struct Json *json, const char *key);
+
+void json_array_end(struct Json *json);
+
+// null val is written as null
+void json_string(struct Json *json, const char *key, const char *val);
+
+void json_int(struct Json *json, const char *key, long val);
+
+void json_double(struct Json *json, const char *key, double val);
+
+void json_bool(struct Json *json, const char *key, bool val);
+
+void json_null(struct Json *json, const char *key);
+
+#endif // JSON_H
+
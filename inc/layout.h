@@ -1,7 +1,22 @@
 #ifndef LAYOUT_H
 #define LAYOUT_H
 
+#include "displ.h"
+#include "head.h"
+#include "mode.h"
+
+// a desired mode tested alone before it is applied
+struct ModeTest {
+	struct zwlr_output_configuration_head_v1 *zwlr_config_head;
+	struct ModeValidation *validation;
+	enum ConfigState state;
+};
+
 void layout(void);
 
+bool layout_idle(void);
+
+void layout_release_head(struct Head *head);
+
 #endif // LAYOUT_H
 
@@ -3,9 +3,14 @@
 
 #include <stdbool.h>
 
+#include "head.h"
+
 struct Lid {
 	bool closed;
 
+	// bumped when closed toggles
+	unsigned long generation;
+
 	char *device_path;
 	struct libinput *libinput_monitor;
 	int libinput_fd;
@@ -15,7 +20,7 @@ void lid_init(void);
 
 void lid_update(void);
 
-bool lid_is_closed(char *name);
+bool lid_is_closed(struct Head *head);
 
 void lid_destroy(void);
 
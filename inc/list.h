@@ -8,6 +8,13 @@ struct SList {
 	struct SList *nex;
 };
 
+// list tracking its tail and length, for O(1) append
+struct SListHeader {
+	struct SList *first;
+	struct SList *last;
+	unsigned long length;
+};
+
 // append val to a list
 struct SList *slist_append(struct SList **head, void *val);
 
@@ -41,15 +48,33 @@ unsigned long slist_length(struct SList *head);
 // clone the list, setting val pointers
 struct SList *slist_shallow_clone(struct SList *head);
 
-// sort into a new list
+// stable sort into a new list
 struct SList *slist_sort(struct SList *head, bool (*before)(const void *a, const void *b));
 
+// stable sort by relinking the list's own items, without allocating
+void slist_sort_in_place(struct SList **head, bool (*before)(const void *a, const void *b));
+
+// stable sort up to n vals into array, returning the number sorted
+unsigned long slist_sort_array(struct SList *head, bool (*before)(const void *a, const void *b), void **array, unsigned long n);
+
 // free list
 void slist_free(struct SList **head);
 
 // free list and vals, null free_val uses free()
 void slist_free_vals(struct SList **head, void (*free_val)(void *val));
 
+// append val to a list, O(1)
+struct SList *slist_header_append(struct SListHeader *list, void *val);
+
+// remove items, null test is val pointer comparison
+unsigned long slist_header_remove_all(struct SListHeader *list, bool (*equal)(const void *val, const void *data), const void *data);
+
+// free list
+void slist_header_free(struct SListHeader *list);
+
+// free list and vals, null free_val uses free()
+void slist_header_free_vals(struct SListHeader *list, void (*free_val)(void *val));
+
 // test val for equality using strcasecmp
 bool slist_equal_strcasecmp(const void *val, const void *data);
 
@@ -10,5 +10,7 @@ const struct zwlr_output_mode_v1_listener *mode_listener(void);
 // config
 const struct zwlr_output_configuration_v1_listener *output_configuration_listener(void);
 
+const struct zwlr_output_configuration_v1_listener *output_configuration_test_listener(void);
+
 #endif // LISTENERS_H
 
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#include "json.h"
+
 enum LogThreshold {
 	DEBUG = 1,
 	INFO,
@@ -11,14 +13,51 @@ enum LogThreshold {
 	LOG_THRESHOLD_DEFAULT = INFO,
 };
 
+enum LogFormat {
+	LOG_FORMAT_TEXT = 1,
+	LOG_FORMAT_JSON,
+	LOG_FORMAT_DEFAULT = LOG_FORMAT_TEXT,
+};
+
+// captured lines beyond either limit drop the oldest
+#define LOG_CAP_LINES 1024
+#define LOG_CAP_SIZE (64 * 1024)
+
 struct LogCapLine {
-	char *line;
+	const char *line;
 	enum LogThreshold threshold;
 };
-extern struct SList *log_cap_lines;
+
+// ring of captured lines, their text in a fixed arena
+struct LogCap {
+	struct LogCapLine lines[LOG_CAP_LINES];
+	size_t first;
+	size_t count;
+
+	char arena[LOG_CAP_SIZE];
+	size_t end;
+
+	// oldest lines dropped and the highest threshold among them
+	unsigned long dropped;
+	enum LogThreshold dropped_threshold;
+	struct LogCapLine dropped_line;
+	char dropped_text[64];
+};
+
+// allocated on first capture
+extern struct LogCap *log_cap;
+
+// lowest threshold printed or captured
+extern int log_gate;
+
+static inline bool log_enabled(enum LogThreshold threshold) {
+	return (int)threshold >= log_gate;
+}
 
 void log_set_threshold(enum LogThreshold threshold, bool cli);
 
+void log_set_format(enum LogFormat format, bool cli);
+
 void log_set_times(bool times);
 
 void log_(enum LogThreshold threshold, const char *__restrict __format, ...);
@@ -43,6 +82,16 @@ void log_suppress_start(void);
 
 void log_suppress_stop(void);
 
+// text is captured but not printed while a structured event stands in for it
+void log_hold_start(void);
+
+void log_hold_stop(void);
+
+// a JSON line with time, level and event name, to be completed with fields; NULL unless the format is JSON and threshold is printed
+struct Json *log_event_begin(enum LogThreshold threshold, const char *name);
+
+void log_event_end(void);
+
 void log_capture_start(void);
 
 void log_capture_stop(void);
@@ -51,5 +100,30 @@ void log_capture_clear(void);
 
 void log_capture_playback(void);
 
+// captured line i, oldest first, led by a line counting any dropped; NULL past the last
+const struct LogCapLine *log_cap_line(struct LogCap *cap, size_t i);
+
+void free_log_cap(void *data);
+
+// buffer lines for stdout and stderr unless they are regular files, dropping lines when full
+void log_sink_start(void);
+
+// write what fd will take without blocking; true when lines remain
+bool log_sink_flush(int fd);
+
+// write the remainder, blocking
+void log_sink_stop(void);
+
+// skip formatting when nothing would be printed or captured
+#define log_(threshold, ...) (log_enabled(threshold) ? log_(threshold, __VA_ARGS__) : (void)0)
+#define log_debug(...) (log_enabled(DEBUG) ? log_debug(__VA_ARGS__) : (void)0)
+#define log_debug_nocap(...) (log_enabled(DEBUG) ? log_debug_nocap(__VA_ARGS__) : (void)0)
+#define log_info(...) (log_enabled(INFO) ? log_info(__VA_ARGS__) : (void)0)
+#define log_warn(...) (log_enabled(WARNING) ? log_warn(__VA_ARGS__) : (void)0)
+#define log_warn_errno(...) (log_enabled(WARNING) ? log_warn_errno(__VA_ARGS__) : (void)0)
+#define log_error(...) (log_enabled(ERROR) ? log_error(__VA_ARGS__) : (void)0)
+#define log_error_nocap(...) (log_enabled(ERROR) ? log_error_nocap(__VA_ARGS__) : (void)0)
+#define log_error_errno(...) (log_enabled(ERROR) ? log_error_errno(__VA_ARGS__) : (void)0)
+
 #endif // LOG_H
 
@@ -14,6 +14,9 @@ char *marshal_ipc_request(struct IpcRequest *request);
 
 struct IpcRequest *unmarshal_ipc_request(char *yaml);
 
+// whether an unframed request is a whole document, quietly
+bool ipc_request_yaml_complete(const char *yaml);
+
 char *marshal_ipc_response(struct IpcResponse *response);
 
 struct IpcResponse *unmarshal_ipc_response(char *yaml);
@@ -2,7 +2,9 @@
 #define MODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "cfg.h"
 #include "list.h"
@@ -16,13 +18,51 @@ struct Mode {
 	int32_t height;
 	int32_t refresh_mhz;
 	bool preferred;
+
+	// position in the head's ModeTable
+	size_t index;
+};
+
+// modes sorted by resolution then refresh, descending, with failures as a bitmap by index
+struct ModeTable {
+	struct Mode **modes;
+	size_t count;
+	size_t available;
+	uint64_t *failed;
+
+	// available modes for head_find_mode
+	struct Mode *preferred;
+	struct Mode *max_preferred;
+	struct Mode *max;
+
+	// modes have changed since the last build
+	bool stale;
+};
+
+enum ModeValidity {
+	MODE_UNTESTED = 0,
+	MODE_VALID,
+	MODE_INVALID,
+};
+
+// rejected modes are persisted for this long
+#define MODE_VALIDATION_EXPIRY_SEC (30 * 24 * 60 * 60)
+
+// the compositor's verdict on a head's mode, kept across hotplugs and rejections across restarts
+struct ModeValidation {
+	char *head_identity;
+	int32_t width;
+	int32_t height;
+	int32_t refresh_mhz;
+	enum ModeValidity validity;
+	time_t recorded;
 };
 
 struct ModesResRefresh {
 	int32_t width;
 	int32_t height;
 	int32_t refresh_hz;
-	struct SList *modes;
+	struct SListHeader modes;
 };
 
 int32_t mhz_to_hz(int32_t mhz);
@@ -33,6 +73,36 @@ struct SList *modes_res_refresh(struct SList *modes);
 
 bool mrr_satisfies_user_mode(struct ModesResRefresh *mrr, struct UserMode *user_mode);
 
+void mode_table_build(struct ModeTable *table, struct SList *modes, struct SList *modes_failed);
+
+bool mode_table_failed(struct ModeTable *table, struct Mode *mode);
+
+void mode_table_fail(struct ModeTable *table, struct SList *modes, struct Mode *mode);
+
+void mode_table_remove(struct ModeTable *table, struct SList *modes, struct Mode *mode);
+
+struct Mode *mode_table_user_mode(struct ModeTable *table, struct UserMode *user_mode);
+
+void mode_table_free(struct ModeTable *table);
+
+struct ModeValidation *mode_validation_init(struct Mode *mode);
+
+bool mode_validation_matches(struct ModeValidation *validation, struct Mode *mode);
+
+void mode_validation_record(struct ModeValidation *validation);
+
+void mode_validated(struct Mode *mode, enum ModeValidity validity);
+
+enum ModeValidity mode_validity(struct Mode *mode);
+
+void mode_validations_load(void);
+
+void mode_validations_forget(void);
+
+void mode_validation_free(void *validation);
+
+void mode_validations_destroy(void);
+
 void mode_free(void *mode);
 
 void mode_res_refresh_free(void *mode);
@@ -0,0 +1,28 @@
+#ifndef POOL_H
+#define POOL_H
+
+enum PoolType {
+	POOL_SLIST = 1,
+	POOL_MODE,
+	POOL_HEAD,
+};
+
+struct PoolStats {
+	unsigned long live;
+	unsigned long high_water;
+	unsigned long capacity;
+};
+
+// zeroed object from the type's free list, adding a slab when empty
+void *pool_alloc(enum PoolType type);
+
+// return an object to the type's free list, null is ignored
+void pool_free(enum PoolType type, void *obj);
+
+struct PoolStats pool_stats(enum PoolType type);
+
+// release all slabs, invalidating any outstanding objects
+void pool_destroy(void);
+
+#endif // POOL_H
+
@@ -1,6 +1,8 @@
 #ifndef SOCKETS_H
 #define SOCKETS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/un.h>
 
@@ -10,11 +12,17 @@ int create_fd_ipc_server(void);
 
 int create_fd_ipc_client(void);
 
+bool set_socket_no_timeout(int fd);
+
 int socket_accept(int fd_sock);
 
-char *socket_read(int fd);
+ssize_t socket_read_nonblock(int fd, char **buf, size_t *len, size_t max, bool *eof);
+
+ssize_t socket_read_wait(int fd, char **buf, size_t *len, bool *eof);
 
 ssize_t socket_write(int fd, char *data, size_t len);
 
+ssize_t socket_write_nonblock(int fd, const char *data, size_t len);
+
 #endif // SOCKETS_H
 
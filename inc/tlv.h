@@ -0,0 +1,111 @@
+#ifndef TLV_H
+#define TLV_H
+
+#include <stddef.h>
+
+#include "ipc.h"
+
+// Compact binary IPC encoding.
+//
+// Each element is a type (uint16), a length (uint32) and that many bytes of value; integers
+// are in network order, floats as their IEEE 754 bits, strings without terminator.
+// Containers hold further elements and scope the meaning of their children's types.
+// Lists are repeated elements. The first element is always TLV_VERSION; unknown types are
+// skipped so that older readers tolerate additions.
+
+#define TLV_FORMAT_VERSION 1
+
+#define TLV_HEADER_SIZE 6
+
+enum TlvType {
+	TLV_VERSION = 1,
+
+	// request / response
+	TLV_OP,
+	TLV_DONE,
+	TLV_RC,
+	TLV_CFG,
+	TLV_STATE,
+	TLV_MESSAGE,
+
+	// CFG
+	TLV_ARRANGE,
+	TLV_ALIGN,
+	TLV_ORDER,
+	TLV_AUTO_SCALE,
+	TLV_SCALE,
+	TLV_MODE,
+	TLV_TRANSFORM,
+	TLV_LAPTOP_DISPLAY_PREFIX,
+	TLV_MAX_PREFERRED_REFRESH,
+	TLV_DISABLED,
+	TLV_LOG_THRESHOLD,
+
+	// SCALE, MODE, TRANSFORM entries
+	TLV_NAME_DESC,
+	TLV_WIDTH,
+	TLV_HEIGHT,
+	TLV_HZ,
+	TLV_MAX,
+	TLV_DEGREE,
+
+	// STATE
+	TLV_LID,
+	TLV_CLOSED,
+	TLV_DEVICE_PATH,
+	TLV_HEAD,
+	TLV_POOL,
+
+	// HEAD
+	TLV_NAME,
+	TLV_DESCRIPTION,
+	TLV_WIDTH_MM,
+	TLV_HEIGHT_MM,
+	TLV_MAKE,
+	TLV_MODEL,
+	TLV_SERIAL_NUMBER,
+	TLV_CURRENT,
+	TLV_DESIRED,
+
+	// HEAD CURRENT/DESIRED
+	TLV_ENABLED,
+	TLV_X,
+	TLV_Y,
+
+	// HEAD MODE
+	TLV_REFRESH_MHZ,
+	TLV_PREFERRED,
+
+	// POOL
+	TLV_LIVE,
+	TLV_HIGH_WATER,
+	TLV_CAPACITY,
+
+	// MESSAGE
+	TLV_THRESHOLD,
+	TLV_LINE,
+
+	// response, appended to keep earlier types stable
+	TLV_EVENT,
+
+	// request, uint64
+	TLV_SINCE,
+
+	// STATE
+	TLV_REVISION, // uint64
+	TLV_DELTA,
+
+	// CFG
+	TLV_LOG_FORMAT,
+};
+
+char *tlv_marshal_ipc_request(struct IpcRequest *request, size_t *len);
+
+struct IpcRequest *tlv_unmarshal_ipc_request(const char *buf, size_t len);
+
+char *tlv_marshal_ipc_response(struct IpcResponse *response, size_t *len);
+
+struct IpcResponse *tlv_unmarshal_ipc_response(const char *buf, size_t len);
+
+#endif // TLV_H
+
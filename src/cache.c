@@ -0,0 +1,399 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "cache.h"
+
+#include "cfg.h"
+#include "head.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "marshalling.h"
+#include "mode.h"
+#include "server.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// CachedLayout, most recently converged last
+static struct SList *layouts = NULL;
+
+// $XDG_CACHE_HOME/way-displays/name or ~/.cache/way-displays/name, creating the directories
+bool cache_path(const char *name, char *path, size_t npath) {
+	char dir[PATH_MAX];
+
+	// empty or relative is invalid and ignored, as per the XDG base directory spec
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	if (xdg_cache_home && xdg_cache_home[0] == '/') {
+		snprintf(dir, sizeof(dir), "%s", xdg_cache_home);
+	} else if (getenv("HOME")) {
+		snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+	} else {
+		return false;
+	}
+
+	mkdir(dir, 0700);
+	strncat(dir, "/way-displays", sizeof(dir) - strlen(dir) - 1);
+	mkdir(dir, 0700);
+
+	snprintf(path, npath, "%s/%s", dir, name);
+
+	return true;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *c = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= c[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+// marshalled cfg, hashed once per instance
+uint64_t hash_cfg(void) {
+	static struct {
+		unsigned long instance;
+		uint64_t hash;
+	} hashed = { 0 };
+
+	if (!cfg)
+		return 0;
+
+	if (!cfg->instance || hashed.instance != cfg->instance) {
+		char *yaml = marshal_cfg(cfg);
+
+		hashed.instance = cfg->instance;
+		hashed.hash = hash_bytes(FNV_OFFSET, yaml, yaml ? strlen(yaml) : 0);
+
+		free(yaml);
+	}
+
+	return hashed.hash;
+}
+
+// identities of the heads in any order, cfg and lid; 0 when a head cannot be identified
+uint64_t cache_layout_fingerprint(void) {
+	if (!heads)
+		return 0;
+
+	// sum is independent of discovery order and does not cancel identical heads
+	uint64_t heads_sum = 0;
+	for (struct SList *i = heads; i; i = i->nex) {
+		const char *identity = head_identity(i->val);
+		if (!identity)
+			return 0;
+
+		heads_sum += hash_bytes(FNV_OFFSET, identity, strlen(identity));
+	}
+
+	unsigned long heads_count = slist_length(heads);
+	bool closed = lid && lid->closed;
+
+	uint64_t fingerprint = hash_cfg();
+	fingerprint = hash_bytes(fingerprint, &heads_sum, sizeof(heads_sum));
+	fingerprint = hash_bytes(fingerprint, &heads_count, sizeof(heads_count));
+	fingerprint = hash_bytes(fingerprint, &closed, sizeof(closed));
+
+	return fingerprint ? fingerprint : 1;
+}
+
+bool equal_layout_fingerprint(const void *val, const void *data) {
+	return val && data && ((struct CachedLayout*)val)->fingerprint == *(uint64_t*)data;
+}
+
+bool equal_cached_head(const void *a, const void *b) {
+	const struct CachedHead *lhs = a;
+	const struct CachedHead *rhs = b;
+
+	return lhs && rhs &&
+		lhs->enabled == rhs->enabled &&
+		lhs->width == rhs->width &&
+		lhs->height == rhs->height &&
+		lhs->refresh_mhz == rhs->refresh_mhz &&
+		lhs->scale == rhs->scale &&
+		lhs->x == rhs->x &&
+		lhs->y == rhs->y &&
+		lhs->transform == rhs->transform &&
+		strcmp(lhs->head_identity, rhs->head_identity) == 0;
+}
+
+void cached_head_free(void *data) {
+	struct CachedHead *cached = data;
+
+	if (!cached)
+		return;
+
+	free(cached->head_identity);
+	free(cached);
+}
+
+void cached_layout_free(void *data) {
+	struct CachedLayout *layout = data;
+
+	if (!layout)
+		return;
+
+	slist_free_vals(&layout->heads, cached_head_free);
+	free(layout);
+}
+
+// one layout line followed by its heads:
+// L fingerprint recorded
+// H enabled width height refresh_mhz scale x y transform identity
+void cache_layouts_write(void) {
+	char path[PATH_MAX];
+	char path_tmp[PATH_MAX + 4];
+
+	if (!cache_path("layouts", path, sizeof(path)))
+		return;
+
+	snprintf(path_tmp, sizeof(path_tmp), "%s.tmp", path);
+
+	FILE *f = fopen(path_tmp, "w");
+	if (!f) {
+		log_warn_errno("\nUnable to write %s", path_tmp);
+		return;
+	}
+
+	for (struct SList *i = layouts; i; i = i->nex) {
+		struct CachedLayout *layout = i->val;
+
+		fprintf(f, "L %016llx %ld\n", (unsigned long long)layout->fingerprint, (long)layout->recorded);
+
+		for (struct SList *j = layout->heads; j; j = j->nex) {
+			struct CachedHead *cached = j->val;
+			fprintf(f, "H %d %d %d %d %d %d %d %d %s\n",
+					cached->enabled,
+					cached->width,
+					cached->height,
+					cached->refresh_mhz,
+					cached->scale,
+					cached->x,
+					cached->y,
+					cached->transform,
+					cached->head_identity
+					);
+		}
+	}
+
+	fclose(f);
+
+	if (rename(path_tmp, path) == -1) {
+		log_warn_errno("\nUnable to write %s", path);
+	}
+}
+
+// drop the least recently converged beyond CACHE_LAYOUTS_MAX
+void layouts_trim(void) {
+	while (slist_length(layouts) > CACHE_LAYOUTS_MAX) {
+		struct SList *oldest = layouts;
+		cached_layout_free(slist_remove(&layouts, &oldest));
+	}
+}
+
+// a mode of the head matching cached, not known to fail
+struct Mode *cached_head_mode(struct Head *head, struct CachedHead *cached) {
+	for (struct SList *i = head->modes.first; i; i = i->nex) {
+		struct Mode *mode = i->val;
+		if (mode->width == cached->width &&
+				mode->height == cached->height &&
+				mode->refresh_mhz == cached->refresh_mhz &&
+				!slist_find_equal(head->modes_failed, NULL, mode) &&
+				mode_validity(mode) != MODE_INVALID) {
+			return mode;
+		}
+	}
+	return NULL;
+}
+
+// desire the layout converged previously for these heads, cfg and lid; false when there is none or it no longer fits
+bool cache_layout_desire(void) {
+	uint64_t fingerprint = cache_layout_fingerprint();
+	if (!fingerprint)
+		return false;
+
+	struct CachedLayout *layout = slist_find_equal_val(layouts, equal_layout_fingerprint, &fingerprint);
+	if (!layout)
+		return false;
+
+	unsigned long n = slist_length(heads);
+	if (slist_length(layout->heads) != n)
+		return false;
+
+	struct CachedHead **cached = calloc(n, sizeof(struct CachedHead*));
+	struct Mode **modes = calloc(n, sizeof(struct Mode*));
+	bool fits = true;
+
+	unsigned long h = 0;
+	for (struct SList *i = heads; fits && i; i = i->nex, h++) {
+		struct Head *head = i->val;
+
+		const char *identity = head_identity(head);
+		for (struct SList *j = layout->heads; identity && j; j = j->nex) {
+			if (strcmp(((struct CachedHead*)j->val)->head_identity, identity) == 0) {
+				cached[h] = j->val;
+				break;
+			}
+		}
+
+		if (!cached[h]) {
+			fits = false;
+			break;
+		}
+
+		// identical heads cannot be told apart
+		for (unsigned long k = 0; k < h; k++) {
+			if (cached[k] == cached[h]) {
+				fits = false;
+			}
+		}
+
+		if (cached[h]->enabled && !(modes[h] = cached_head_mode(head, cached[h]))) {
+			fits = false;
+		}
+	}
+
+	if (fits) {
+		h = 0;
+		for (struct SList *i = heads; i; i = i->nex, h++) {
+			struct Head *head = i->val;
+
+			memcpy(&head->desired, &head->current, sizeof(struct HeadState));
+
+			head->desired.enabled = cached[h]->enabled;
+			if (cached[h]->enabled) {
+				head->desired.mode = modes[h];
+				head->desired.scale = cached[h]->scale;
+				head->desired.x = cached[h]->x;
+				head->desired.y = cached[h]->y;
+				head->desired.transform = cached[h]->transform;
+
+				head_scaled_dimensions(head);
+			}
+		}
+	}
+
+	free(cached);
+	free(modes);
+
+	return fits;
+}
+
+// remember the current layout of all heads, which must be as desired
+void cache_layout_store(void) {
+	uint64_t fingerprint = cache_layout_fingerprint();
+	if (!fingerprint || slist_find(heads, head_current_not_desired))
+		return;
+
+	struct CachedLayout *layout = calloc(1, sizeof(struct CachedLayout));
+	layout->fingerprint = fingerprint;
+	layout->recorded = time(NULL);
+
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+
+		struct CachedHead *cached = calloc(1, sizeof(struct CachedHead));
+		cached->head_identity = strdup(head_identity(head));
+		cached->enabled = head->current.enabled && head->current.mode;
+		if (cached->enabled) {
+			cached->width = head->current.mode->width;
+			cached->height = head->current.mode->height;
+			cached->refresh_mhz = head->current.mode->refresh_mhz;
+			cached->scale = head->current.scale;
+			cached->x = head->current.x;
+			cached->y = head->current.y;
+			cached->transform = head->current.transform;
+		}
+
+		slist_append(&layout->heads, cached);
+	}
+
+	// unchanged: most recent in memory only
+	struct SList *existing = slist_find_equal(layouts, equal_layout_fingerprint, &fingerprint);
+	bool unchanged = existing && slist_equal(((struct CachedLayout*)existing->val)->heads, layout->heads, equal_cached_head);
+
+	slist_remove_all_free(&layouts, equal_layout_fingerprint, &fingerprint, cached_layout_free);
+	slist_append(&layouts, layout);
+
+	if (unchanged)
+		return;
+
+	layouts_trim();
+
+	log_debug("\nCached layout %016llx", (unsigned long long)fingerprint);
+
+	cache_layouts_write();
+}
+
+void cache_layouts_load(void) {
+	char path[PATH_MAX];
+
+	if (!cache_path("layouts", path, sizeof(path)))
+		return;
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+
+	struct CachedLayout *layout = NULL;
+	unsigned int loaded = 0;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long fingerprint;
+		long recorded;
+		int enabled, scale, transform;
+		int32_t width, height, refresh_mhz, x, y;
+		int identity_at = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		if (sscanf(line, "L %llx %ld", &fingerprint, &recorded) == 2) {
+			layout = calloc(1, sizeof(struct CachedLayout));
+			layout->fingerprint = fingerprint;
+			layout->recorded = recorded;
+
+			slist_remove_all_free(&layouts, equal_layout_fingerprint, &layout->fingerprint, cached_layout_free);
+			slist_append(&layouts, layout);
+			loaded++;
+
+		} else if (layout && sscanf(line, "H %d %d %d %d %d %d %d %d%n",
+					&enabled, &width, &height, &refresh_mhz, &scale, &x, &y, &transform, &identity_at) == 8 &&
+				line[identity_at] == ' ' && line[identity_at + 1]) {
+			// exactly one space before the identity, which may itself start with one
+			struct CachedHead *cached = calloc(1, sizeof(struct CachedHead));
+			cached->head_identity = strdup(line + identity_at + 1);
+			cached->enabled = enabled;
+			cached->width = width;
+			cached->height = height;
+			cached->refresh_mhz = refresh_mhz;
+			cached->scale = scale;
+			cached->x = x;
+			cached->y = y;
+			cached->transform = transform;
+
+			slist_append(&layout->heads, cached);
+		}
+	}
+
+	fclose(f);
+
+	// the file may hold more, when edited or written by another build
+	layouts_trim();
+
+	log_debug("\nLoaded %u layouts from %s", loaded, path);
+}
+
+void cache_layouts_destroy(void) {
+	slist_free_vals(&layouts, cached_layout_free);
+}
+
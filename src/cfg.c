@@ -188,6 +188,8 @@ void warn_short_name_desc(const char *name_desc, const char *element) {
 	}
 }
 
+static unsigned long cfg_instances = 0;
+
 struct Cfg *clone_cfg(struct Cfg *from) {
 	if (!from) {
 		return NULL;
@@ -200,6 +202,9 @@ struct Cfg *clone_cfg(struct Cfg *from) {
 	to->file_path = from->file_path ? strdup(from->file_path) : NULL;
 	to->file_name = from->file_name ? strdup(from->file_name) : NULL;
 
+	to->generation = from->generation;
+	to->instance = ++cfg_instances;
+
 	// ARRANGE
 	if (from->arrange) {
 		to->arrange = from->arrange;
@@ -271,6 +276,11 @@ struct Cfg *clone_cfg(struct Cfg *from) {
 		to->log_threshold = from->log_threshold;
 	}
 
+	// LOG_FORMAT
+	if (from->log_format) {
+		to->log_format = from->log_format;
+	}
+
 	return to;
 }
 
@@ -336,12 +346,18 @@ bool equal_cfg(struct Cfg *a, struct Cfg* b) {
 		return false;
 	}
 
+	// LOG_FORMAT
+	if (a->log_format != b->log_format) {
+		return false;
+	}
+
 	return true;
 }
 
 struct Cfg *cfg_default(void) {
 	struct Cfg *def = (struct Cfg*)calloc(1, sizeof(struct Cfg));
 
+	def->instance = ++cfg_instances;
 	def->arrange = ARRANGE_DEFAULT;
 	def->align = ALIGN_DEFAULT;
 	def->auto_scale = AUTO_SCALE_DEFAULT;
@@ -602,6 +618,8 @@ struct Cfg *cfg_merge(struct Cfg *to, struct Cfg *from, bool del) {
 		if (equal_cfg(merged, to)) {
 			cfg_free(merged);
 			merged = NULL;
+		} else {
+			merged->generation = to->generation + 1;
 		}
 	}
 
@@ -653,9 +671,11 @@ void cfg_file_reload(void) {
 
 	log_info("\nReloading configuration file: %s", cfg->file_path);
 	if (unmarshal_cfg_from_file(reloaded)) {
+		reloaded->generation = cfg->generation + (equal_cfg(reloaded, cfg) ? 0 : 1);
 		cfg_free(cfg);
 		cfg = reloaded;
 		log_set_threshold(cfg->log_threshold, false);
+		log_set_format(cfg->log_format, false);
 		validate_fix(cfg);
 		log_info("\nNew configuration:");
 		print_cfg(INFO, cfg, false);
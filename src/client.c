@@ -12,6 +12,18 @@
 #include "process.h"
 
 
+// the CFG and STATE a subscription delivered, changes only after the first
+void print_delivered(struct IpcResponse *ipc_response) {
+	if (ipc_response->cfg) {
+		log_info("\nConfiguration:");
+		print_cfg(INFO, ipc_response->cfg, false);
+	}
+
+	print_lid(INFO, ipc_response->lid);
+
+	print_heads(INFO, NONE, ipc_response->heads);
+}
+
 int client(struct IpcRequest *ipc_request) {
 	if (!ipc_request) {
 		return EXIT_FAILURE;
@@ -30,19 +42,28 @@ int client(struct IpcRequest *ipc_request) {
 	log_info("\nClient sending request: %s", ipc_request_command_friendly(ipc_request->command));
 	print_cfg(INFO, ipc_request->cfg, ipc_request->command == CFG_DEL);
 
-	int fd = ipc_request_send(ipc_request);
+	int fd = ipc_request_send(ipc_request, IPC_ENCODING_BINARY);
 	if (fd == -1) {
 		rc = EXIT_FAILURE;
 		goto end;
 	}
 
+	struct IpcConnection connection = { .fd = fd, };
 	struct IpcResponse *ipc_response;
 	bool done = false;
 	while (!done) {
-		ipc_response = ipc_response_receive(fd);
+		ipc_response = ipc_response_receive(&connection);
 		if (ipc_response) {
 			rc = ipc_response->rc;
 			done = ipc_response->done;
+			for (int ev = 1; ev <= IPC_EVENT_MAX; ev++) {
+				if (ipc_response->events & IPC_EVENT_BIT(ev)) {
+					log_info("\nEvent: %s", ipc_event_name(ev));
+				}
+			}
+			if (ipc_request->command == SUBSCRIBE) {
+				print_delivered(ipc_response);
+			}
 			free_ipc_response(ipc_response);
 		} else {
 			rc = IPC_RC_BAD_RESPONSE;
@@ -50,6 +71,8 @@ int client(struct IpcRequest *ipc_request) {
 		}
 	}
 
+	free(connection.buf);
+
 	close(fd);
 
 end:
@@ -7,6 +7,7 @@
 #include "cfg.h"
 #include "ipc.h"
 #include "log.h"
+#include "pool.h"
 
 struct NameVal {
 	unsigned int val;
@@ -27,6 +28,7 @@ static struct NameVal cfg_elements[] = {
 	{ .val = LOG_THRESHOLD,         .name = "LOG_THRESHOLD",         },
 	{ .val = DISABLED,              .name = "DISABLED",              },
 	{ .val = ARRANGE_ALIGN,         .name = "ARRANGE_ALIGN",         },
+	{ .val = LOG_FORMAT,            .name = "LOG_FORMAT",            },
 	{ .val = 0,                     .name = NULL,                    },
 };
 
@@ -56,11 +58,22 @@ static struct NameVal auto_scales[] = {
 };
 
 static struct NameVal ipc_request_commands[] = {
-	{ .val = GET,       .name = "GET",       .friendly = "get",    },
-	{ .val = CFG_SET,   .name = "CFG_SET",   .friendly = "set",    },
-	{ .val = CFG_DEL,   .name = "CFG_DEL",   .friendly = "delete", },
-	{ .val = CFG_WRITE, .name = "CFG_WRITE", .friendly = "write",  },
-	{ .val = 0,         .name = NULL,        .friendly = NULL,     },
+	{ .val = GET,          .name = "GET",          .friendly = "get",       },
+	{ .val = CFG_SET,      .name = "CFG_SET",      .friendly = "set",       },
+	{ .val = CFG_DEL,      .name = "CFG_DEL",      .friendly = "delete",    },
+	{ .val = CFG_WRITE,    .name = "CFG_WRITE",    .friendly = "write",     },
+	{ .val = SUBSCRIBE,    .name = "SUBSCRIBE",    .friendly = "subscribe", },
+	{ .val = MODES_FORGET, .name = "MODES_FORGET", .friendly = "forget",    },
+	{ .val = 0,            .name = NULL,           .friendly = NULL,        },
+};
+
+static struct NameVal ipc_events[] = {
+	{ .val = IPC_EVENT_HEADS,     .name = "HEADS",     },
+	{ .val = IPC_EVENT_LID,       .name = "LID",       },
+	{ .val = IPC_EVENT_CFG,       .name = "CFG",       },
+	{ .val = IPC_EVENT_SUCCEEDED, .name = "SUCCEEDED", },
+	{ .val = IPC_EVENT_FAILED,    .name = "FAILED",    },
+	{ .val = 0,                   .name = NULL,        },
 };
 
 static struct NameVal log_thresholds[] = {
@@ -71,6 +84,19 @@ static struct NameVal log_thresholds[] = {
 	{ .val = 0,       .name = NULL,      },
 };
 
+static struct NameVal log_formats[] = {
+	{ .val = LOG_FORMAT_TEXT, .name = "TEXT", },
+	{ .val = LOG_FORMAT_JSON, .name = "JSON", },
+	{ .val = 0,               .name = NULL,   },
+};
+
+static struct NameVal pool_types[] = {
+	{ .val = POOL_SLIST, .name = "SLIST", },
+	{ .val = POOL_MODE,  .name = "MODE",  },
+	{ .val = POOL_HEAD,  .name = "HEAD",  },
+	{ .val = 0,          .name = NULL,    },
+};
+
 unsigned int val(struct NameVal *name_vals, const char *name) {
 	if (!name_vals || !name) {
 		return 0;
@@ -167,6 +193,14 @@ const char *ipc_request_command_friendly(enum IpcRequestCommand ipc_request_op)
 	return friendly(ipc_request_commands, ipc_request_op);
 }
 
+enum IpcEvent ipc_event_val(const char *name) {
+	return val(ipc_events, name);
+}
+
+const char *ipc_event_name(enum IpcEvent ipc_event) {
+	return name(ipc_events, ipc_event);
+}
+
 enum LogThreshold log_threshold_val(const char *name) {
 	return val(log_thresholds, name);
 }
@@ -175,3 +209,15 @@ const char *log_threshold_name(enum LogThreshold log_threshold) {
 	return friendly(log_thresholds, log_threshold);
 }
 
+enum LogFormat log_format_val(const char *name) {
+	return val(log_formats, name);
+}
+
+const char *log_format_name(enum LogFormat log_format) {
+	return name(log_formats, log_format);
+}
+
+const char *pool_type_name(enum PoolType pool_type) {
+	return name(pool_types, pool_type);
+}
+
@@ -1,38 +1,48 @@
-#include <poll.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/signalfd.h>
 #include <unistd.h>
-#include <wayland-client-core.h>
 
 #include "fds.h"
 
 #include "cfg.h"
-#include "lid.h"
+#include "list.h"
 #include "log.h"
-#include "displ.h"
 #include "process.h"
 #include "server.h"
 #include "sockets.h"
 
-#define PFDS_SIZE 5
+#define FDS_EVENTS_MAX 16
+
+struct FdRegistration {
+	int fd;
+	uint32_t events;
+	void (*handler)(int fd, void *data);
+	void *data;
+	void (*handler_writable)(int fd, void *data);
+	void *data_writable;
+};
 
 int fd_signal = -1;
 int fd_ipc = -1;
 int fd_cfg_dir = -1;
-bool fds_created = false;
 
-nfds_t npfds = 0;
-struct pollfd pfds[PFDS_SIZE];
+int fd_epoll = -1;
+
+struct SList *registrations = NULL;
+
+// unregistered during a dispatch, freed once it completes
+struct SList *registrations_released = NULL;
 
-struct pollfd *pfd_signal = NULL;
-struct pollfd *pfd_ipc = NULL;
-struct pollfd *pfd_wayland = NULL;
-struct pollfd *pfd_lid = NULL;
-struct pollfd *pfd_cfg_dir = NULL;
+struct epoll_event events[FDS_EVENTS_MAX];
+int nevents = 0;
 
 int create_fd_signal(void) {
 	sigset_t mask;
@@ -58,69 +68,147 @@ int create_fd_cfg_dir(void) {
 	return fd_cfg_dir;
 }
 
-void create_fds(void) {
+bool registration_has_fd(const void *val, const void *data) {
+	const struct FdRegistration *registration = val;
+
+	return registration && registration->fd == *(const int*)data;
+}
+
+void fds_init(void) {
+	fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (fd_epoll == -1) {
+		log_error_errno("\nunable to create epoll instance, exiting");
+		exit_fail();
+	}
+
 	fd_signal = create_fd_signal();
 	fd_ipc = create_fd_ipc_server();
 	fd_cfg_dir = create_fd_cfg_dir();
+}
+
+bool register_events(int fd, uint32_t events, void (*handler)(int fd, void *data), void *data) {
+	if (fd == -1)
+		return false;
 
-	fds_created = true;
+	struct FdRegistration *registration = calloc(1, sizeof(struct FdRegistration));
+	registration->fd = fd;
+	registration->events = events;
+	if (events & EPOLLOUT) {
+		registration->handler_writable = handler;
+		registration->data_writable = data;
+	} else {
+		registration->handler = handler;
+		registration->data = data;
+	}
+
+	struct epoll_event event = { .events = events, .data.ptr = registration, };
+	if (epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+		log_error_errno("\nunable to watch fd %d", fd);
+		free(registration);
+		return false;
+	}
+
+	slist_append(&registrations, registration);
+
+	return true;
 }
 
-void init_pfds(void) {
-	if (!fds_created)
-		create_fds();
-
-	// wayland and signal are always present, others are optional
-	npfds = 2;
-	if (lid)
-		npfds++;
-	if (fd_ipc != -1)
-		npfds++;
-	if (fd_cfg_dir != -1)
-		npfds++;
-
-	int i = 0;
-
-	pfd_signal = &pfds[i++];
-	pfd_signal->fd = fd_signal;
-	pfd_signal->events = POLLIN;
-
-	pfd_wayland = &pfds[i++];
-	pfd_wayland->fd = wl_display_get_fd(displ->display);
-	pfd_wayland->events = POLLIN;
-
-	if (fd_ipc != -1) {
-		pfd_ipc = &pfds[i++];
-		pfd_ipc->fd = fd_ipc;
-		pfd_ipc->events = POLLIN;
+bool modify_events(struct FdRegistration *registration, uint32_t events) {
+	struct epoll_event event = { .events = events, .data.ptr = registration, };
+	if (epoll_ctl(fd_epoll, EPOLL_CTL_MOD, registration->fd, &event) == -1) {
+		log_error_errno("\nunable to watch fd %d", registration->fd);
+		return false;
 	}
 
-	if (lid) {
-		pfd_lid = &pfds[i++];
-		pfd_lid->fd = lid->libinput_fd;
-		pfd_lid->events = POLLIN;
+	registration->events = events;
+
+	return true;
+}
+
+bool fds_register(int fd, void (*handler)(int fd, void *data), void *data) {
+	return register_events(fd, EPOLLIN, handler, data);
+}
+
+bool fds_register_writable(int fd, void (*handler)(int fd, void *data), void *data) {
+	struct FdRegistration *registration = slist_find_equal_val(registrations, registration_has_fd, &fd);
+	if (!registration) {
+		return register_events(fd, EPOLLOUT, handler, data);
 	}
 
-	if (fd_cfg_dir != -1) {
-		pfd_cfg_dir = &pfds[i++];
-		pfd_cfg_dir->fd = fd_cfg_dir;
-		pfd_cfg_dir->events = POLLIN;
+	registration->handler_writable = handler;
+	registration->data_writable = data;
+
+	return registration->events & EPOLLOUT || modify_events(registration, registration->events | EPOLLOUT);
+}
+
+void fds_unregister(int fd) {
+	struct FdRegistration *registration = slist_find_equal_val(registrations, registration_has_fd, &fd);
+	if (!registration)
+		return;
+
+	epoll_ctl(fd_epoll, EPOLL_CTL_DEL, fd, NULL);
+
+	slist_remove_all(&registrations, NULL, registration);
+
+	// events from the current wait may still reference it
+	registration->fd = -1;
+	registration->handler = NULL;
+	registration->handler_writable = NULL;
+	slist_append(&registrations_released, registration);
+}
+
+void fds_unregister_writable(int fd) {
+	struct FdRegistration *registration = slist_find_equal_val(registrations, registration_has_fd, &fd);
+	if (!registration || !(registration->events & EPOLLOUT))
+		return;
+
+	if (!(registration->events & ~EPOLLOUT)) {
+		fds_unregister(fd);
+		return;
 	}
+
+	registration->handler_writable = NULL;
+	modify_events(registration, registration->events & ~EPOLLOUT);
+}
+
+int fds_wait(int timeout) {
+	slist_free_vals(&registrations_released, NULL);
+
+	nevents = epoll_wait(fd_epoll, events, FDS_EVENTS_MAX, timeout);
+
+	if (nevents == -1 && errno == EINTR) {
+		nevents = 0;
+	}
+
+	return nevents;
+}
+
+void fds_dispatch(void) {
+	for (int i = 0; i < nevents; i++) {
+		struct FdRegistration *registration = events[i].data.ptr;
+
+		// hangups and errors go to either; the first may unregister
+		if (registration->handler && events[i].events & ~EPOLLOUT) {
+			registration->handler(registration->fd, registration->data);
+		}
+		if (registration->handler_writable && events[i].events & ~EPOLLIN) {
+			registration->handler_writable(registration->fd, registration->data_writable);
+		}
+	}
+	nevents = 0;
+
+	slist_free_vals(&registrations_released, NULL);
 }
 
-void destroy_pfds(void) {
-	npfds = 0;
+void fds_destroy(void) {
+	slist_free_vals(&registrations, NULL);
+	slist_free_vals(&registrations_released, NULL);
 
-	pfd_signal = NULL;
-	pfd_wayland = NULL;
-	pfd_lid = NULL;
-	pfd_ipc = NULL;
-	pfd_cfg_dir = NULL;
+	nevents = 0;
 
-	for (size_t i = 0; i < PFDS_SIZE; i++) {
-		pfds[i].fd = 0;
-		pfds[i].events = 0;
-		pfds[i].revents = 0;
+	if (fd_epoll != -1) {
+		close(fd_epoll);
+		fd_epoll = -1;
 	}
 }
 
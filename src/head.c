@@ -1,9 +1,10 @@
+#include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 #include <wayland-util.h>
 #include <wayland-client-protocol.h>
 
@@ -14,154 +15,154 @@
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "pool.h"
 #include "server.h"
 
 struct SList *heads = NULL;
 struct SList *heads_arrived = NULL;
 struct SList *heads_departed = NULL;
 
-bool head_is_max_preferred_refresh(struct Head *head) {
-	if (!head)
-		return false;
+unsigned long heads_generation = 0;
 
-	for (struct SList *i = cfg->max_preferred_refresh_name_desc; i; i = i->nex) {
-		if (head_matches_name_desc(i->val, head)) {
-			return true;
-		}
+static const char *LAPTOP_DISPLAY_PREFIX_DEFAULT = "eDP";
+
+char *lowercase_dup(const char *s) {
+	if (!s)
+		return NULL;
+
+	char *lowered = strdup(s);
+	for (char *c = lowered; *c; c++) {
+		*c = (char)tolower((unsigned char)*c);
 	}
-	return false;
+	return lowered;
 }
 
-bool head_matches_user_mode(const void *user_mode, const void *head) {
-	return user_mode && head && head_matches_name_desc(((struct UserMode*)user_mode)->name_desc, (struct Head*)head);
-}
+// name_desc matches the name exactly or is within the description, all lowercased
+bool name_desc_matches_lowered(const char *name_desc, const char *name, const char *description) {
+	if (!name_desc)
+		return false;
 
-bool head_matches_user_transform(const void *user_transform, const void *head) {
-	return user_transform && head && head_matches_name_desc(((struct UserTransform*)user_transform)->name_desc, (struct Head*)head);
+	return (name && strcmp(name_desc, name) == 0) || (description && strstr(description, name_desc));
 }
 
-struct Mode *user_mode(struct Head *head, struct UserMode *user_mode) {
-	if (!head || !head->name || !user_mode)
-		return NULL;
+// lowercased copies of each name_desc, NULL for none
+struct SList *name_descs_lowered(struct SList *list, const char *(*name_desc)(const void *val)) {
+	struct SList *lowered = NULL;
 
-	struct SList *i, *j;
-
-	// highest mode matching the user mode
-	struct SList *mrrs = modes_res_refresh(head->modes);
-	for (i = mrrs; i; i = i->nex) {
-		struct ModesResRefresh *mrr = i->val;
-		if (mrr && mrr_satisfies_user_mode(mrr, user_mode)) {
-			for (j = mrr->modes; j; j = j->nex) {
-				struct Mode *mode = j->val;
-				if (!slist_find_equal(head->modes_failed, NULL, mode)) {
-					slist_free_vals(&mrrs, mode_res_refresh_free);
-					return mode;
-				}
-			}
-		}
+	for (struct SList *i = list; i; i = i->nex) {
+		slist_append(&lowered, lowercase_dup(name_desc ? name_desc(i->val) : i->val));
 	}
-	slist_free_vals(&mrrs, mode_res_refresh_free);
 
-	return NULL;
+	return lowered;
 }
 
-struct Mode *preferred_mode(struct Head *head) {
-	if (!head)
-		return NULL;
-
-	struct Mode *mode = NULL;
-	for (struct SList *i = head->modes; i; i = i->nex) {
-		if (!i->val)
-			continue;
-		mode = i->val;
-
-		if (mode->preferred && !slist_find_equal(head->modes_failed, NULL, mode)) {
-			return mode;
-		}
-	}
+const char *user_scale_name_desc(const void *val) {
+	return ((struct UserScale*)val)->name_desc;
+}
 
-	return NULL;
+const char *user_mode_name_desc(const void *val) {
+	return ((struct UserMode*)val)->name_desc;
 }
 
-struct Mode *max_preferred_mode(struct Head *head) {
-	struct Mode *preferred = preferred_mode(head);
+const char *user_transform_name_desc(const void *val) {
+	return ((struct UserTransform*)val)->name_desc;
+}
 
-	if (!preferred)
-		return NULL;
+// the cfg's name_desc and laptop prefix, lowercased once per instance and parallel to the cfg's lists
+static struct {
+	unsigned long instance;
+	struct SList *order;
+	struct SList *user_scales;
+	struct SList *user_modes;
+	struct SList *user_transform;
+	struct SList *max_preferred_refresh;
+	struct SList *disabled;
+	char *laptop_prefix;
+} lowered = { 0 };
+
+void lowered_free(void) {
+	slist_free_vals(&lowered.order, NULL);
+	slist_free_vals(&lowered.user_scales, NULL);
+	slist_free_vals(&lowered.user_modes, NULL);
+	slist_free_vals(&lowered.user_transform, NULL);
+	slist_free_vals(&lowered.max_preferred_refresh, NULL);
+	slist_free_vals(&lowered.disabled, NULL);
+	free(lowered.laptop_prefix);
+	lowered.laptop_prefix = NULL;
+	lowered.instance = 0;
+}
 
-	struct Mode *mode = NULL, *max = NULL;
+void lowered_cfg(void) {
+	if (cfg->instance && lowered.instance == cfg->instance)
+		return;
 
-	for (struct SList *i = head->modes; i; i = i->nex) {
-		if (!i->val)
-			continue;
-		mode = i->val;
+	lowered_free();
 
-		if (slist_find_equal(head->modes_failed, NULL, mode)) {
-			continue;
-		}
+	lowered.instance = cfg->instance;
+	lowered.order = name_descs_lowered(cfg->order_name_desc, NULL);
+	lowered.user_scales = name_descs_lowered(cfg->user_scales, user_scale_name_desc);
+	lowered.user_modes = name_descs_lowered(cfg->user_modes, user_mode_name_desc);
+	lowered.user_transform = name_descs_lowered(cfg->user_transform, user_transform_name_desc);
+	lowered.max_preferred_refresh = name_descs_lowered(cfg->max_preferred_refresh_name_desc, NULL);
+	lowered.disabled = name_descs_lowered(cfg->disabled_name_desc, NULL);
+	lowered.laptop_prefix = lowercase_dup(cfg->laptop_display_prefix ? cfg->laptop_display_prefix : LAPTOP_DISPLAY_PREFIX_DEFAULT);
+}
 
-		if (mode->width != preferred->width || mode->height != preferred->height) {
-			continue;
-		}
+// resolve the cfg elements matching this head, when cfg or the head has changed since last bound
+void head_bind(struct Head *head) {
+	if (!head || !cfg)
+		return;
 
-		if (!max) {
-			max = mode;
-		} else if (mode->refresh_mhz > max->refresh_mhz) {
-			max = mode;
-		}
-	}
+	if (head->bindings.cfg_instance == cfg->instance && head->bindings.generation == head->generation)
+		return;
 
-	return max;
-}
+	memset(&head->bindings, 0, sizeof(head->bindings));
+	head->bindings.cfg_instance = cfg->instance;
+	head->bindings.generation = head->generation;
 
-struct Mode *max_mode(struct Head *head) {
-	if (!head)
-		return NULL;
+	lowered_cfg();
 
-	struct Mode *mode = NULL, *max = NULL;
-	for (struct SList *i = head->modes; i; i = i->nex) {
-		if (!i->val)
-			continue;
-		mode = i->val;
+	// lowercased once for all the cfg's name_desc
+	char *name = lowercase_dup(head->name);
+	char *description = lowercase_dup(head->description);
+	struct SList *i, *l;
 
-		if (slist_find_equal(head->modes_failed, NULL, mode)) {
-			continue;
+	unsigned int order = 0;
+	head->bindings.order = UINT_MAX;
+	for (l = lowered.order; l; l = l->nex, order++) {
+		if (name_desc_matches_lowered(l->val, name, description)) {
+			head->bindings.order = order;
+			break;
 		}
+	}
 
-		if (!max) {
-			max = mode;
-			continue;
+	// first matching element wins
+	for (i = cfg->user_scales, l = lowered.user_scales; i && l && !head->bindings.user_scale; i = i->nex, l = l->nex) {
+		if (name_desc_matches_lowered(l->val, name, description)) {
+			head->bindings.user_scale = i->val;
 		}
-
-		// highest resolution
-		if (mode->width * mode->height > max->width * max->height) {
-			max = mode;
-			continue;
+	}
+	for (i = cfg->user_modes, l = lowered.user_modes; i && l && !head->bindings.user_mode; i = i->nex, l = l->nex) {
+		if (name_desc_matches_lowered(l->val, name, description)) {
+			head->bindings.user_mode = i->val;
 		}
-
-		// highest refresh at highest resolution
-		if (mode->width == max->width &&
-				mode->height == max->height &&
-				mode->refresh_mhz > max->refresh_mhz) {
-			max = mode;
-			continue;
+	}
+	for (i = cfg->user_transform, l = lowered.user_transform; i && l && !head->bindings.user_transform; i = i->nex, l = l->nex) {
+		if (name_desc_matches_lowered(l->val, name, description)) {
+			head->bindings.user_transform = i->val;
 		}
 	}
+	for (l = lowered.max_preferred_refresh; l && !head->bindings.max_preferred_refresh; l = l->nex) {
+		head->bindings.max_preferred_refresh = name_desc_matches_lowered(l->val, name, description);
+	}
+	for (l = lowered.disabled; l && !head->bindings.disabled; l = l->nex) {
+		head->bindings.disabled = name_desc_matches_lowered(l->val, name, description);
+	}
 
-	return max;
-}
-
-bool head_matches_name_desc(const void *a, const void *b) {
-	const char *name_desc = a;
-	const struct Head *head = b;
-
-	if (!name_desc || !head)
-		return false;
+	head->bindings.laptop = name && strncmp(lowered.laptop_prefix, name, strlen(lowered.laptop_prefix)) == 0;
 
-	return (
-			(head->name && strcasecmp(name_desc, head->name) == 0) ||
-			(head->description && strcasestr(head->description, name_desc))
-		   );
+	free(name);
+	free(description);
 }
 
 wl_fixed_t head_auto_scale(struct Head *head) {
@@ -203,7 +204,11 @@ struct Mode *head_find_mode(struct Head *head) {
 	if (!head)
 		return NULL;
 
-	if (slist_length(head->modes) == slist_length(head->modes_failed)) {
+	if (head->mode_table.stale) {
+		head_index_modes(head);
+	}
+
+	if (!head->mode_table.available) {
 		return NULL;
 	}
 
@@ -211,10 +216,12 @@ struct Mode *head_find_mode(struct Head *head) {
 
 	struct Mode *mode = NULL;
 
+	head_bind(head);
+
 	// maybe a user mode
-	struct UserMode *um = slist_find_equal_val(cfg->user_modes, head_matches_user_mode, head);
+	struct UserMode *um = head->bindings.user_mode;
 	if (um) {
-		mode = user_mode(head, um);
+		mode = mode_table_user_mode(&head->mode_table, um);
 		if (!mode && !um->warned_no_mode) {
 			um->warned_no_mode = true;
 			info_user_mode_string(um, buf, sizeof(buf));
@@ -224,10 +231,10 @@ struct Mode *head_find_mode(struct Head *head) {
 
 	// always preferred
 	if (!mode) {
-		if (head_is_max_preferred_refresh(head)) {
-			mode = max_preferred_mode(head);
+		if (head->bindings.max_preferred_refresh) {
+			mode = head->mode_table.max_preferred;
 		} else {
-			mode = preferred_mode(head);
+			mode = head->mode_table.preferred;
 		}
 		if (!mode && !head->warned_no_preferred) {
 			head->warned_no_preferred = true;
@@ -237,7 +244,7 @@ struct Mode *head_find_mode(struct Head *head) {
 
 	// last change maximum
 	if (!mode) {
-		mode = max_mode(head);
+		mode = head->mode_table.max;
 	}
 
 	return mode;
@@ -248,8 +255,10 @@ enum wl_output_transform head_find_transform(struct Head *head){
 		return WL_OUTPUT_TRANSFORM_NORMAL;
 	enum wl_output_transform transform;
 
+	head_bind(head);
+
 	// User transform value from config file
-	struct UserTransform *ut = slist_find_equal_val(cfg->user_transform, head_matches_user_transform, head);
+	struct UserTransform *ut = head->bindings.user_transform;
 
 	if (ut) {
 		transform = ut->transform;
@@ -277,22 +286,62 @@ bool head_current_mode_not_desired(const void *data) {
 	return (head && head->desired.mode != head->current.mode);
 }
 
+// make model serial, falling back to description or name; computed once until they change
+const char *head_identity(struct Head *head) {
+	if (!head)
+		return NULL;
+
+	if (head->identity)
+		return head->identity;
+
+	if (head->make || head->model || head->serial_number) {
+		char buf[512];
+		snprintf(buf, sizeof(buf), "%s %s %s",
+				head->make ? head->make : "",
+				head->model ? head->model : "",
+				head->serial_number ? head->serial_number : ""
+				);
+		head->identity = strdup(buf);
+	} else if (head->description) {
+		head->identity = strdup(head->description);
+	} else if (head->name) {
+		head->identity = strdup(head->name);
+	}
+
+	return head->identity;
+}
+
+// name, description, make, model or serial number changed
+void head_identity_changed(struct Head *head) {
+	if (!head)
+		return;
+
+	free(head->identity);
+	head->identity = NULL;
+}
+
 void head_free(void *data) {
 	struct Head *head = data;
 
 	if (!head)
 		return;
 
+	mode_table_free(&head->mode_table);
+	slist_free_vals(&head->mrrs, mode_res_refresh_free);
 	slist_free(&head->modes_failed);
-	slist_free_vals(&head->modes, mode_free);
+	slist_header_free_vals(&head->modes, mode_free);
 
 	free(head->name);
 	free(head->description);
 	free(head->make);
 	free(head->model);
 	free(head->serial_number);
+	free(head->identity);
+
+	free(head->serialized.yaml);
+	free(head->serialized.tlv);
 
-	free(head);
+	pool_free(POOL_HEAD, head);
 }
 
 void head_release_mode(struct Head *head, struct Mode *mode) {
@@ -305,11 +354,74 @@ void head_release_mode(struct Head *head, struct Mode *mode) {
 	if (head->current.mode == mode) {
 		head->current.mode = NULL;
 	}
+	if (head->preferred_mode == mode) {
+		head->preferred_mode = NULL;
+	}
+
+	head->generation++;
+
+	slist_header_remove_all(&head->modes, NULL, mode);
+	slist_remove_all(&head->modes_failed, NULL, mode);
+
+	mode_table_remove(&head->mode_table, head->modes.first, mode);
+
+	slist_free_vals(&head->mrrs, mode_res_refresh_free);
+}
+
+void head_modes_changed(struct Head *head) {
+	if (!head)
+		return;
+
+	head->generation++;
+
+	head->mode_table.stale = true;
+
+	slist_free_vals(&head->mrrs, mode_res_refresh_free);
+}
+
+void head_index_modes(struct Head *head) {
+	if (!head)
+		return;
+
+	mode_table_build(&head->mode_table, head->modes.first, head->modes_failed);
+}
+
+struct SList *head_modes_res_refresh(struct Head *head) {
+	if (!head)
+		return NULL;
+
+	if (!head->mrrs) {
+		head->mrrs = modes_res_refresh(head->modes.first);
+	}
 
-	slist_remove_all(&head->modes, NULL, mode);
+	return head->mrrs;
+}
+
+void head_fail_mode(struct Head *head, struct Mode *mode) {
+	if (!head || !mode)
+		return;
+
+	head->generation++;
+
+	slist_append(&head->modes_failed, mode);
+
+	mode_table_fail(&head->mode_table, head->modes.first, mode);
+}
+
+void head_forget_failed_modes(struct Head *head) {
+	if (!head)
+		return;
+
+	slist_free(&head->modes_failed);
+
+	head->warned_no_mode = false;
+
+	head_modes_changed(head);
 }
 
 void heads_release_head(struct Head *head) {
+	heads_generation++;
+
 	slist_remove_all(&heads_arrived, NULL, head);
 	slist_remove_all(&heads_departed, NULL, head);
 	slist_remove_all(&heads, NULL, head);
@@ -321,5 +433,7 @@ void heads_destroy(void) {
 	slist_free_vals(&heads_departed, head_free);
 
 	slist_free(&heads_arrived);
+
+	lowered_free();
 }
 
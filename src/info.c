@@ -1,16 +1,21 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wayland-util.h>
 
 #include "info.h"
 
 #include "cfg.h"
 #include "convert.h"
+#include "displ.h"
 #include "head.h"
+#include "json.h"
 #include "lid.h"
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "server.h"
 
 void info_user_mode_string(struct UserMode *user_mode, char *buf, size_t nbuf) {
 	if (!user_mode) {
@@ -94,7 +99,7 @@ void print_modes_res_refresh(enum LogThreshold t, struct Head *head) {
 	static char buf[2048];
 	char *bp;
 
-	struct SList *mrrs = modes_res_refresh(head->modes);
+	struct SList *mrrs = head_modes_res_refresh(head);
 
 	struct ModesResRefresh *mrr = NULL;
 	struct Mode *mode = NULL;
@@ -105,7 +110,7 @@ void print_modes_res_refresh(enum LogThreshold t, struct Head *head) {
 		bp = buf;
 		bp += snprintf(bp, sizeof(buf) - (bp - buf), "    mode:    %5d x%5d @%4d Hz ", mrr->width, mrr->height, mrr->refresh_hz);
 
-		for (struct SList *j = mrr->modes; j; j = j->nex) {
+		for (struct SList *j = mrr->modes.first; j; j = j->nex) {
 			mode = j->val;
 			bp += snprintf(bp, sizeof(buf) - (bp - buf), "%4d,%03d mHz", mode->refresh_mhz / 1000, mode->refresh_mhz % 1000);
 			if (mode == head->preferred_mode) {
@@ -114,12 +119,74 @@ void print_modes_res_refresh(enum LogThreshold t, struct Head *head) {
 		}
 		log_(t,"%s", buf);
 	}
+}
 
-	slist_free_vals(&mrrs, mode_res_refresh_free);
+void json_name_descs(struct Json *json, const char *key, struct SList *name_descs) {
+	json_array_begin(json, key);
+	for (struct SList *i = name_descs; i; i = i->nex) {
+		json_string(json, NULL, i->val);
+	}
+	json_array_end(json);
+}
+
+// structured cfg, in place of its text; false unless logging JSON
+bool event_cfg(enum LogThreshold t, struct Cfg *cfg, bool del) {
+	struct Json *json = log_event_begin(t, "cfg");
+	if (!json)
+		return false;
+
+	json_bool(json, "delete", del);
+	json_string(json, "arrange", arrange_name(cfg->arrange));
+	json_string(json, "align", align_name(cfg->align));
+	json_name_descs(json, "order", cfg->order_name_desc);
+	json_string(json, "auto_scale", auto_scale_name(cfg->auto_scale));
+
+	json_array_begin(json, "scale");
+	for (struct SList *i = cfg->user_scales; i; i = i->nex) {
+		struct UserScale *user_scale = i->val;
+		json_object_begin(json, NULL);
+		json_string(json, "name_desc", user_scale->name_desc);
+		json_double(json, "scale", user_scale->scale);
+		json_object_end(json);
+	}
+	json_array_end(json);
+
+	json_array_begin(json, "mode");
+	for (struct SList *i = cfg->user_modes; i; i = i->nex) {
+		struct UserMode *user_mode = i->val;
+		json_object_begin(json, NULL);
+		json_string(json, "name_desc", user_mode->name_desc);
+		json_bool(json, "max", user_mode->max);
+		json_int(json, "width", user_mode->width);
+		json_int(json, "height", user_mode->height);
+		json_int(json, "hz", user_mode->refresh_hz);
+		json_object_end(json);
+	}
+	json_array_end(json);
+
+	json_array_begin(json, "transform");
+	for (struct SList *i = cfg->user_transform; i; i = i->nex) {
+		struct UserTransform *user_transform = i->val;
+		json_object_begin(json, NULL);
+		json_string(json, "name_desc", user_transform->name_desc);
+		json_int(json, "transform", user_transform->transform);
+		json_object_end(json);
+	}
+	json_array_end(json);
+
+	json_name_descs(json, "max_preferred_refresh", cfg->max_preferred_refresh_name_desc);
+	json_name_descs(json, "disabled", cfg->disabled_name_desc);
+	json_string(json, "laptop_display_prefix", cfg->laptop_display_prefix);
+	json_string(json, "log_threshold", log_threshold_name(cfg->log_threshold));
+	json_string(json, "log_format", log_format_name(cfg->log_format));
+
+	log_event_end();
+
+	return true;
 }
 
 void print_cfg(enum LogThreshold t, struct Cfg *cfg, bool del) {
-	if (!cfg)
+	if (!cfg || !log_enabled(t))
 		return;
 
 	struct UserScale *user_scale;
@@ -127,6 +194,12 @@ void print_cfg(enum LogThreshold t, struct Cfg *cfg, bool del) {
 	struct UserTransform *user_transform;
 	struct SList *i;
 
+	// the event stands in for the text, which is still captured
+	bool structured = event_cfg(t, cfg, del);
+	if (structured) {
+		log_hold_start();
+	}
+
 	if (cfg->arrange && cfg->align) {
 		log_(t, "  Arrange in a %s aligned at the %s", arrange_name(cfg->arrange), align_name(cfg->align));
 	} else if (cfg->arrange) {
@@ -190,6 +263,10 @@ void print_cfg(enum LogThreshold t, struct Cfg *cfg, bool del) {
 	if (cfg->laptop_display_prefix) {
 		log_(t, "  Laptop display prefix: %s", cfg->laptop_display_prefix);
 	}
+
+	if (structured) {
+		log_hold_stop();
+	}
 }
 
 void print_head_current(enum LogThreshold t, struct Head *head) {
@@ -208,7 +285,7 @@ void print_head_current(enum LogThreshold t, struct Head *head) {
 		log_(t, "    (disabled)");
 	}
 
-	if (lid_is_closed(head->name)) {
+	if (lid_is_closed(head)) {
 		log_(t, "    (lid closed)");
 	}
 }
@@ -248,10 +325,97 @@ void print_head_desired(enum LogThreshold t, struct Head *head) {
 	}
 }
 
+void json_mode(struct Json *json, const char *key, struct Mode *mode) {
+	if (!mode) {
+		json_null(json, key);
+		return;
+	}
+
+	json_object_begin(json, key);
+	json_int(json, "width", mode->width);
+	json_int(json, "height", mode->height);
+	json_int(json, "refresh_mhz", mode->refresh_mhz);
+	json_bool(json, "preferred", mode->preferred);
+	json_object_end(json);
+}
+
+void json_head_state(struct Json *json, const char *key, struct HeadState *state) {
+	json_object_begin(json, key);
+	json_bool(json, "enabled", state->enabled);
+	json_mode(json, "mode", state->mode);
+	json_double(json, "scale", wl_fixed_to_double(state->scale));
+	json_int(json, "x", state->x);
+	json_int(json, "y", state->y);
+	json_int(json, "transform", state->transform);
+	json_object_end(json);
+}
+
+// structured head, in place of its text; false unless logging JSON
+bool event_head(enum LogThreshold t, enum InfoEvent event, struct Head *head) {
+	static const char *names[] = {
+		[ARRIVED] = "head_arrived",
+		[DEPARTED] = "head_departed",
+		[DELTA] = "head_changing",
+		[NONE] = "head",
+	};
+
+	if (event == DELTA && !head_current_not_desired(head))
+		return false;
+
+	struct Json *json = log_event_begin(t, names[event]);
+	if (!json)
+		return false;
+
+	json_string(json, "name", head->name);
+	json_string(json, "description", head->description);
+
+	switch (event) {
+		case ARRIVED:
+		case NONE:
+			json_string(json, "make", head->make);
+			json_string(json, "model", head->model);
+			json_string(json, "serial_number", head->serial_number);
+			json_int(json, "width_mm", head->width_mm);
+			json_int(json, "height_mm", head->height_mm);
+			json_bool(json, "lid_closed", lid_is_closed(head));
+			json_head_state(json, "current", &head->current);
+
+			json_array_begin(json, "modes");
+			for (struct SList *i = head->modes.first; i; i = i->nex) {
+				json_mode(json, NULL, i->val);
+			}
+			json_array_end(json);
+
+			json_array_begin(json, "modes_failed");
+			for (struct SList *i = head->modes_failed; i; i = i->nex) {
+				json_mode(json, NULL, i->val);
+			}
+			json_array_end(json);
+			break;
+		case DELTA:
+			json_head_state(json, "current", &head->current);
+			json_head_state(json, "desired", &head->desired);
+			break;
+		case DEPARTED:
+		default:
+			break;
+	}
+
+	log_event_end();
+
+	return true;
+}
+
 void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head) {
-	if (!head)
+	if (!head || !log_enabled(t))
 		return;
 
+	// the event stands in for the text, which is still captured
+	bool structured = event_head(t, event, head);
+	if (structured) {
+		log_hold_start();
+	}
+
 	switch (event) {
 		case ARRIVED:
 		case NONE:
@@ -291,11 +455,138 @@ void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head) {
 		default:
 			break;
 	}
+
+	if (structured) {
+		log_hold_stop();
+	}
+}
+
+void print_lid(enum LogThreshold t, struct Lid *lid) {
+	if (!lid || !log_enabled(t))
+		return;
+
+	struct Json *json = log_event_begin(t, "lid");
+	if (json) {
+		json_bool(json, "closed", lid->closed);
+		json_string(json, "device_path", lid->device_path);
+		log_event_end();
+		log_hold_start();
+	}
+
+	log_(t, "\nLid %s", lid->closed ? "closed" : "open");
+
+	if (json) {
+		log_hold_stop();
+	}
+}
+
+void print_changes(enum ConfigState state) {
+	enum LogThreshold t;
+	const char *result;
+	const char *text;
+
+	switch (state) {
+		case SUCCEEDED:
+			t = INFO;
+			result = "succeeded";
+			text = "Changes successful";
+			break;
+		case FAILED:
+			t = ERROR;
+			result = "failed";
+			text = "Changes failed";
+			break;
+		case CANCELLED:
+			t = WARNING;
+			result = "cancelled";
+			text = "Changes cancelled, retrying";
+			break;
+		default:
+			return;
+	}
+
+	struct Json *json = log_event_begin(t, "changes");
+	if (json) {
+		json_string(json, "result", result);
+		log_event_end();
+		log_hold_start();
+	}
+
+	log_(t, "\n%s", text);
+
+	if (json) {
+		log_hold_stop();
+	}
 }
 
 void print_heads(enum LogThreshold t, enum InfoEvent event, struct SList *heads) {
+	if (!log_enabled(t))
+		return;
+
 	for (struct SList *i = heads; i; i = i->nex) {
 		print_head(t, event, i->val);
 	}
 }
 
+unsigned long state_revision = 0;
+unsigned long state_revision_heads = 0;
+unsigned long state_revision_lid = 0;
+
+// generations seen by the last state_revise
+static struct {
+	unsigned long heads;
+	unsigned long lid;
+} revised_generations = { 0 };
+
+bool equal_head_state(struct HeadState *a, struct HeadState *b) {
+	return a->mode == b->mode &&
+		a->scale == b->scale &&
+		a->enabled == b->enabled &&
+		a->x == b->x &&
+		a->y == b->y &&
+		a->transform == b->transform;
+}
+
+void state_revise(void) {
+	unsigned long next = state_revision + 1;
+	bool revised = false;
+
+	if (heads_generation != revised_generations.heads) {
+		revised_generations.heads = heads_generation;
+		state_revision_heads = next;
+		revised = true;
+	}
+
+	unsigned long lid_generation = lid ? lid->generation : 0;
+	if (lid_generation != revised_generations.lid) {
+		revised_generations.lid = lid_generation;
+		state_revision_lid = next;
+		revised = true;
+	}
+
+	// current changes bump the generation, desired is written directly by layout
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+		if (head->generation != head->revised_generation || !equal_head_state(&head->desired, &head->revised_desired)) {
+			head->revised_generation = head->generation;
+			head->revised_desired = head->desired;
+			head->revision = next;
+			revised = true;
+
+			free(head->serialized.yaml);
+			free(head->serialized.tlv);
+			memset(&head->serialized, 0, sizeof(head->serialized));
+		}
+	}
+
+	if (revised) {
+		state_revision = next;
+	}
+}
+
+bool state_delta_since(unsigned long since) {
+
+	// departed heads can't be expressed; the client may be from before a restart
+	return since >= state_revision_heads && since <= state_revision;
+}
+
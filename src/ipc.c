@@ -1,111 +1,398 @@
+#include <arpa/inet.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ipc.h"
 
 #include "cfg.h"
+#include "head.h"
+#include "info.h"
+#include "lid.h"
+#include "list.h"
 #include "log.h"
 #include "marshalling.h"
 #include "sockets.h"
+#include "tlv.h"
 
-int ipc_request_send(struct IpcRequest *request) {
-	int fd = -1;
+// output queued for a client beyond which it is dropped
+#define IPC_OUT_MAX (4 * 1024 * 1024)
 
-	char *yaml = marshal_ipc_request(request);
-	if (!yaml) {
-		goto end;
+// largest request accepted
+#define IPC_REQUEST_MAX (1024 * 1024)
+
+// how long a client may stall while sending its request or taking its final response
+#define IPC_IDLE_MS 2000
+
+void ipc_frame_header(char *header, enum IpcEncoding encoding, uint32_t length) {
+	uint32_t length_n = htonl(length);
+
+	memset(header, 0, IPC_FRAME_HEADER_SIZE);
+	memcpy(header, IPC_FRAME_MAGIC, IPC_FRAME_MAGIC_SIZE);
+	header[IPC_FRAME_MAGIC_SIZE] = (char)encoding;
+	memcpy(header + IPC_FRAME_HEADER_SIZE - sizeof(length_n), &length_n, sizeof(length_n));
+}
+
+// total length of the frame at buf when complete, 0 when more is needed, -1 when not a frame
+ssize_t ipc_frame_length(const char *buf, size_t len, enum IpcEncoding *encoding) {
+	size_t magic = len < IPC_FRAME_MAGIC_SIZE ? len : IPC_FRAME_MAGIC_SIZE;
+	if (memcmp(buf, IPC_FRAME_MAGIC, magic) != 0) {
+		return -1;
+	}
+
+	if (len < IPC_FRAME_HEADER_SIZE) {
+		return 0;
+	}
+
+	uint32_t length_n;
+	memcpy(&length_n, buf + IPC_FRAME_HEADER_SIZE - sizeof(length_n), sizeof(length_n));
+	size_t length = IPC_FRAME_HEADER_SIZE + ntohl(length_n);
+
+	if (len < length) {
+		return 0;
+	}
+
+	if (encoding) {
+		*encoding = (enum IpcEncoding)buf[IPC_FRAME_MAGIC_SIZE];
+	}
+
+	return length;
+}
+
+// payload length claimed by a frame header, 0 until the header is complete
+size_t frame_declared_length(const char *buf, size_t len) {
+	if (len < IPC_FRAME_HEADER_SIZE || memcmp(buf, IPC_FRAME_MAGIC, IPC_FRAME_MAGIC_SIZE) != 0) {
+		return 0;
+	}
+
+	uint32_t length_n;
+	memcpy(&length_n, buf + IPC_FRAME_HEADER_SIZE - sizeof(length_n), sizeof(length_n));
+
+	return ntohl(length_n);
+}
+
+// write the payload, in a frame when requested
+ssize_t write_payload(int fd, bool framed, enum IpcEncoding encoding, char *payload, size_t length) {
+	if (!framed) {
+		return socket_write(fd, payload, length);
 	}
 
-	log_debug_nocap("========sending server request==========\n%s\n----------------------------------------", yaml);
+	char *buf = calloc(IPC_FRAME_HEADER_SIZE + length, sizeof(char));
+	ipc_frame_header(buf, encoding, length);
+	memcpy(buf + IPC_FRAME_HEADER_SIZE, payload, length);
+
+	ssize_t n = socket_write(fd, buf, IPC_FRAME_HEADER_SIZE + length);
+
+	free(buf);
+
+	return n;
+}
+
+// remove the first n bytes received
+void consume(struct IpcConnection *connection, size_t n) {
+	memmove(connection->buf, connection->buf + n, connection->len - n);
+	connection->len -= n;
+	connection->buf[connection->len] = '\0';
+}
+
+int ipc_request_send(struct IpcRequest *request, enum IpcEncoding encoding) {
+	int fd = -1;
+	char *payload = NULL;
+	size_t len = 0;
+
+	if (encoding == IPC_ENCODING_BINARY) {
+		payload = tlv_marshal_ipc_request(request, &len);
+	} else if ((payload = marshal_ipc_request(request))) {
+		len = strlen(payload);
+		log_debug_nocap("========sending server request==========\n%s\n----------------------------------------", payload);
+	}
+	if (!payload) {
+		goto end;
+	}
 
 	if ((fd = create_fd_ipc_client()) == -1) {
 		goto end;
 	}
 
-	if (socket_write(fd, yaml, strlen(yaml)) == -1) {
+	// events may be a long time coming
+	if (request->command == SUBSCRIBE && !set_socket_no_timeout(fd)) {
+		close(fd);
+		fd = -1;
+		goto end;
+	}
+
+	if (write_payload(fd, true, encoding, payload, len) == -1) {
+		close(fd);
 		fd = -1;
 		goto end;
 	}
 
 end:
-	if (yaml) {
-		free(yaml);
+	if (payload) {
+		free(payload);
 	}
 
 	return fd;
 }
 
 void ipc_response_send(struct IpcResponse *response) {
-	char *yaml = marshal_ipc_response(response);
+	char *payload = NULL;
+	size_t len = 0;
+
+	state_revise();
 
-	if (!yaml) {
+	if (response->encoding == IPC_ENCODING_BINARY) {
+		payload = tlv_marshal_ipc_response(response, &len);
+	} else if ((payload = marshal_ipc_response(response))) {
+		len = strlen(payload);
+		log_debug_nocap("========sending client response==========\n%s----------------------------------------", payload);
+	}
+
+	if (!payload) {
 		response->done = true;
 		return;
 	}
 
-	log_debug_nocap("========sending client response==========\n%s----------------------------------------", yaml);
+	bool written;
+	if (response->framed) {
+		char header[IPC_FRAME_HEADER_SIZE];
+		ipc_frame_header(header, response->encoding, len);
+		written = ipc_connection_write(response->connection, header, sizeof(header)) &&
+			ipc_connection_write(response->connection, payload, len);
+	} else {
+		written = ipc_connection_write(response->connection, payload, len);
+	}
 
-	if (socket_write(response->fd, yaml, strlen(yaml)) == -1) {
+	if (!written) {
 		response->done = true;
+	} else {
+		if (response->messages) {
+			log_capture_clear();
+		}
+		if (response->status && ipc_response_has_state(response)) {
+			response->since = state_revision;
+		}
 	}
 
-	free(yaml);
+	free(payload);
 }
 
-struct IpcRequest *ipc_request_receive(int fd_sock) {
-	struct IpcRequest *request = NULL;
-	char *yaml = NULL;
-	int fd = -1;
+// progress made reading or writing
+void ipc_connection_active(struct IpcConnection *connection) {
+	clock_gettime(CLOCK_MONOTONIC, &connection->active_at);
+}
 
-	if ((fd = socket_accept(fd_sock)) == -1) {
+struct IpcConnection *ipc_connection_accept(int fd_sock) {
+	int fd = socket_accept(fd_sock);
+	if (fd == -1) {
 		return NULL;
 	}
 
-	if (!(yaml = socket_read(fd))) {
-		close(fd);
-		return NULL;
+	struct IpcConnection *connection = (struct IpcConnection*)calloc(1, sizeof(struct IpcConnection));
+	connection->fd = fd;
+	connection->state = IPC_READING;
+	ipc_connection_active(connection);
+
+	return connection;
+}
+
+bool ipc_connection_write(struct IpcConnection *connection, const char *data, size_t len) {
+
+	// straight to the socket when nothing is waiting
+	if (!connection->out_len) {
+		ssize_t n = socket_write_nonblock(connection->fd, data, len);
+		if (n == -1) {
+			return false;
+		}
+		data += n;
+		len -= n;
 	}
 
-	log_debug_nocap("========received client request=========\n%s\n----------------------------------------", yaml);
+	if (!len) {
+		return true;
+	}
 
-	request = unmarshal_ipc_request(yaml);
-	free(yaml);
+	if (connection->out_len + len > IPC_OUT_MAX) {
+		log_error_nocap("\nIPC client not reading, dropping %zu bytes", connection->out_len + len);
+		return false;
+	}
 
-	if (!request) {
-		request = (struct IpcRequest*)calloc(1, sizeof(struct IpcRequest));
-		request->bad = true;
-		request->fd = fd;
-		return request;
+	connection->out = realloc(connection->out, connection->out_len + len);
+	memcpy(connection->out + connection->out_len, data, len);
+	connection->out_len += len;
+
+	return true;
+}
+
+bool ipc_connection_flush(struct IpcConnection *connection) {
+	if (!connection->out_len) {
+		return true;
 	}
 
-	request->fd = fd;
+	ssize_t n = socket_write_nonblock(connection->fd, connection->out, connection->out_len);
+	if (n == -1) {
+		return false;
+	}
+
+	memmove(connection->out, connection->out + n, connection->out_len - n);
+	connection->out_len -= n;
+
+	if (n > 0) {
+		ipc_connection_active(connection);
+	}
+
+	return true;
+}
+
+long ipc_connection_idle_remaining_ms(struct IpcConnection *connection) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	long idle = (now.tv_sec - connection->active_at.tv_sec) * 1000 + (now.tv_nsec - connection->active_at.tv_nsec) / 1000000;
+
+	return idle < IPC_IDLE_MS ? IPC_IDLE_MS - idle : 0;
+}
+
+bool ipc_connection_read(struct IpcConnection *connection) {
+
+	ssize_t n = socket_read_nonblock(connection->fd, &connection->buf, &connection->len, IPC_REQUEST_MAX + 1, &connection->eof);
+	if (n == -1) {
+		connection->state = IPC_CLOSED;
+		return false;
+	}
+	if (n > 0) {
+		ipc_connection_active(connection);
+	}
+
+	if (connection->len > IPC_REQUEST_MAX) {
+		log_error("\nIPC request exceeds %d bytes, closing", IPC_REQUEST_MAX);
+		connection->state = IPC_CLOSED;
+		return false;
+	}
+
+	if (connection->len == 0) {
+		if (connection->eof) {
+			connection->state = IPC_CLOSED;
+		}
+		return false;
+	}
+
+	size_t payload_len = connection->len;
+
+	ssize_t length = ipc_frame_length(connection->buf, connection->len, &connection->encoding);
+	if (length == 0 && frame_declared_length(connection->buf, connection->len) > IPC_REQUEST_MAX) {
+		log_error("\nIPC request frame exceeds %d bytes, closing", IPC_REQUEST_MAX);
+		connection->state = IPC_CLOSED;
+		return false;
+	}
+
+	if (length > 0) {
+
+		// framed, ignoring anything after the first
+		connection->framed = true;
+		connection->buf[length] = '\0';
+		consume(connection, IPC_FRAME_HEADER_SIZE);
+		payload_len = length - IPC_FRAME_HEADER_SIZE;
+
+	} else if (length == 0) {
+
+		// incomplete frame
+		if (connection->eof) {
+			log_error("\nTruncated IPC request frame");
+			connection->state = IPC_CLOSED;
+		}
+		return false;
+
+	} else if (!connection->eof && connection->buf[connection->len - 1] != '\n' && !ipc_request_yaml_complete(connection->buf)) {
+
+		// unframed requests are usually newline terminated or followed by the client closing its
+		// write side; older clients do neither, sending a whole document and waiting
+		return false;
+	}
+
+	connection->request = NULL;
+	if (!connection->framed || connection->encoding == IPC_ENCODING_YAML) {
+		log_debug_nocap("========received client request=========\n%s\n----------------------------------------", connection->buf);
+		connection->request = unmarshal_ipc_request(connection->buf);
+	} else if (connection->encoding == IPC_ENCODING_BINARY) {
+		connection->request = tlv_unmarshal_ipc_request(connection->buf, payload_len);
+	} else {
+		log_error("\nUnsupported IPC encoding %d", connection->encoding);
+	}
+	if (!connection->request) {
+		connection->request = (struct IpcRequest*)calloc(1, sizeof(struct IpcRequest));
+		connection->request->bad = true;
+	}
+	connection->request->fd = connection->fd;
+
+	// answer in kind, YAML when unframed or unsupported
+	if (!connection->framed || (connection->encoding != IPC_ENCODING_YAML && connection->encoding != IPC_ENCODING_BINARY)) {
+		connection->encoding = IPC_ENCODING_YAML;
+	}
 
-	return request;
+	return true;
 }
 
-struct IpcResponse *ipc_response_receive(int fd) {
+struct IpcResponse *ipc_response_receive(struct IpcConnection *connection) {
 	struct IpcResponse *response = NULL;
-	char *yaml = NULL;
+	enum IpcEncoding encoding = 0;
+	ssize_t length = 0;
 
-	if (fd == -1) {
+	if (connection->fd == -1) {
 		log_error("invalid fd for ipc response receive");
 		return NULL;
 	}
 
-	if (!(yaml = socket_read(fd))) {
-		return NULL;
+	// reassemble the next frame; there may already be more than one buffered
+	while (!connection->len || (length = ipc_frame_length(connection->buf, connection->len, &encoding)) == 0) {
+		if (connection->eof) {
+			log_error("\nServer closed the connection");
+			return NULL;
+		}
+		if (socket_read_wait(connection->fd, &connection->buf, &connection->len, &connection->eof) == -1) {
+			return NULL;
+		}
 	}
 
-	log_debug_nocap("========received server response========\n%s\n----------------------------------------", yaml);
+	if (length < 0) {
+		log_error("\nInvalid IPC response frame");
+		return NULL;
+	}
 
-	response = unmarshal_ipc_response(yaml);
-	free(yaml);
+	if (encoding == IPC_ENCODING_YAML) {
+		char *yaml = strndup(connection->buf + IPC_FRAME_HEADER_SIZE, length - IPC_FRAME_HEADER_SIZE);
+		log_debug_nocap("========received server response========\n%s\n----------------------------------------", yaml);
+		response = unmarshal_ipc_response(yaml);
+		free(yaml);
+	} else if (encoding == IPC_ENCODING_BINARY) {
+		response = tlv_unmarshal_ipc_response(connection->buf + IPC_FRAME_HEADER_SIZE, length - IPC_FRAME_HEADER_SIZE);
+	} else {
+		log_error("\nUnsupported IPC encoding %d", encoding);
+	}
+	consume(connection, length);
 
 	return response;
 }
 
+bool ipc_response_has_cfg(struct IpcResponse *response) {
+	return !response->events || response->events & IPC_EVENT_BIT(IPC_EVENT_CFG);
+}
+
+bool ipc_response_has_state(struct IpcResponse *response) {
+	return !response->events || response->events & ~IPC_EVENT_BIT(IPC_EVENT_CFG);
+}
+
+bool ipc_response_state_delta(struct IpcResponse *response) {
+	return response->delta && state_delta_since(response->since);
+}
+
+bool ipc_response_state_includes(struct IpcResponse *response, unsigned long revision) {
+	return !ipc_response_state_delta(response) || revision > response->since;
+}
+
 void free_ipc_request(struct IpcRequest *request) {
 	if (!request) {
 		return;
@@ -121,6 +408,32 @@ void free_ipc_response(struct IpcResponse *response) {
 		return;
 	}
 
+	cfg_free(response->cfg);
+
+	if (response->lid) {
+		free(response->lid->device_path);
+		free(response->lid);
+	}
+
+	slist_free_vals(&response->heads, head_free);
+
 	free(response);
 }
 
+void free_ipc_connection(void *data) {
+	struct IpcConnection *connection = data;
+
+	if (!connection) {
+		return;
+	}
+
+	free(connection->buf);
+	free(connection->out);
+
+	free_ipc_request(connection->request);
+
+	free_log_cap(connection->messages);
+
+	free(connection);
+}
+
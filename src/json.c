@@ -0,0 +1,146 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json.h"
+
+void json_put(struct Json *json, const char *s, size_t n) {
+	if (json->truncated)
+		return;
+
+	// always leave room for the terminator
+	if (json->len + n >= json->size) {
+		json->truncated = true;
+		return;
+	}
+
+	memcpy(json->buf + json->len, s, n);
+	json->len += n;
+	json->buf[json->len] = '\0';
+}
+
+void json_putf(struct Json *json, const char *__restrict __format, ...) {
+	char s[64];
+
+	va_list args;
+	va_start(args, __format);
+	int n = vsnprintf(s, sizeof(s), __format, args);
+	va_end(args);
+
+	json_put(json, s, n < (int)sizeof(s) ? (size_t)n : sizeof(s) - 1);
+}
+
+// escapes quotes, backslashes and control characters; UTF-8 passes through
+void json_put_quoted(struct Json *json, const char *s) {
+	json_put(json, "\"", 1);
+
+	const char *run = s;
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c != '"' && c != '\\' && c >= 0x20) {
+			continue;
+		}
+
+		json_put(json, run, s - run);
+		run = s + 1;
+
+		switch (c) {
+			case '"':
+				json_put(json, "\\\"", 2);
+				break;
+			case '\\':
+				json_put(json, "\\\\", 2);
+				break;
+			case '\n':
+				json_put(json, "\\n", 2);
+				break;
+			case '\t':
+				json_put(json, "\\t", 2);
+				break;
+			default:
+				json_putf(json, "\\u%04x", c);
+				break;
+		}
+	}
+	json_put(json, run, s - run);
+
+	json_put(json, "\"", 1);
+}
+
+// separator then key, when there is one
+void json_put_key(struct Json *json, const char *key) {
+	if (json->comma) {
+		json_put(json, ",", 1);
+	}
+	json->comma = true;
+
+	if (key) {
+		json_put_quoted(json, key);
+		json_put(json, ":", 1);
+	}
+}
+
+void json_init(struct Json *json, char *buf, size_t size) {
+	json->buf = buf;
+	json->size = size;
+	json->len = 0;
+	json->comma = false;
+	json->truncated = size == 0;
+
+	if (size) {
+		buf[0] = '\0';
+	}
+}
+
+void json_object_begin(struct Json *json, const char *key) {
+	json_put_key(json, key);
+	json_put(json, "{", 1);
+	json->comma = false;
+}
+
+void json_object_end(struct Json *json) {
+	json_put(json, "}", 1);
+	json->comma = true;
+}
+
+void json_array_begin(struct Json *json, const char *key) {
+	json_put_key(json, key);
+	json_put(json, "[", 1);
+	json->comma = false;
+}
+
+void json_array_end(struct Json *json) {
+	json_put(json, "]", 1);
+	json->comma = true;
+}
+
+void json_string(struct Json *json, const char *key, const char *val) {
+	json_put_key(json, key);
+	if (val) {
+		json_put_quoted(json, val);
+	} else {
+		json_put(json, "null", 4);
+	}
+}
+
+void json_int(struct Json *json, const char *key, long val) {
+	json_put_key(json, key);
+	json_putf(json, "%ld", val);
+}
+
+void json_double(struct Json *json, const char *key, double val) {
+	json_put_key(json, key);
+	json_putf(json, "%.3f", val);
+}
+
+void json_bool(struct Json *json, const char *key, bool val) {
+	json_put_key(json, key);
+	json_put(json, val ? "true" : "false", val ? 4 : 5);
+}
+
+void json_null(struct Json *json, const char *key) {
+	json_put_key(json, key);
+	json_put(json, "null", 4);
+}
+
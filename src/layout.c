@@ -2,11 +2,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wayland-util.h>
 #include <wayland-client-protocol.h>
 
 #include "layout.h"
 
+#include "cache.h"
 #include "cfg.h"
 #include "displ.h"
 #include "head.h"
@@ -20,7 +22,51 @@
 #include "server.h"
 #include "wlr-output-management-unstable-v1.h"
 
-struct Head *head_changing_mode = NULL;
+// generations of the global inputs at the last desire
+static struct {
+	unsigned long cfg;
+	unsigned long lid;
+	unsigned long heads;
+} desired_generations = { 0 };
+
+static unsigned long desire_skipped = 0;
+
+// from the first test or apply until no further changes are needed
+static struct {
+	bool started;
+	struct timespec started_at;
+	unsigned int round_trips;
+	unsigned int failed;
+	unsigned int cancelled;
+	unsigned int tests;
+} convergence = { 0 };
+
+void convergence_start(void) {
+	if (!convergence.started) {
+		clock_gettime(CLOCK_MONOTONIC, &convergence.started_at);
+		convergence.started = true;
+	}
+}
+
+void convergence_end(void) {
+	if (!convergence.started) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long ms = (now.tv_sec - convergence.started_at.tv_sec) * 1000 + (now.tv_nsec - convergence.started_at.tv_nsec) / 1000000;
+
+	log_debug("\nConverged in %u round trips, %u failed, %u cancelled, %u modes tested, %ld ms",
+			convergence.round_trips,
+			convergence.failed,
+			convergence.cancelled,
+			convergence.tests,
+			ms
+			);
+
+	memset(&convergence, 0, sizeof(convergence));
+}
 
 void position_heads(struct SList *heads) {
 	struct Head *head;
@@ -91,55 +137,30 @@ void position_heads(struct SList *heads) {
 	}
 }
 
-struct SList *order_heads(struct SList *order_name_desc, struct SList *heads) {
-	struct SList *heads_ordered = NULL;
-	struct Head *head;
-	struct SList *i, *j, *r;
-
-	struct SList *sorting = slist_shallow_clone(heads);
-
-	// specified order first
-	for (i = order_name_desc; i; i = i->nex) {
-		j = sorting;
-		while(j) {
-			head = j->val;
-			r = j;
-			j = j->nex;
-			if (!head) {
-				continue;
-			}
-			if (i->val && head_matches_name_desc(i->val, head)) {
-				slist_append(&heads_ordered, head);
-				slist_remove(&sorting, &r);
-			}
-		}
-	}
-
-	// remaing in discovered order
-	for (i = sorting; i; i = i->nex) {
-		head = i->val;
-		if (!head) {
-			continue;
-		}
+bool head_ordered_before(const void *a, const void *b) {
+	return ((const struct Head*)a)->bindings.order < ((const struct Head*)b)->bindings.order;
+}
 
-		slist_append(&heads_ordered, head);
+// specified order first, remaining in discovered order
+struct SList *order_heads(struct SList *heads) {
+	for (struct SList *i = heads; i; i = i->nex) {
+		head_bind(i->val);
 	}
 
-	slist_free(&sorting);
-
-	return heads_ordered;
+	return slist_sort(heads, head_ordered_before);
 }
 
 void desire_enabled(struct Head *head) {
 
 	// lid closed
-	head->desired.enabled = !lid_is_closed(head->name);
+	head->desired.enabled = !lid_is_closed(head);
 
 	// ignore lid closed when there is only the laptop display, for smoother sleeping
 	head->desired.enabled |= slist_length(heads) == 1;
 
 	// explicitly disabled
-	head->desired.enabled &= slist_find_equal(cfg->disabled_name_desc, head_matches_name_desc, head) == NULL;
+	head_bind(head);
+	head->desired.enabled &= !head->bindings.disabled;
 }
 
 void desire_mode(struct Head *head) {
@@ -149,6 +170,14 @@ void desire_mode(struct Head *head) {
 	// attempt to find a mode
 	struct Mode *mode = head_find_mode(head);
 
+	// known to be rejected
+	while (mode && mode_validity(mode) == MODE_INVALID) {
+		log_info("\n%s: skipping mode rejected previously:", head->name);
+		print_mode(INFO, mode);
+		head_fail_mode(head, mode);
+		mode = head_find_mode(head);
+	}
+
 	if (mode) {
 		head->desired.mode = mode;
 	} else {
@@ -167,13 +196,10 @@ void desire_scale(struct Head *head) {
 		return;
 
 	// user scale first
-	struct UserScale *user_scale;
-	for (struct SList *i = cfg->user_scales; i; i = i->nex) {
-		user_scale = (struct UserScale*)i->val;
-		if (head_matches_name_desc(user_scale->name_desc, head)) {
-			head->desired.scale = wl_fixed_from_double(user_scale->scale);
-			return;
-		}
+	head_bind(head);
+	if (head->bindings.user_scale) {
+		head->desired.scale = wl_fixed_from_double(head->bindings.user_scale->scale);
+		return;
 	}
 
 	// auto or 1
@@ -200,9 +226,41 @@ void desire_transform(struct Head *head) {
 
 void desire(void) {
 
+	// global inputs: any change invalidates every head
+	bool changed_all = cfg->generation != desired_generations.cfg ||
+		(lid ? lid->generation : 0) != desired_generations.lid ||
+		heads_generation != desired_generations.heads;
+
+	bool changed = changed_all;
+	for (struct SList *i = heads; !changed && i; i = i->nex) {
+		changed = ((struct Head*)i->val)->desired_generation != ((struct Head*)i->val)->generation;
+	}
+
+	if (!changed) {
+		log_debug("\nLayout inputs unchanged, %lu passes skipped", ++desire_skipped);
+		return;
+	}
+
+	desired_generations.cfg = cfg->generation;
+	desired_generations.lid = lid ? lid->generation : 0;
+	desired_generations.heads = heads_generation;
+
+	// converged previously with these heads, cfg and lid
+	if (cache_layout_desire()) {
+		log_debug("\nUsing cached layout");
+		for (struct SList *i = heads; i; i = i->nex) {
+			((struct Head*)i->val)->desired_generation = ((struct Head*)i->val)->generation;
+		}
+		return;
+	}
+
 	for (struct SList *i = heads; i; i = i->nex) {
 		struct Head *head = (struct Head*)i->val;
 
+		if (!changed_all && head->desired_generation == head->generation) {
+			continue;
+		}
+
 		memcpy(&head->desired, &head->current, sizeof(struct HeadState));
 
 		desire_enabled(head);
@@ -211,52 +269,175 @@ void desire(void) {
 		desire_transform(head);
 
 		head_scaled_dimensions(head);
+
+		head->desired_generation = head->generation;
 	}
 
-	struct SList *heads_ordered = order_heads(cfg->order_name_desc, heads);
+	struct SList *heads_ordered = order_heads(heads);
 
 	position_heads(heads_ordered);
 
 	slist_free(&heads_ordered);
 }
 
+// heads whose modes are in the outstanding configuration
+struct SList *heads_changing_mode = NULL;
+
+// outstanding and answered mode tests
+static struct SList *mode_tests = NULL;
+
+// test desired modes not yet validated, each alone; true when any are outstanding
+bool test_modes(struct SListHeader *heads_changing) {
+	for (struct SList *i = heads_changing->first; i; i = i->nex) {
+		struct Head *head = (struct Head*)i->val;
+
+		if (!head_current_mode_not_desired(head) || !head->desired.mode || mode_validity(head->desired.mode) != MODE_UNTESTED) {
+			continue;
+		}
+
+		struct ModeValidation *validation = mode_validation_init(head->desired.mode);
+		if (!validation) {
+			continue;
+		}
+
+		struct ModeTest *test = calloc(1, sizeof(struct ModeTest));
+		test->validation = validation;
+		test->state = OUTSTANDING;
+
+		struct zwlr_output_configuration_v1 *zwlr_config = zwlr_output_manager_v1_create_configuration(displ->output_manager, displ->serial);
+		zwlr_output_configuration_v1_add_listener(zwlr_config, output_configuration_test_listener(), test);
+
+		test->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head->zwlr_head);
+		zwlr_output_configuration_head_v1_set_mode(test->zwlr_config_head, head->desired.mode->zwlr_mode);
+
+		zwlr_output_configuration_v1_test(zwlr_config);
+
+		slist_append(&mode_tests, test);
+
+		convergence_start();
+		convergence.tests++;
+	}
+
+	return mode_tests != NULL;
+}
+
+// record answers once all tests are answered, failing rejected desired modes; false while waiting
+bool mode_tests_answered(void) {
+	for (struct SList *i = mode_tests; i; i = i->nex) {
+		if (((struct ModeTest*)i->val)->state == OUTSTANDING) {
+			return false;
+		}
+	}
+
+	for (struct SList *i = mode_tests; i; i = i->nex) {
+		struct ModeTest *test = i->val;
+
+		switch (test->state) {
+			case SUCCEEDED:
+				test->validation->validity = MODE_VALID;
+				mode_validation_record(test->validation);
+				break;
+
+			case FAILED:
+				test->validation->validity = MODE_INVALID;
+				for (struct SList *j = heads; j; j = j->nex) {
+					struct Head *head = j->val;
+					if (mode_validation_matches(test->validation, head->desired.mode)) {
+						log_error("\nMode test failed");
+						log_error("  %s:", head->name);
+						print_mode(ERROR, head->desired.mode);
+						head_fail_mode(head, head->desired.mode);
+					}
+				}
+				mode_validation_record(test->validation);
+				break;
+
+			case CANCELLED:
+			default:
+				// try again
+				mode_validation_free(test->validation);
+				break;
+		}
+	}
+
+	slist_free_vals(&mode_tests, NULL);
+
+	return true;
+}
+
+// bisecting a failed configuration: apply only this many mode changes, alone
+// otherwise optimistic: all changes in one configuration
+static unsigned int modes_limit = 0;
+
+// the outstanding configuration holds only mode changes
+static bool modes_alone = false;
+
 void apply(void) {
-	struct SList *heads_changing = NULL;
+	struct SListHeader heads_changing = { 0 };
 
 	// determine whether changes are needed before initiating output configuration
 	struct SList *i = heads;
 	while ((i = slist_find(i, head_current_not_desired))) {
-		slist_append(&heads_changing, i->val);
+		slist_header_append(&heads_changing, i->val);
 		i = i->nex;
 	}
-	if (!heads_changing)
+	if (!heads_changing.first)
+		return;
+
+	// changes are applied once the modes are known to be good
+	if (test_modes(&heads_changing)) {
+		slist_header_free(&heads_changing);
 		return;
+	}
 
 	// passed into our configuration listener
 	struct zwlr_output_configuration_v1 *zwlr_config = zwlr_output_manager_v1_create_configuration(displ->output_manager, displ->serial);
 	zwlr_output_configuration_v1_add_listener(zwlr_config, output_configuration_listener(), displ);
 
-	if ((head_changing_mode = slist_find_val(heads, head_current_mode_not_desired))) {
+	slist_free(&heads_changing_mode);
+	for (i = heads_changing.first; i; i = i->nex) {
+		if (head_current_mode_not_desired(i->val)) {
+			if (modes_limit && slist_length(heads_changing_mode) == modes_limit) {
+				break;
+			}
+			slist_append(&heads_changing_mode, i->val);
+		}
+	}
 
-		print_head(INFO, DELTA, head_changing_mode);
+	modes_alone = modes_limit && heads_changing_mode;
+
+	if (modes_alone) {
+
+		// mode changes in their own operation; mode change desire is always enabled
+		for (i = heads_changing_mode; i; i = i->nex) {
+			struct Head *head = (struct Head*)i->val;
 
-		// mode change in its own operation; mode change desire is always enabled
-		head_changing_mode->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head_changing_mode->zwlr_head);
-		zwlr_output_configuration_head_v1_set_mode(head_changing_mode->zwlr_config_head, head_changing_mode->desired.mode->zwlr_mode);
+			print_head(INFO, DELTA, head);
+
+			head->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head->zwlr_head);
+			zwlr_output_configuration_head_v1_set_mode(head->zwlr_config_head, head->desired.mode->zwlr_mode);
+		}
 
 	} else {
 
 		print_heads(INFO, DELTA, heads);
 
-		// all changes except mode
-		for (i = heads_changing; i; i = i->nex) {
+		// all changes
+		for (i = heads_changing.first; i; i = i->nex) {
 			struct Head *head = (struct Head*)i->val;
 
-			if (head->desired.enabled) {
+			bool mode = head_current_mode_not_desired(head);
+
+			if (head->desired.enabled || mode) {
 				head->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head->zwlr_head);
-				zwlr_output_configuration_head_v1_set_scale(head->zwlr_config_head, head->desired.scale);
-				zwlr_output_configuration_head_v1_set_position(head->zwlr_config_head, head->desired.x, head->desired.y);
-				zwlr_output_configuration_head_v1_set_transform(head->zwlr_config_head, head->desired.transform);
+				if (mode) {
+					zwlr_output_configuration_head_v1_set_mode(head->zwlr_config_head, head->desired.mode->zwlr_mode);
+				}
+				if (head->desired.enabled) {
+					zwlr_output_configuration_head_v1_set_scale(head->zwlr_config_head, head->desired.scale);
+					zwlr_output_configuration_head_v1_set_position(head->zwlr_config_head, head->desired.x, head->desired.y);
+					zwlr_output_configuration_head_v1_set_transform(head->zwlr_config_head, head->desired.transform);
+				}
 			} else {
 				zwlr_output_configuration_v1_disable_head(zwlr_config, head->zwlr_head);
 			}
@@ -267,37 +448,69 @@ void apply(void) {
 
 	displ->config_state = OUTSTANDING;
 
-	slist_free(&heads_changing);
+	convergence_start();
+	convergence.round_trips++;
+
+	slist_header_free(&heads_changing);
 }
 
 void handle_success(void) {
-	if (head_changing_mode) {
 
-		// succesful mode change is not always reported
-		head_changing_mode->current.mode = head_changing_mode->desired.mode;
+	// succesful mode change is not always reported
+	for (struct SList *i = heads_changing_mode; i; i = i->nex) {
+		struct Head *head = (struct Head*)i->val;
+		head->current.mode = head->desired.mode;
+		head->generation++;
+		mode_validated(head->desired.mode, MODE_VALID);
+	}
+	slist_free(&heads_changing_mode);
 
-		head_changing_mode = NULL;
+	// continue bisecting through the mode changes, then the remainder optimistically
+	if (!modes_alone) {
+		modes_limit = 0;
 	}
 }
 
 void handle_failure(void) {
+	unsigned int modes_changing = slist_length(heads_changing_mode);
 
-	if (head_changing_mode) {
+	if (!modes_changing) {
+
+		// any other failures are fatal
+		exit_fail();
+
+	} else if (modes_alone && modes_changing == 1) {
 
 		// mode setting failure, try again
-		log_error("  %s:", head_changing_mode->name);
-		print_mode(ERROR, head_changing_mode->desired.mode);
-		slist_append(&head_changing_mode->modes_failed, head_changing_mode->desired.mode);
+		struct Head *head = (struct Head*)heads_changing_mode->val;
+		log_error("  %s:", head->name);
+		print_mode(ERROR, head->desired.mode);
+		mode_validated(head->desired.mode, MODE_INVALID);
+		head_fail_mode(head, head->desired.mode);
 
 		// current mode may be misreported
-		head_changing_mode->current.mode = NULL;
+		head->current.mode = NULL;
+
+		modes_limit = 0;
 
-		head_changing_mode = NULL;
 	} else {
 
-		// any other failures are fatal
-		exit_fail();
+		// mode changes alone, then halve them until the failure is found
+		modes_limit = modes_alone ? (modes_changing + 1) / 2 : modes_changing;
+		log_warn("  Retrying %u of %u mode changes alone", modes_limit, modes_changing);
 	}
+
+	slist_free(&heads_changing_mode);
+}
+
+// neither a configuration nor mode tests outstanding
+bool layout_idle(void) {
+	return displ->config_state == IDLE && !mode_tests;
+}
+
+// forget a head that is about to be freed
+void layout_release_head(struct Head *head) {
+	slist_remove_all(&heads_changing_mode, NULL, head);
 }
 
 void layout(void) {
@@ -310,7 +523,7 @@ void layout(void) {
 
 	switch (displ->config_state) {
 		case SUCCEEDED:
-			log_info("\nChanges successful");
+			print_changes(displ->config_state);
 			handle_success();
 			displ->config_state = IDLE;
 			break;
@@ -320,22 +533,39 @@ void layout(void) {
 			return;
 
 		case FAILED:
-			log_error("\nChanges failed");
+			print_changes(displ->config_state);
+			convergence.failed++;
 			handle_failure();
 			displ->config_state = IDLE;
 			break;
 
 		case CANCELLED:
-			log_warn("\nChanges cancelled, retrying");
+			print_changes(displ->config_state);
+			convergence.cancelled++;
 			displ->config_state = IDLE;
-			return;
+
+			// the change that cancelled has usually been received already, retry now
+			break;
 
 		case IDLE:
 		default:
 			break;
 	}
 
+	// tested modes first
+	if (!mode_tests_answered()) {
+		return;
+	}
+
 	desire();
 	apply();
+
+	// nothing more to do
+	if (layout_idle()) {
+		if (convergence.started) {
+			cache_layout_store();
+		}
+		convergence_end();
+	}
 }
 
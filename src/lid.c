@@ -7,17 +7,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 #include <unistd.h>
 
 #include "lid.h"
 
 #include "cfg.h"
+#include "info.h"
 #include "log.h"
 #include "server.h"
 
-static const char *LAPTOP_DISPLAY_PREFIX_DEFAULT = "eDP";
-
 static int libinput_open_restricted(const char *path, int flags, void *data) {
 
 	// user permissions are sufficient for input devices, no need for systemd
@@ -150,6 +148,7 @@ void lid_update(void) {
 		return;
 
 	struct libinput_event *event;
+	bool closed = lid->closed;
 
 	libinput_dispatch(lid->libinput_monitor);
 	while ((event = libinput_get_event(lid->libinput_monitor))) {
@@ -164,7 +163,11 @@ void lid_update(void) {
 		libinput_dispatch(lid->libinput_monitor);
 	}
 
-	log_info("\nLid %s", lid->closed ? "closed" : "open");
+	if (lid->closed != closed) {
+		lid->generation++;
+	}
+
+	print_lid(INFO, lid);
 }
 
 void lid_init(void) {
@@ -202,24 +205,15 @@ void lid_init(void) {
 	lid->libinput_monitor = libinput_monitor;
 }
 
-bool lid_is_closed(char *name) {
-	if (!name)
+bool lid_is_closed(struct Head *head) {
+	if (!head)
 		return false;
 
 	if (!lid)
 		return false;
 
-	const char *laptop_display_prefix;
-	if (cfg->laptop_display_prefix) {
-		laptop_display_prefix = cfg->laptop_display_prefix;
-	} else {
-		laptop_display_prefix = LAPTOP_DISPLAY_PREFIX_DEFAULT;
-	}
+	head_bind(head);
 
-	if (strncasecmp(laptop_display_prefix, name, strlen(laptop_display_prefix)) == 0) {
-		return lid->closed;
-	} else {
-		return false;
-	}
+	return head->bindings.laptop && lid->closed;
 }
 
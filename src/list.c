@@ -1,13 +1,16 @@
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 
 #include "list.h"
 
+#include "pool.h"
+
 struct SList *slist_append(struct SList **head, void *val) {
 	struct SList *i, *l;
 
-	i = calloc(1, sizeof(struct SList));
+	i = pool_alloc(POOL_SLIST);
 	i->val = val;
 
 	if (*head) {
@@ -110,7 +113,7 @@ void *slist_remove(struct SList **head, struct SList **item) {
 			*head = f->nex;
 		}
 		removed = f->val;
-		free(f);
+		pool_free(POOL_SLIST, f);
 		*item = NULL;
 	}
 
@@ -147,11 +150,14 @@ unsigned long slist_remove_all_free(struct SList **head, bool (*equal)(const voi
 }
 
 struct SList *slist_shallow_clone(struct SList *head) {
-	struct SList *c, *i;
+	struct SList *c, *i, **tail;
 
 	c = NULL;
+	tail = &c;
 	for (i = head; i; i = i->nex) {
-		slist_append(&c, i->val);
+		*tail = pool_alloc(POOL_SLIST);
+		(*tail)->val = i->val;
+		tail = &(*tail)->nex;
 	}
 
 	return c;
@@ -174,32 +180,130 @@ struct SList *slist_sort(struct SList *head, bool (*before)(const void *a, const
 		return sorted;
 	}
 
-	if (!head->nex) {
-		slist_append(&sorted, head->val);
-		return sorted;
+	sorted = slist_shallow_clone(head);
+
+	slist_sort_in_place(&sorted, before);
+
+	return sorted;
+}
+
+// see https://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.html
+void slist_sort_in_place(struct SList **head, bool (*before)(const void *a, const void *b)) {
+	if (!head || !*head || !before) {
+		return;
 	}
 
-	struct SList *sorting = slist_shallow_clone(head);
+	struct SList *list = *head;
+	struct SList *p, *q, *e, *tail;
+	unsigned long width, merges, psize, qsize;
 
-	struct SList *sorting_head  = sorting;
-	struct SList **sorted_trail = &sorted;
+	for (width = 1;; width *= 2) {
+		p = list;
+		list = NULL;
+		tail = NULL;
+		merges = 0;
 
-	while (sorting != NULL) {
-		sorting_head = sorting;
-		sorted_trail = &sorted;
+		while (p) {
+			merges++;
 
-		sorting = sorting->nex;
+			// q is width past p, or the end
+			q = p;
+			for (psize = 0; psize < width && q; psize++) {
+				q = q->nex;
+			}
+			qsize = width;
+
+			// merge, taking from p when equal for stability
+			while (psize > 0 || (qsize > 0 && q)) {
+				if (psize == 0) {
+					e = q;
+					q = q->nex;
+					qsize--;
+				} else if (qsize == 0 || !q || !before(q->val, p->val)) {
+					e = p;
+					p = p->nex;
+					psize--;
+				} else {
+					e = q;
+					q = q->nex;
+					qsize--;
+				}
+
+				if (tail) {
+					tail->nex = e;
+				} else {
+					list = e;
+				}
+				tail = e;
+			}
 
-		while (!(*sorted_trail == NULL || before(sorting_head->val, (*sorted_trail)->val))) {
-			sorted_trail = &(*sorted_trail)->nex;
+			p = q;
 		}
 
-		sorting_head->nex = *sorted_trail;
-		*sorted_trail = sorting_head;
+		tail->nex = NULL;
+
+		if (merges <= 1) {
+			break;
+		}
 	}
 
-	slist_free(&sorting);
-	return sorted;
+	*head = list;
+}
+
+unsigned long slist_sort_array(struct SList *head, bool (*before)(const void *a, const void *b), void **array, unsigned long n) {
+	unsigned long length = 0;
+
+	if (!array || !before) {
+		return length;
+	}
+
+	for (struct SList *i = head; i && length < n; i = i->nex) {
+		array[length++] = i->val;
+	}
+
+	if (length < 2) {
+		return length;
+	}
+
+	void **scratch = calloc(length, sizeof(void*));
+	void **from = array;
+	void **to = scratch;
+	void **swap;
+
+	// bottom up, taking from the left run when equal for stability
+	for (unsigned long width = 1; width < length; width *= 2) {
+		for (unsigned long lo = 0; lo < length; lo += 2 * width) {
+			unsigned long mid = lo + width < length ? lo + width : length;
+			unsigned long hi = lo + 2 * width < length ? lo + 2 * width : length;
+			unsigned long l = lo, r = mid, k = lo;
+
+			while (l < mid && r < hi) {
+				if (before(from[r], from[l])) {
+					to[k++] = from[r++];
+				} else {
+					to[k++] = from[l++];
+				}
+			}
+			while (l < mid) {
+				to[k++] = from[l++];
+			}
+			while (r < hi) {
+				to[k++] = from[r++];
+			}
+		}
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != array) {
+		memcpy(array, from, length * sizeof(void*));
+	}
+
+	free(scratch);
+
+	return length;
 }
 
 void slist_free(struct SList **head) {
@@ -209,7 +313,7 @@ void slist_free(struct SList **head) {
 	while (i) {
 		f = i;
 		i = i->nex;
-		free(f);
+		pool_free(POOL_SLIST, f);
 	}
 
 	*head = NULL;
@@ -229,6 +333,61 @@ void slist_free_vals(struct SList **head, void (*free_val)(void *val)) {
 	slist_free(head);
 }
 
+struct SList *slist_header_append(struct SListHeader *list, void *val) {
+	struct SList *i;
+
+	i = pool_alloc(POOL_SLIST);
+	i->val = val;
+
+	if (list->last) {
+		list->last->nex = i;
+	} else {
+		list->first = i;
+	}
+	list->last = i;
+	list->length++;
+
+	return i;
+}
+
+unsigned long slist_header_remove_all(struct SListHeader *list, bool (*equal)(const void *val, const void *data), const void *data) {
+	struct SList **i, *f;
+	unsigned long removed = 0;
+
+	list->last = NULL;
+
+	i = &list->first;
+	while (*i) {
+		if (equal ? equal((*i)->val, data) : (*i)->val == data) {
+			f = *i;
+			*i = f->nex;
+			pool_free(POOL_SLIST, f);
+			removed++;
+		} else {
+			list->last = *i;
+			i = &(*i)->nex;
+		}
+	}
+
+	list->length -= removed;
+
+	return removed;
+}
+
+void slist_header_free(struct SListHeader *list) {
+	slist_free(&list->first);
+
+	list->last = NULL;
+	list->length = 0;
+}
+
+void slist_header_free_vals(struct SListHeader *list, void (*free_val)(void *val)) {
+	slist_free_vals(&list->first, free_val);
+
+	list->last = NULL;
+	list->length = 0;
+}
+
 bool slist_equal_strcasecmp(const void *val, const void *data) {
 	if (!val || !data) {
 		return false;
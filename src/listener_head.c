@@ -6,8 +6,10 @@
 #include "listeners.h"
 
 #include "head.h"
+#include "layout.h"
 #include "list.h"
 #include "mode.h"
+#include "pool.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Head data
@@ -18,6 +20,8 @@ static void name(void *data,
 	struct Head *head = data;
 
 	head->name = strdup(name);
+	head_identity_changed(head);
+	head->generation++;
 }
 
 static void description(void *data,
@@ -26,6 +30,8 @@ static void description(void *data,
 	struct Head *head = data;
 
 	head->description = strdup(description);
+	head_identity_changed(head);
+	head->generation++;
 }
 
 static void physical_size(void *data,
@@ -36,6 +42,7 @@ static void physical_size(void *data,
 
 	head->width_mm = width;
 	head->height_mm = height;
+	head->generation++;
 }
 
 static void mode(void *data,
@@ -43,11 +50,13 @@ static void mode(void *data,
 		struct zwlr_output_mode_v1 *zwlr_output_mode_v1) {
 	struct Head *head = data;
 
-	struct Mode *mode = calloc(1, sizeof(struct Mode));
+	struct Mode *mode = pool_alloc(POOL_MODE);
 	mode->head = head;
 	mode->zwlr_mode = zwlr_output_mode_v1;
 
-	slist_append(&head->modes, mode);
+	slist_header_append(&head->modes, mode);
+
+	head_modes_changed(head);
 
 	zwlr_output_mode_v1_add_listener(zwlr_output_mode_v1, mode_listener(), mode);
 }
@@ -58,6 +67,7 @@ static void enabled(void *data,
 	struct Head *head = data;
 
 	head->current.enabled = enabled;
+	head->generation++;
 }
 
 static void current_mode(void *data,
@@ -66,10 +76,11 @@ static void current_mode(void *data,
 	struct Head *head = data;
 
 	struct Mode *mode = NULL;
-	for (struct SList *i = head->modes; i; i = i->nex) {
+	for (struct SList *i = head->modes.first; i; i = i->nex) {
 		mode = i->val;
 		if (mode && mode->zwlr_mode == zwlr_output_mode_v1) {
 			head->current.mode = mode;
+			head->generation++;
 			break;
 		}
 	}
@@ -83,6 +94,7 @@ static void position(void *data,
 
 	head->current.x = x;
 	head->current.y = y;
+	head->generation++;
 }
 
 static void transform(void *data,
@@ -91,6 +103,7 @@ static void transform(void *data,
 	struct Head *head = data;
 
 	head->current.transform = transform;
+	head->generation++;
 }
 
 static void scale(void *data,
@@ -99,6 +112,7 @@ static void scale(void *data,
 	struct Head *head = data;
 
 	head->current.scale = scale;
+	head->generation++;
 }
 
 static void make(void *data,
@@ -107,6 +121,8 @@ static void make(void *data,
 	struct Head *head = data;
 
 	head->make = strdup(make);
+	head_identity_changed(head);
+	head->generation++;
 }
 
 static void model(void *data,
@@ -115,6 +131,8 @@ static void model(void *data,
 	struct Head *head = data;
 
 	head->model = strdup(model);
+	head_identity_changed(head);
+	head->generation++;
 }
 
 static void serial_number(void *data,
@@ -123,6 +141,8 @@ static void serial_number(void *data,
 	struct Head *head = data;
 
 	head->serial_number = strdup(serial_number);
+	head_identity_changed(head);
+	head->generation++;
 }
 
 static void finished(void *data,
@@ -130,12 +150,13 @@ static void finished(void *data,
 	struct Head *head = data;
 
 	// dummy Head, just for printing
-	struct Head *head_departed = calloc(1, sizeof(struct Head));
+	struct Head *head_departed = pool_alloc(POOL_HEAD);
 	head_departed->name = strdup(head->name);
 	head_departed->description = strdup(head->description);
 	slist_append(&heads_departed, head_departed);
 
 	heads_release_head(head);
+	layout_release_head(head);
 	head_free(head);
 
 	zwlr_output_head_v1_destroy(zwlr_output_head_v1);
@@ -17,6 +17,8 @@ static void size(void *data,
 
 	mode->width = width;
 	mode->height = height;
+
+	head_modes_changed(mode->head);
 }
 
 static void refresh(void *data,
@@ -25,6 +27,8 @@ static void refresh(void *data,
 	struct Mode *mode = data;
 
 	mode->refresh_mhz = refresh;
+
+	head_modes_changed(mode->head);
 }
 
 static void preferred(void *data,
@@ -35,6 +39,7 @@ static void preferred(void *data,
 
 	if (mode->head) {
 		mode->head->preferred_mode = mode;
+		head_modes_changed(mode->head);
 	}
 }
 
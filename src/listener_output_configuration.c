@@ -5,6 +5,7 @@
 #include "displ.h"
 #include "list.h"
 #include "head.h"
+#include "layout.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Displ data
@@ -51,3 +52,42 @@ const struct zwlr_output_configuration_v1_listener *output_configuration_listene
 	return &listener;
 }
 
+// ModeTest data
+
+void test_cleanup(struct ModeTest *test,
+		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1,
+		enum ConfigState config_state) {
+
+	zwlr_output_configuration_head_v1_destroy(test->zwlr_config_head);
+	test->zwlr_config_head = NULL;
+
+	zwlr_output_configuration_v1_destroy(zwlr_output_configuration_v1);
+
+	test->state = config_state;
+}
+
+static void test_succeeded(void *data,
+		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
+	test_cleanup(data, zwlr_output_configuration_v1, SUCCEEDED);
+}
+
+static void test_failed(void *data,
+		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
+	test_cleanup(data, zwlr_output_configuration_v1, FAILED);
+}
+
+static void test_cancelled(void *data,
+		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
+	test_cleanup(data, zwlr_output_configuration_v1, CANCELLED);
+}
+
+static const struct zwlr_output_configuration_v1_listener test_listener = {
+	.succeeded = test_succeeded,
+	.failed = test_failed,
+	.cancelled = test_cancelled,
+};
+
+const struct zwlr_output_configuration_v1_listener *output_configuration_test_listener(void) {
+	return &test_listener;
+}
+
@@ -6,6 +6,7 @@
 #include "displ.h"
 #include "head.h"
 #include "list.h"
+#include "pool.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Displ data
@@ -14,8 +15,11 @@ static void head(void *data,
 		struct zwlr_output_manager_v1 *zwlr_output_manager_v1,
 		struct zwlr_output_head_v1 *zwlr_output_head_v1) {
 
-	struct Head *head = calloc(1, sizeof(struct Head));
+	struct Head *head = pool_alloc(POOL_HEAD);
 	head->zwlr_head = zwlr_output_head_v1;
+	head->generation = 1;
+
+	heads_generation++;
 
 	slist_append(&heads, head);
 	slist_append(&heads_arrived, head);
@@ -29,6 +33,14 @@ static void done(void *data,
 	struct Displ *displ = data;
 
 	displ->serial = serial;
+
+	// all modes have been announced
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+		if (head && head->mode_table.stale) {
+			head_index_modes(head);
+		}
+	}
 }
 
 static void finished(void *data,
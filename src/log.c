@@ -1,33 +1,75 @@
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "log.h"
 
-#include "list.h"
+#include "json.h"
 
 #define LS 16384
 
+// per stream, lines beyond this are dropped
+#define LOG_SINK_SIZE (256 * 1024)
+
+// structured events up to this long
+#define LOG_EVENT_SIZE (64 * 1024)
+
+// a terminal reports writable with room for little more than this, so write no more at a time
+#define LOG_SINK_TTY_WRITE 256
+
 struct LogActive {
 	enum LogThreshold threshold;
 	bool threshold_cli;
+	enum LogFormat format;
+	bool format_cli;
 	bool times;
 	bool capturing;
 	bool suppressing;
+	unsigned int holding;
 };
 struct LogActive active = {
 	.threshold = LOG_THRESHOLD_DEFAULT,
 	.threshold_cli = false,
+	.format = LOG_FORMAT_DEFAULT,
+	.format_cli = false,
 	.times = false,
 	.capturing = false,
 	.suppressing = false,
+	.holding = 0,
 };
 
-struct SList *log_cap_lines = NULL;
+// the event being written
+static struct {
+	struct Json json;
+	enum LogThreshold threshold;
+	char buf[LOG_EVENT_SIZE];
+} event;
+
+struct LogCap *log_cap = NULL;
+
+// lines for a stream that may block, written as it becomes writable
+struct LogSink {
+	int fd;
+	bool socket;
+	bool tty;
+	char *buf;
+	size_t start;
+	size_t len;
+	unsigned long dropped;
+};
+struct LogSink *sink_out = NULL;
+struct LogSink *sink_err = NULL;
+
+int log_gate = LOG_THRESHOLD_DEFAULT;
 
 char threshold_char[] = {
 	'?',
@@ -37,6 +79,14 @@ char threshold_char[] = {
 	'E',
 };
 
+char *threshold_name[] = {
+	"",
+	"DEBUG",
+	"INFO",
+	"WARNING",
+	"ERROR",
+};
+
 char *threshold_prefix[] = {
 	"",
 	"",
@@ -45,39 +95,237 @@ char *threshold_prefix[] = {
 	"ERROR: ",
 };
 
-void print_time(enum LogThreshold threshold, FILE *__restrict __stream) {
+void update_gate(void) {
+	if (active.capturing) {
+		log_gate = DEBUG;
+	} else if (active.suppressing || active.holding) {
+		log_gate = ERROR + 1;
+	} else {
+		log_gate = active.threshold;
+	}
+}
+
+// formatted once per second
+const char *time_string(bool iso) {
 	static char buf[16];
-	static time_t t;
+	static char buf_iso[32];
+	static time_t cached = -1;
+
+	time_t t = time(NULL);
+	if (t != cached) {
+		struct tm *tm = localtime(&t);
+		strftime(buf, sizeof(buf), "%H:%M:%S", tm);
+		strftime(buf_iso, sizeof(buf_iso), "%Y-%m-%dT%H:%M:%S%z", tm);
+		cached = t;
+	}
+
+	return iso ? buf_iso : buf;
+}
+
+// time and level of a JSON line, leaving the object open
+void json_line_begin(struct Json *json, char *buf, size_t nbuf, enum LogThreshold threshold) {
+	json_init(json, buf, nbuf);
+	json_object_begin(json, NULL);
+	if (active.times) {
+		json_string(json, "time", time_string(true));
+	}
+	json_string(json, "level", threshold_name[threshold]);
+}
+
+// close the object and terminate the line, keeping just the time and level when it did not fit
+size_t json_line_end(struct Json *json, enum LogThreshold threshold) {
+	json_object_end(json);
+
+	if (json->truncated || json->len + 1 >= json->size) {
+		json_line_begin(json, json->buf, json->size, threshold);
+		json_bool(json, "truncated", true);
+		json_object_end(json);
+	}
+
+	json->buf[json->len++] = '\n';
+	json->buf[json->len] = '\0';
+
+	return json->len;
+}
+
+int format_line(char *buf, size_t nbuf, enum LogThreshold threshold, bool prefix, const char *l) {
+	if (active.format == LOG_FORMAT_JSON) {
+		struct Json json;
+		json_line_begin(&json, buf, nbuf, threshold);
+		json_string(&json, "message", l);
+		return json_line_end(&json, threshold);
+	}
+
+	int n = 0;
+
+	if (active.times) {
+		n += snprintf(buf, nbuf, "%c [%s] ", threshold_char[threshold], time_string(false));
+	}
+	n += snprintf(buf + n, nbuf - n, "%s%s\n", prefix && l[0] != '\0' ? threshold_prefix[threshold] : "", l);
+
+	return n < (int)nbuf ? n : (int)nbuf - 1;
+}
+
+// write without blocking until empty or the fd would block
+void sink_write(struct LogSink *sink) {
+	while (sink->len) {
+		size_t n = sink->len < LOG_SINK_SIZE - sink->start ? sink->len : LOG_SINK_SIZE - sink->start;
+		ssize_t written;
+
+		if (sink->socket) {
+			written = send(sink->fd, sink->buf + sink->start, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+		} else {
+			// writable pipes take PIPE_BUF without blocking, terminals much less
+			size_t max = sink->tty ? LOG_SINK_TTY_WRITE : PIPE_BUF;
+			struct pollfd pfd = { .fd = sink->fd, .events = POLLOUT, };
+			if (poll(&pfd, 1, 0) != 1) {
+				return;
+			}
+			if (!(pfd.revents & POLLOUT)) {
+				errno = EPIPE;
+				written = -1;
+			} else {
+				written = write(sink->fd, sink->buf + sink->start, n < max ? n : max);
+			}
+		}
+
+		if (written == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return;
+			}
+
+			// reader has gone
+			sink->start = 0;
+			sink->len = 0;
+			return;
+		}
+
+		sink->start = (sink->start + written) % LOG_SINK_SIZE;
+		sink->len -= written;
+	}
+
+	sink->start = 0;
+}
+
+bool sink_put(struct LogSink *sink, const char *data, size_t n) {
+	if (sink->len + n > LOG_SINK_SIZE) {
+		return false;
+	}
+
+	size_t end = (sink->start + sink->len) % LOG_SINK_SIZE;
+	size_t first = n < LOG_SINK_SIZE - end ? n : LOG_SINK_SIZE - end;
+
+	memcpy(sink->buf + end, data, first);
+	memcpy(sink->buf, data + first, n - first);
+	sink->len += n;
+
+	return true;
+}
+
+void sink_text(struct LogSink *sink, const char *text, size_t n) {
+	if (sink->dropped) {
+		char notice[64];
+		char buf[256];
+		snprintf(notice, sizeof(notice), "%lu log lines dropped", sink->dropped);
+
+		int m = format_line(buf, sizeof(buf), WARNING, true, notice);
 
-	t = time(NULL);
+		if (!sink_put(sink, buf, m)) {
+			sink->dropped++;
+			return;
+		}
+		sink->dropped = 0;
+	}
 
-	strftime(buf, sizeof(buf), "%H:%M:%S", localtime(&t));
+	if (!sink_put(sink, text, n)) {
+		sink->dropped++;
+		return;
+	}
 
-	fprintf(__stream, "%c [%s] ", threshold_char[threshold], buf);
+	sink_write(sink);
+}
+
+void write_text(enum LogThreshold threshold, const char *text, size_t n) {
+	struct LogSink *sink = threshold == ERROR ? sink_err : sink_out;
+
+	if (sink) {
+		sink_text(sink, text, n);
+	} else {
+		fwrite(text, 1, n, threshold == ERROR ? stderr : stdout);
+	}
+}
+
+void cap_drop_oldest(struct LogCap *cap) {
+	struct LogCapLine *oldest = &cap->lines[cap->first];
+
+	cap->dropped++;
+	if (oldest->threshold > cap->dropped_threshold) {
+		cap->dropped_threshold = oldest->threshold;
+	}
+
+	cap->first = (cap->first + 1) % LOG_CAP_LINES;
+	cap->count--;
+}
+
+// contiguous space at the end of the arena, wrapping and dropping the oldest lines as needed
+char *cap_alloc(struct LogCap *cap, size_t n) {
+	for (;;) {
+		if (!cap->count) {
+			cap->end = 0;
+		}
+
+		size_t start = cap->count ? (size_t)(cap->lines[cap->first].line - cap->arena) : 0;
+		size_t at = LOG_CAP_SIZE;
+
+		if (cap->count == LOG_CAP_LINES) {
+			// no free line
+		} else if (!cap->count || cap->end > start) {
+			if (LOG_CAP_SIZE - cap->end >= n) {
+				at = cap->end;
+			} else if (start >= n) {
+				at = 0;
+			}
+		} else if (start - cap->end >= n) {
+			at = cap->end;
+		}
+
+		if (at != LOG_CAP_SIZE) {
+			cap->end = at + n;
+			return cap->arena + at;
+		}
+
+		cap_drop_oldest(cap);
+	}
 }
 
 void capture_line(enum LogThreshold threshold, char *l) {
-	struct LogCapLine *cap_line = calloc(1, sizeof(struct LogCapLine));
-	cap_line->line = strdup(l);
+	if (!log_cap) {
+		log_cap = calloc(1, sizeof(struct LogCap));
+	}
+
+	size_t n = strlen(l) + 1;
+	char *line = cap_alloc(log_cap, n);
+	memcpy(line, l, n);
+
+	struct LogCapLine *cap_line = &log_cap->lines[(log_cap->first + log_cap->count) % LOG_CAP_LINES];
+	cap_line->line = line;
 	cap_line->threshold = threshold;
-	slist_append(&log_cap_lines, cap_line);
+	log_cap->count++;
 }
 
 void print_raw(enum LogThreshold threshold, bool prefix, const char *l) {
-	static FILE *stream;
+	static char buf[LS * 2];
 
-	stream = threshold == ERROR ? stderr : stdout;
+	if (threshold < active.threshold || active.suppressing || active.holding) {
+		return;
+	}
 
-	if (threshold >= active.threshold && !active.suppressing) {
-		if (active.times) {
-			print_time(threshold, stream);
-		}
-		if (l[0] != '\0') {
-			fprintf(stream, "%s%s\n", prefix ? threshold_prefix[threshold] : "", l);
-		} else {
-			fprintf(stream, "\n");
-		}
+	// blank separators carry nothing as JSON
+	if (active.format == LOG_FORMAT_JSON && l[0] == '\0') {
+		return;
 	}
+
+	write_text(threshold, buf, format_line(buf, sizeof(buf), threshold, prefix, l));
 }
 
 void print_line(enum LogThreshold threshold, bool prefix, int eno, const char *__restrict __format, va_list __args) {
@@ -124,6 +372,18 @@ void log_set_threshold(enum LogThreshold threshold, bool cli) {
 	if (!active.threshold_cli || cli) {
 		active.threshold = threshold;
 		active.threshold_cli = cli;
+		update_gate();
+	}
+}
+
+void log_set_format(enum LogFormat format, bool cli) {
+	if (!format) {
+		return;
+	}
+
+	if (!active.format_cli || cli) {
+		active.format = format;
+		active.format_cli = cli;
 	}
 }
 
@@ -131,21 +391,21 @@ void log_set_times(bool times) {
 	active.times = times;
 }
 
-void log_(enum LogThreshold threshold, const char *__restrict __format, ...) {
+void (log_)(enum LogThreshold threshold, const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(threshold, 0, __format, args);
 	va_end(args);
 }
 
-void log_debug(const char *__restrict __format, ...) {
+void (log_debug)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(DEBUG, 0, __format, args);
 	va_end(args);
 }
 
-void log_debug_nocap(const char *__restrict __format, ...) {
+void (log_debug_nocap)(const char *__restrict __format, ...) {
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
@@ -157,35 +417,35 @@ void log_debug_nocap(const char *__restrict __format, ...) {
 	active.capturing = was_capturing;
 }
 
-void log_info(const char *__restrict __format, ...) {
+void (log_info)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(INFO, 0, __format, args);
 	va_end(args);
 }
 
-void log_warn(const char *__restrict __format, ...) {
+void (log_warn)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(WARNING, 0, __format, args);
 	va_end(args);
 }
 
-void log_warn_errno(const char *__restrict __format, ...) {
+void (log_warn_errno)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(WARNING, errno, __format, args);
 	va_end(args);
 }
 
-void log_error(const char *__restrict __format, ...) {
+void (log_error)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(ERROR, 0, __format, args);
 	va_end(args);
 }
 
-void log_error_nocap(const char *__restrict __format, ...) {
+void (log_error_nocap)(const char *__restrict __format, ...) {
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
@@ -197,59 +457,170 @@ void log_error_nocap(const char *__restrict __format, ...) {
 	active.capturing = was_capturing;
 }
 
-void log_error_errno(const char *__restrict __format, ...) {
+void (log_error_errno)(const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
 	print_log(ERROR, errno, __format, args);
 	va_end(args);
 }
 
-void free_log_cap_line(void *data) {
-	struct LogCapLine *cap_line = data;
+const struct LogCapLine *log_cap_line(struct LogCap *cap, size_t i) {
+	if (!cap)
+		return NULL;
 
-	if (!cap_line) {
-		return;
+	if (cap->dropped) {
+		if (i == 0) {
+			snprintf(cap->dropped_text, sizeof(cap->dropped_text), "%lu earlier lines dropped", cap->dropped);
+			cap->dropped_line.line = cap->dropped_text;
+			cap->dropped_line.threshold = cap->dropped_threshold;
+			return &cap->dropped_line;
+		}
+		i--;
 	}
 
-	if (cap_line->line) {
-		free(cap_line->line);
-	}
+	if (i >= cap->count)
+		return NULL;
+
+	return &cap->lines[(cap->first + i) % LOG_CAP_LINES];
+}
 
-	free(cap_line);
+void free_log_cap(void *data) {
+	free(data);
 }
 
 void log_suppress_start(void) {
 	active.suppressing = true;
+	update_gate();
 }
 
 void log_suppress_stop(void) {
 	active.suppressing = false;
+	update_gate();
+}
+
+void log_hold_start(void) {
+	active.holding++;
+	update_gate();
+}
+
+void log_hold_stop(void) {
+	if (active.holding) {
+		active.holding--;
+	}
+	update_gate();
+}
+
+struct Json *log_event_begin(enum LogThreshold threshold, const char *name) {
+	if (active.format != LOG_FORMAT_JSON || threshold < active.threshold || active.suppressing) {
+		return NULL;
+	}
+
+	event.threshold = threshold;
+	json_line_begin(&event.json, event.buf, sizeof(event.buf), threshold);
+	json_string(&event.json, "event", name);
+
+	return &event.json;
+}
+
+void log_event_end(void) {
+	write_text(event.threshold, event.buf, json_line_end(&event.json, event.threshold));
 }
 
 void log_capture_start(void) {
 	active.capturing = true;
+	update_gate();
 }
 
 void log_capture_stop(void) {
 	active.capturing = false;
+	update_gate();
 }
 
 void log_capture_clear(void) {
-	slist_free_vals(&log_cap_lines, free_log_cap_line);
+	if (log_cap) {
+		log_cap->first = 0;
+		log_cap->count = 0;
+		log_cap->end = 0;
+		log_cap->dropped = 0;
+		log_cap->dropped_threshold = 0;
+	}
 }
 
 void log_capture_playback(void) {
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
-	for (struct SList *i = log_cap_lines; i; i = i->nex) {
-		struct LogCapLine *cap_line = i->val;
-		if (!cap_line)
-			continue;
-
+	const struct LogCapLine *cap_line;
+	for (size_t i = 0; (cap_line = log_cap_line(log_cap, i)); i++) {
 		print_raw(cap_line->threshold, true, cap_line->line);
 	}
 
 	active.capturing = was_capturing;
 }
 
+struct LogSink *sink_init(int fd) {
+	struct stat st;
+
+	// regular files do not block
+	if (fstat(fd, &st) == -1 || S_ISREG(st.st_mode)) {
+		return NULL;
+	}
+
+	struct LogSink *sink = calloc(1, sizeof(struct LogSink));
+	sink->fd = fd;
+	sink->socket = S_ISSOCK(st.st_mode);
+	sink->tty = isatty(fd);
+	sink->buf = malloc(LOG_SINK_SIZE);
+
+	return sink;
+}
+
+// write the remainder, waiting a little for each write
+void sink_free(struct LogSink *sink) {
+	if (!sink)
+		return;
+
+	struct pollfd pfd = { .fd = sink->fd, .events = POLLOUT, };
+	while (sink->len && poll(&pfd, 1, 1000) == 1) {
+		sink_write(sink);
+	}
+
+	if (sink->dropped) {
+		dprintf(sink->fd, "%s%lu log lines dropped\n", threshold_prefix[WARNING], sink->dropped);
+	}
+
+	free(sink->buf);
+	free(sink);
+}
+
+void log_sink_start(void) {
+	if (sink_out || sink_err)
+		return;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	sink_out = sink_init(STDOUT_FILENO);
+	sink_err = sink_init(STDERR_FILENO);
+
+	atexit(log_sink_stop);
+}
+
+bool log_sink_flush(int fd) {
+	struct LogSink *sink = fd == STDOUT_FILENO ? sink_out : fd == STDERR_FILENO ? sink_err : NULL;
+
+	if (!sink)
+		return false;
+
+	sink_write(sink);
+
+	return sink->len > 0;
+}
+
+void log_sink_stop(void) {
+	sink_free(sink_out);
+	sink_out = NULL;
+
+	sink_free(sink_err);
+	sink_err = NULL;
+}
@@ -19,12 +19,15 @@ void usage(FILE *stream) {
 		"Usage: way-displays [OPTIONS...] [COMMAND]\n"
 		"  Runs the server when no COMMAND specified.\n"
 		"OPTIONS\n"
-		"  -L, --l[og-threshold] <debug|info|warning|error>\n"
+		"  -L, --log-t[hreshold] <debug|info|warning|error>\n"
+		"      --log-f[ormat] <text|json>\n"
 		"COMMANDS\n"
 		"  -h, --h[elp]    show this message\n"
 		"  -v, --v[ersion] display version information\n"
 		"  -g, --g[et]     show the active settings\n"
+		"  -m, --m[onitor] show the active settings then stream changes\n"
 		"  -w, --w[rite]   write active to cfg.yaml\n"
+		"  -f, --f[orget]  forget modes that failed, retrying them\n"
 		"  -s, --s[et]     add or change\n"
 		"     ARRANGE_ALIGN <row|column> <top|middle|bottom|left|right>\n"
 		"     ORDER <name> ...\n"
@@ -174,6 +177,33 @@ struct IpcRequest *parse_get(int argc, char **argv) {
 	return request;
 }
 
+struct IpcRequest *parse_monitor(int argc, char **argv) {
+	if (optind != argc) {
+		log_error("--monitor takes no arguments");
+		exit(EXIT_FAILURE);
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->command = SUBSCRIBE;
+
+	// only what changed after the first
+	request->delta = true;
+
+	return request;
+}
+
+struct IpcRequest *parse_forget(int argc, char **argv) {
+	if (optind != argc) {
+		log_error("--forget takes no arguments");
+		exit(EXIT_FAILURE);
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->command = MODES_FORGET;
+
+	return request;
+}
+
 struct IpcRequest *parse_write(int argc, char **argv) {
 	if (optind != argc) {
 		log_error("--write takes no arguments");
@@ -270,18 +300,34 @@ bool parse_log_threshold(char *optarg) {
 	return true;
 }
 
+bool parse_log_format(char *optarg) {
+	enum LogFormat format = log_format_val(optarg);
+
+	if (!format) {
+		log_error("invalid --log-format %s", optarg);
+		return false;
+	}
+
+	log_set_format(format, true);
+
+	return true;
+}
+
 struct IpcRequest *parse_args(int argc, char **argv) {
 	static struct option long_options[] = {
 		{ "delete",        required_argument, 0, 'd' },
+		{ "forget",        no_argument,       0, 'f' },
 		{ "get",           no_argument,       0, 'g' },
 		{ "help",          no_argument,       0, 'h' },
+		{ "log-format",    required_argument, 0, 'F' },
 		{ "log-threshold", required_argument, 0, 'L' },
+		{ "monitor",       no_argument,       0, 'm' },
 		{ "set",           required_argument, 0, 's' },
 		{ "version",       no_argument,       0, 'v' },
 		{ "write",         no_argument,       0, 'w' },
 		{ 0,               0,                 0,  0  }
 	};
-	static char *short_options = "d:ghL:s:vw";
+	static char *short_options = "d:fghL:ms:vw";
 
 	int c;
 	while (1) {
@@ -295,6 +341,11 @@ struct IpcRequest *parse_args(int argc, char **argv) {
 					exit(EXIT_FAILURE);
 				}
 				break;
+			case 'F':
+				if (!parse_log_format(optarg)) {
+					exit(EXIT_FAILURE);
+				}
+				break;
 			case 'h':
 				usage(stdout);
 				exit(EXIT_SUCCESS);
@@ -303,12 +354,16 @@ struct IpcRequest *parse_args(int argc, char **argv) {
 				exit(EXIT_SUCCESS);
 			case 'g':
 				return parse_get(argc, argv);
+			case 'm':
+				return parse_monitor(argc, argv);
 			case 's':
 				return parse_set(argc, argv);
 			case 'd':
 				return parse_del(argc, argv);
 			case 'w':
 				return parse_write(argc, argv);
+			case 'f':
+				return parse_forget(argc, argv);
 			case '?':
 			default:
 				usage(stderr);
@@ -22,11 +22,13 @@ extern "C" {
 #include "cfg.h"
 #include "convert.h"
 #include "head.h"
+#include "info.h"
 #include "ipc.h"
 #include "lid.h"
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "pool.h"
 #include "server.h"
 }
 
@@ -190,6 +192,10 @@ YAML::Emitter& operator << (YAML::Emitter& e, struct Cfg& cfg) {
 		e << YAML::Key << "LOG_THRESHOLD" << YAML::Value << log_threshold_name(cfg.log_threshold);
 	}
 
+	if (cfg.log_format) {
+		e << YAML::Key << "LOG_FORMAT" << YAML::Value << log_format_name(cfg.log_format);
+	}
+
 	return e;
 }
 
@@ -231,10 +237,10 @@ YAML::Emitter& operator << (YAML::Emitter& e, struct Head& head) {
 	e << head.desired;
 	e << YAML::EndMap;									// DESIRED
 
-	if (head.modes) {
+	if (head.modes.first) {
 		e << YAML::Key << "MODES" << YAML::BeginSeq;	// MODES
 
-		for (struct SList *i = head.modes; i; i = i->nex) {
+		for (struct SList *i = head.modes.first; i; i = i->nex) {
 			e << YAML::BeginMap;							// mode
 			e << *(Mode*)(i->val);
 			e << "CURRENT" << (head.current.mode == i->val);
@@ -247,6 +253,53 @@ YAML::Emitter& operator << (YAML::Emitter& e, struct Head& head) {
 	return e;
 }
 
+// a standalone block document, each line indented and the first prefixed
+std::string indented(const YAML::Emitter &e, const char *first, const char *rest) {
+	std::string yaml = first;
+
+	for (const char *c = e.c_str(); *c; c++) {
+		yaml += *c;
+		if (*c == '\n') {
+			yaml += rest;
+		}
+	}
+	yaml += '\n';
+
+	return yaml;
+}
+
+// a STATE HEADS entry, marshalled once per head revision, see state_revise
+const char *head_yaml(struct Head *head) {
+	if (!head->serialized.yaml) {
+		YAML::Emitter e;
+		e << YAML::TrueFalseBool;
+		e << YAML::UpperCase;
+		e << YAML::BeginMap << *head << YAML::EndMap;
+		head->serialized.yaml = strdup(indented(e, "    - ", "      ").c_str());
+	}
+	return head->serialized.yaml;
+}
+
+// the active cfg as a top level CFG, marshalled once per instance
+static struct {
+	unsigned long instance;
+	std::string yaml;
+} cfg_serialized;
+
+const char *cfg_yaml(struct Cfg *cfg) {
+	if (!cfg->instance || cfg->instance != cfg_serialized.instance) {
+		YAML::Emitter e;
+		e << YAML::TrueFalseBool;
+		e << YAML::UpperCase;
+		e << YAML::BeginMap;
+		e << YAML::Key << "CFG" << YAML::Value << YAML::BeginMap << *cfg << YAML::EndMap;
+		e << YAML::EndMap;
+		cfg_serialized.instance = cfg->instance;
+		cfg_serialized.yaml = indented(e, "", "");
+	}
+	return cfg_serialized.yaml.c_str();
+}
+
 void cfg_parse_node(struct Cfg *cfg, const YAML::Node &node) {
 	if (!cfg || !node || !node.IsMap()) {
 		throw std::runtime_error("empty CFG");
@@ -260,6 +313,14 @@ void cfg_parse_node(struct Cfg *cfg, const YAML::Node &node) {
 		}
 	}
 
+	if (node["LOG_FORMAT"]) {
+		const std::string &format_str = node["LOG_FORMAT"].as<std::string>();
+		cfg->log_format = log_format_val(format_str.c_str());
+		if (!cfg->log_format) {
+			log_warn("Ignoring invalid LOG_FORMAT %s, using default %s", format_str.c_str(), log_format_name(LOG_FORMAT_DEFAULT));
+		}
+	}
+
 	if (node["LAPTOP_DISPLAY_PREFIX"]) {
 		if (cfg->laptop_display_prefix) {
 			free(cfg->laptop_display_prefix);
@@ -393,6 +454,103 @@ void cfg_parse_node(struct Cfg *cfg, const YAML::Node &node) {
 	}
 }
 
+void head_state_parse_node(struct HeadState *head_state, const YAML::Node &node) {
+	if (node["SCALE"]) {
+		head_state->scale = wl_fixed_from_double(node["SCALE"].as<double>());
+	}
+	if (node["ENABLED"]) {
+		head_state->enabled = node["ENABLED"].as<bool>();
+	}
+	if (node["X"]) {
+		head_state->x = node["X"].as<int32_t>();
+	}
+	if (node["Y"]) {
+		head_state->y = node["Y"].as<int32_t>();
+	}
+}
+
+char *node_str(const YAML::Node &node) {
+	return node && !node.IsNull() ? strdup(node.as<std::string>().c_str()) : NULL;
+}
+
+// as operator << Head, the modes' zwlr objects absent
+void head_parse_node(struct SList **heads, const YAML::Node &node) {
+	if (!node.IsMap()) {
+		throw std::runtime_error("invalid HEAD");
+	}
+
+	struct Head *head = (struct Head*)pool_alloc(POOL_HEAD);
+	slist_append(heads, head);
+
+	head->name = node_str(node["NAME"]);
+	head->description = node_str(node["DESCRIPTION"]);
+	head->make = node_str(node["MAKE"]);
+	head->model = node_str(node["MODEL"]);
+	head->serial_number = node_str(node["SERIAL_NUMBER"]);
+
+	if (node["WIDTH_MM"]) {
+		head->width_mm = node["WIDTH_MM"].as<int32_t>();
+	}
+	if (node["HEIGHT_MM"]) {
+		head->height_mm = node["HEIGHT_MM"].as<int32_t>();
+	}
+
+	if (node["CURRENT"]) {
+		head_state_parse_node(&head->current, node["CURRENT"]);
+	}
+	if (node["DESIRED"]) {
+		head_state_parse_node(&head->desired, node["DESIRED"]);
+	}
+
+	if (node["MODES"]) {
+		for (const auto &node_mode : node["MODES"]) {
+			struct Mode *mode = (struct Mode*)pool_alloc(POOL_MODE);
+			mode->head = head;
+			slist_header_append(&head->modes, mode);
+
+			mode->width = node_mode["WIDTH"].as<int32_t>();
+			mode->height = node_mode["HEIGHT"].as<int32_t>();
+			mode->refresh_mhz = node_mode["REFRESH_MHZ"].as<int32_t>();
+			mode->preferred = node_mode["PREFERRED"] && node_mode["PREFERRED"].as<bool>();
+			if (mode->preferred) {
+				head->preferred_mode = mode;
+			}
+			if (node_mode["CURRENT"] && node_mode["CURRENT"].as<bool>()) {
+				head->current.mode = mode;
+			}
+		}
+	}
+}
+
+// as marshalled by marshal_ipc_response, less the POOL diagnostics
+void state_parse_node(struct IpcResponse *response, const YAML::Node &node) {
+	if (!node.IsMap()) {
+		throw std::runtime_error("invalid STATE");
+	}
+
+	if (node["REVISION"]) {
+		response->revision = node["REVISION"].as<unsigned long>();
+	}
+
+	if (node["DELTA"]) {
+		response->delta = node["DELTA"].as<bool>();
+	}
+
+	const YAML::Node node_lid = node["LID"];
+	if (node_lid && node_lid.IsMap()) {
+		response->lid = (struct Lid*)calloc(1, sizeof(struct Lid));
+		response->lid->closed = node_lid["CLOSED"] && node_lid["CLOSED"].as<bool>();
+		response->lid->device_path = node_str(node_lid["DEVICE_PATH"]);
+	}
+
+	const YAML::Node node_heads = node["HEADS"];
+	if (node_heads && node_heads.IsSequence()) {
+		for (const auto &node_head : node_heads) {
+			head_parse_node(&response->heads, node_head);
+		}
+	}
+}
+
 char *marshal_ipc_request(struct IpcRequest *request) {
 	if (!request) {
 		return NULL;
@@ -408,6 +566,10 @@ char *marshal_ipc_request(struct IpcRequest *request) {
 
 		e << YAML::Key << "OP" << YAML::Value << ipc_request_command_name(request->command);
 
+		if (request->delta) {
+			e << YAML::Key << "SINCE" << YAML::Value << request->since;
+		}
+
 		if (request->cfg) {
 			e << YAML::Key << "CFG" << YAML::BeginMap;	// CFG
 			e << *request->cfg;
@@ -453,6 +615,12 @@ struct IpcRequest *unmarshal_ipc_request(char *yaml) {
 			throw std::runtime_error("missing OP");
 		}
 
+		const YAML::Node node_since = node["SINCE"];
+		if (node_since) {
+			request->delta = true;
+			request->since = node_since.as<unsigned long>();
+		}
+
 		const YAML::Node node_cfg = node["CFG"];
 		if (node_cfg && node_cfg.IsMap()) {
 			request->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
@@ -469,8 +637,22 @@ struct IpcRequest *unmarshal_ipc_request(char *yaml) {
 	}
 }
 
+bool ipc_request_yaml_complete(const char *yaml) {
+	if (!yaml) {
+		return false;
+	}
+
+	try {
+		const YAML::Node node = YAML::Load(yaml);
+		return node.IsMap() && node["OP"];
+	} catch (const std::exception &e) {
+		return false;
+	}
+}
+
+// top level mappings emitted separately and concatenated; heads and cfg are reused as marshalled
 char *marshal_ipc_response(struct IpcResponse *response) {
-	char *yaml = NULL;
+	std::string yaml;
 
 	try {
 		YAML::Emitter e;
@@ -483,71 +665,119 @@ char *marshal_ipc_response(struct IpcResponse *response) {
 		e << YAML::Key << "DONE" << YAML::Value << response->done;
 		e << YAML::Key << "RC" << YAML::Value << response->rc;
 
+		if (response->events) {
+			e << YAML::Key << "EVENTS" << YAML::BeginSeq;		// EVENTS
+			for (int ev = 1; ev <= IPC_EVENT_MAX; ev++) {
+				if (response->events & IPC_EVENT_BIT(ev)) {
+					e << ipc_event_name((enum IpcEvent)ev);
+				}
+			}
+			e << YAML::EndSeq;									// EVENTS
+		}
+
+		e << YAML::EndMap;									// root
+
+		if (!e.good()) {
+			log_error("marshalling ipc response: %s", e.GetLastError().c_str());
+			return NULL;
+		}
+
+		yaml = indented(e, "", "");
+
 		if (response->status) {
-			if (cfg) {
-				e << YAML::Key << "CFG" << YAML::BeginMap;		// CFG
-				e << *cfg;
-				e << YAML::EndMap;								// CFG
+			if (cfg && ipc_response_has_cfg(response)) {
+				yaml += cfg_yaml(cfg);
 			}
 
-			if (lid || heads) {
-				e << YAML::Key << "STATE" << YAML::BeginMap;	// STATE
+			if ((lid || heads) && ipc_response_has_state(response)) {
+				YAML::Emitter s;
+				s << YAML::TrueFalseBool;
+				s << YAML::UpperCase;
+				s.SetIndent(2);
+
+				s << YAML::BeginMap;								// root
+				s << YAML::Key << "STATE" << YAML::BeginMap;		// STATE
+
+				s << YAML::Key << "REVISION" << YAML::Value << state_revision;
+				if (response->delta) {
+					s << YAML::Key << "DELTA" << YAML::Value << ipc_response_state_delta(response);
+				}
 
-				if (lid) {
-					e << YAML::Key << "LID" << YAML::BeginMap;		// LID
-					e << YAML::Key << "CLOSED" << YAML::Value << lid->closed;
-					e << YAML::Key << "DEVICE_PATH" << YAML::Value << lid->device_path;
-					e << YAML::EndMap;								// LID
+				if (lid && ipc_response_state_includes(response, state_revision_lid)) {
+					s << YAML::Key << "LID" << YAML::BeginMap;		// LID
+					s << YAML::Key << "CLOSED" << YAML::Value << lid->closed;
+					s << YAML::Key << "DEVICE_PATH" << YAML::Value << lid->device_path;
+					s << YAML::EndMap;								// LID
 				}
 
+				s << YAML::Key << "POOL" << YAML::BeginMap;		// POOL
+				for (int t = POOL_SLIST; t <= POOL_HEAD; t++) {
+					struct PoolStats stats = pool_stats((enum PoolType)t);
+					s << YAML::Key << pool_type_name((enum PoolType)t) << YAML::BeginMap;
+					s << YAML::Key << "LIVE" << YAML::Value << stats.live;
+					s << YAML::Key << "HIGH_WATER" << YAML::Value << stats.high_water;
+					s << YAML::Key << "CAPACITY" << YAML::Value << stats.capacity;
+					s << YAML::EndMap;
+				}
+				s << YAML::EndMap;								// POOL
+
+				s << YAML::EndMap;								// STATE
+				s << YAML::EndMap;								// root
+
+				if (!s.good()) {
+					log_error("marshalling ipc response: %s", s.GetLastError().c_str());
+					return NULL;
+				}
+
+				yaml += indented(s, "", "");
+
+				// last in STATE, at its indent
 				if (heads) {
-					e << YAML::Key << "HEADS" << YAML::BeginSeq;	// HEADS
+					std::string heads_yaml;
 					for (struct SList *i = heads; i; i = i->nex) {
-						e << YAML::BeginMap << *(Head*)(i->val) << YAML::EndMap;
+						struct Head *head = (struct Head*)i->val;
+						if (ipc_response_state_includes(response, head->revision)) {
+							heads_yaml += head_yaml(head);
+						}
 					}
-					e << YAML::EndSeq;								// HEADS
+					yaml += heads_yaml.empty() ? "  HEADS: []\n" : "  HEADS:\n" + heads_yaml;
 				}
-
-				e << YAML::EndMap;								// STATE
 			}
 		}
 
 		if (response->messages) {
-			e << YAML::Key << "MESSAGES" << YAML::BeginMap;		// MESSAGES
-			for (struct SList *i = log_cap_lines; i; i = i->nex) {
-				struct LogCapLine *cap_line = (struct LogCapLine*)i->val;
-				if (cap_line && cap_line->line) {
-					e << YAML::Key << log_threshold_name(cap_line->threshold);
-					e << YAML::Value << cap_line->line;
-					if (cap_line->threshold == WARNING && response->rc < IPC_RC_WARN) {
-						response->rc = IPC_RC_WARN;
-					}
-					if (cap_line->threshold == ERROR && response->rc < IPC_RC_ERROR) {
-						response->rc = IPC_RC_ERROR;
-					}
+			YAML::Emitter m;
+
+			m << YAML::BeginMap;								// root
+			m << YAML::Key << "MESSAGES" << YAML::BeginMap;		// MESSAGES
+			const struct LogCapLine *cap_line;
+			for (size_t i = 0; (cap_line = log_cap_line(log_cap, i)); i++) {
+				m << YAML::Key << log_threshold_name(cap_line->threshold);
+				m << YAML::Value << cap_line->line;
+				if (cap_line->threshold == WARNING && response->rc < IPC_RC_WARN) {
+					response->rc = IPC_RC_WARN;
+				}
+				if (cap_line->threshold == ERROR && response->rc < IPC_RC_ERROR) {
+					response->rc = IPC_RC_ERROR;
 				}
 			}
-			e << YAML::EndMap;									// MESSAGES
-		}
+			m << YAML::EndMap;									// MESSAGES
+			m << YAML::EndMap;									// root
 
-		e << YAML::EndMap;									// root
+			if (!m.good()) {
+				log_error("marshalling ipc response: %s", m.GetLastError().c_str());
+				return NULL;
+			}
 
-		if (!e.good()) {
-			log_error("marshalling ipc response: %s", e.GetLastError().c_str());
-			return NULL;
+			yaml += indented(m, "", "");
 		}
 
-		yaml = yaml_with_newline(e);
-
 	} catch (const std::exception &e) {
 		log_error("marshalling ipc response: %s\n%s", e.what());
+		return NULL;
 	}
 
-	if (response->messages) {
-		log_capture_clear();
-	}
-
-	return yaml;
+	return strdup(yaml.c_str());
 }
 
 struct IpcResponse *unmarshal_ipc_response(char *yaml) {
@@ -582,6 +812,27 @@ struct IpcResponse *unmarshal_ipc_response(char *yaml) {
 				response->rc = i->second.as<int>();
 			}
 
+			if (i->first.as<std::string>() == "EVENTS" && i->second.IsSequence()) {
+				for (YAML::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
+					enum IpcEvent ev = ipc_event_val(j->as<std::string>().c_str());
+					if (ev) {
+						response->events |= IPC_EVENT_BIT(ev);
+					}
+				}
+			}
+
+			if (i->first.as<std::string>() == "CFG" && i->second.IsMap()) {
+				cfg_free(response->cfg);
+				response->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+				response->status = true;
+				cfg_parse_node(response->cfg, i->second);
+			}
+
+			if (i->first.as<std::string>() == "STATE") {
+				response->status = true;
+				state_parse_node(response, i->second);
+			}
+
 			if (i->first.as<std::string>() == "MESSAGES" && i->second.IsMap()) {
 				for (YAML::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
 					enum LogThreshold threshold = log_threshold_val(j->first.as<std::string>().c_str());
@@ -1,12 +1,24 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "mode.h"
 
+#include "cache.h"
 #include "cfg.h"
 #include "head.h"
 #include "list.h"
+#include "log.h"
+#include "pool.h"
+
+// recorded verdicts
+struct SList *mode_validations = NULL;
 
 int32_t mhz_to_hz(int32_t mhz) {
 	return (mhz + 500) / 1000;
@@ -63,6 +75,199 @@ bool mrr_satisfies_user_mode(struct ModesResRefresh *mrr, struct UserMode *user_
 		 (user_mode->refresh_hz == -1 || mrr->refresh_hz == user_mode->refresh_hz));
 }
 
+bool failed_bit(uint64_t *failed, size_t i) {
+	return failed[i / 64] & (1ULL << (i % 64));
+}
+
+void set_failed_bit(uint64_t *failed, size_t i, bool val) {
+	if (val) {
+		failed[i / 64] |= 1ULL << (i % 64);
+	} else {
+		failed[i / 64] &= ~(1ULL << (i % 64));
+	}
+}
+
+bool mode_in_table(struct ModeTable *table, struct Mode *mode) {
+	return table && mode && mode->index < table->count && table->modes[mode->index] == mode;
+}
+
+// as per the discovery order of modes
+void mode_table_slots(struct ModeTable *table, struct SList *modes) {
+	struct Mode *mode;
+
+	table->preferred = NULL;
+	table->max_preferred = NULL;
+	table->max = NULL;
+
+	for (struct SList *i = modes; i; i = i->nex) {
+		mode = i->val;
+		if (!mode || mode_table_failed(table, mode)) {
+			continue;
+		}
+
+		// first preferred
+		if (!table->preferred && mode->preferred) {
+			table->preferred = mode;
+		}
+
+		// highest resolution
+		if (!table->max || mode->width * mode->height > table->max->width * table->max->height) {
+			table->max = mode;
+			continue;
+		}
+
+		// highest refresh at highest resolution
+		if (mode->width == table->max->width &&
+				mode->height == table->max->height &&
+				mode->refresh_mhz > table->max->refresh_mhz) {
+			table->max = mode;
+		}
+	}
+
+	if (!table->preferred) {
+		return;
+	}
+
+	// highest refresh at preferred resolution
+	for (struct SList *i = modes; i; i = i->nex) {
+		mode = i->val;
+		if (!mode || mode_table_failed(table, mode)) {
+			continue;
+		}
+
+		if (mode->width != table->preferred->width || mode->height != table->preferred->height) {
+			continue;
+		}
+
+		if (!table->max_preferred || mode->refresh_mhz > table->max_preferred->refresh_mhz) {
+			table->max_preferred = mode;
+		}
+	}
+}
+
+void mode_table_build(struct ModeTable *table, struct SList *modes, struct SList *modes_failed) {
+	if (!table)
+		return;
+
+	mode_table_free(table);
+
+	size_t count = slist_length(modes);
+
+	table->modes = calloc(count + 1, sizeof(struct Mode*));
+	table->failed = calloc(count / 64 + 1, sizeof(uint64_t));
+
+	// stable, preserving discovery order
+	size_t sorted = slist_sort_array(modes, greater_than_res_refresh, (void**)table->modes, count);
+
+	for (size_t i = 0; i < sorted; i++) {
+		if (table->modes[i]) {
+			table->modes[i]->index = table->count;
+			table->modes[table->count++] = table->modes[i];
+		}
+	}
+
+	table->available = table->count;
+	for (struct SList *i = modes_failed; i; i = i->nex) {
+		struct Mode *mode = i->val;
+		if (mode_in_table(table, mode) && !failed_bit(table->failed, mode->index)) {
+			set_failed_bit(table->failed, mode->index, true);
+			table->available--;
+		}
+	}
+
+	mode_table_slots(table, modes);
+
+	table->stale = false;
+}
+
+bool mode_table_failed(struct ModeTable *table, struct Mode *mode) {
+	return mode_in_table(table, mode) && failed_bit(table->failed, mode->index);
+}
+
+void mode_table_fail(struct ModeTable *table, struct SList *modes, struct Mode *mode) {
+	if (!mode_in_table(table, mode) || failed_bit(table->failed, mode->index))
+		return;
+
+	set_failed_bit(table->failed, mode->index, true);
+	table->available--;
+
+	mode_table_slots(table, modes);
+}
+
+void mode_table_remove(struct ModeTable *table, struct SList *modes, struct Mode *mode) {
+	if (!mode_in_table(table, mode))
+		return;
+
+	size_t index = mode->index;
+
+	if (!failed_bit(table->failed, index)) {
+		table->available--;
+	}
+
+	memmove(&table->modes[index], &table->modes[index + 1], (table->count - index - 1) * sizeof(struct Mode*));
+	table->count--;
+
+	for (size_t i = index; i < table->count; i++) {
+		table->modes[i]->index = i;
+		set_failed_bit(table->failed, i, failed_bit(table->failed, i + 1));
+	}
+	set_failed_bit(table->failed, table->count, false);
+
+	mode_table_slots(table, modes);
+}
+
+struct Mode *mode_table_user_mode(struct ModeTable *table, struct UserMode *user_mode) {
+	if (!table || !user_mode)
+		return NULL;
+
+	size_t lo = 0, hi = table->count, mid;
+	struct Mode *mode;
+
+	// first mode at the user resolution
+	if (!user_mode->max) {
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			mode = table->modes[mid];
+			if (mode->width > user_mode->width || (mode->width == user_mode->width && mode->height > user_mode->height)) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+	}
+
+	// highest refresh matching the user mode
+	for (size_t i = lo; i < table->count; i++) {
+		mode = table->modes[i];
+
+		if (!user_mode->max) {
+			if (mode->width != user_mode->width || mode->height != user_mode->height) {
+				break;
+			}
+			if (user_mode->refresh_hz != -1 && mhz_to_hz(mode->refresh_mhz) != user_mode->refresh_hz) {
+				continue;
+			}
+		}
+
+		if (!failed_bit(table->failed, i)) {
+			return mode;
+		}
+	}
+
+	return NULL;
+}
+
+void mode_table_free(struct ModeTable *table) {
+	if (!table)
+		return;
+
+	free(table->modes);
+	free(table->failed);
+
+	memset(table, 0, sizeof(struct ModeTable));
+	table->stale = true;
+}
+
 double mode_dpi(struct Mode *mode) {
 	if (!mode || !mode->head || !mode->head->width_mm || !mode->head->height_mm) {
 		return 0;
@@ -74,7 +279,7 @@ double mode_dpi(struct Mode *mode) {
 }
 
 struct SList *modes_res_refresh(struct SList *modes) {
-	struct SList *mrrs = NULL;
+	struct SListHeader mrrs = { 0 };
 
 	struct SList *sorted = slist_sort(modes, greater_than_res_refresh);
 
@@ -83,20 +288,224 @@ struct SList *modes_res_refresh(struct SList *modes) {
 	for (struct SList *i = sorted; i; i = i->nex) {
 		mode = i->val;
 
-		if (!mrr || !equal_mode_res_hz(mode, mrr->modes->val)) {
+		if (!mrr || !equal_mode_res_hz(mode, mrr->modes.first->val)) {
 			mrr = calloc(1, sizeof(struct ModesResRefresh));
 			mrr->width = mode->width;
 			mrr->height = mode->height;
 			mrr->refresh_hz = mhz_to_hz(mode->refresh_mhz);
-			slist_append(&mrrs, mrr);
+			slist_header_append(&mrrs, mrr);
 		}
 
-		slist_append(&mrr->modes, mode);
+		slist_header_append(&mrr->modes, mode);
 	}
 
 	slist_free(&sorted);
 
-	return mrrs;
+	return mrrs.first;
+}
+
+// rejected modes only, one per line: recorded width height refresh_mhz identity
+void modes_failed_write(void) {
+	char path[PATH_MAX];
+	char path_tmp[PATH_MAX + 4];
+
+	if (!cache_path("modes_failed", path, sizeof(path)))
+		return;
+
+	snprintf(path_tmp, sizeof(path_tmp), "%s.tmp", path);
+
+	FILE *f = fopen(path_tmp, "w");
+	if (!f) {
+		log_warn_errno("\nUnable to write %s", path_tmp);
+		return;
+	}
+
+	for (struct SList *i = mode_validations; i; i = i->nex) {
+		struct ModeValidation *validation = i->val;
+		if (validation->validity == MODE_INVALID) {
+			fprintf(f, "%ld %d %d %d %s\n",
+					(long)validation->recorded,
+					validation->width,
+					validation->height,
+					validation->refresh_mhz,
+					validation->head_identity
+					);
+		}
+	}
+
+	fclose(f);
+
+	if (rename(path_tmp, path) == -1) {
+		log_warn_errno("\nUnable to write %s", path);
+	}
+}
+
+struct ModeValidation *mode_validation_init(struct Mode *mode) {
+	if (!mode)
+		return NULL;
+
+	const char *identity = head_identity(mode->head);
+	if (!identity)
+		return NULL;
+
+	struct ModeValidation *validation = calloc(1, sizeof(struct ModeValidation));
+
+	validation->head_identity = strdup(identity);
+	validation->width = mode->width;
+	validation->height = mode->height;
+	validation->refresh_mhz = mode->refresh_mhz;
+	validation->recorded = time(NULL);
+
+	return validation;
+}
+
+bool mode_validation_matches(struct ModeValidation *validation, struct Mode *mode) {
+	if (!validation || !mode ||
+			validation->width != mode->width ||
+			validation->height != mode->height ||
+			validation->refresh_mhz != mode->refresh_mhz) {
+		return false;
+	}
+
+	const char *identity = head_identity(mode->head);
+
+	return identity && strcmp(validation->head_identity, identity) == 0;
+}
+
+bool equal_mode_validation(const void *a, const void *b) {
+	const struct ModeValidation *lhs = a;
+	const struct ModeValidation *rhs = b;
+
+	return lhs && rhs &&
+		lhs->width == rhs->width &&
+		lhs->height == rhs->height &&
+		lhs->refresh_mhz == rhs->refresh_mhz &&
+		strcmp(lhs->head_identity, rhs->head_identity) == 0;
+}
+
+void mode_validation_record(struct ModeValidation *validation) {
+	if (!validation)
+		return;
+
+	struct SList *i = slist_find_equal(mode_validations, equal_mode_validation, validation);
+	bool persist = validation->validity == MODE_INVALID || (i && ((struct ModeValidation*)i->val)->validity == MODE_INVALID);
+
+	slist_remove_all_free(&mode_validations, equal_mode_validation, validation, mode_validation_free);
+	slist_append(&mode_validations, validation);
+
+	if (persist) {
+		modes_failed_write();
+	}
+}
+
+void mode_validated(struct Mode *mode, enum ModeValidity validity) {
+	struct ModeValidation *validation = mode_validation_init(mode);
+	if (validation) {
+		validation->validity = validity;
+		mode_validation_record(validation);
+	}
+}
+
+enum ModeValidity mode_validity(struct Mode *mode) {
+	if (!mode || !mode_validations)
+		return MODE_UNTESTED;
+
+	enum ModeValidity validity = MODE_UNTESTED;
+
+	const char *identity = head_identity(mode->head);
+
+	for (struct SList *i = mode_validations; identity && i; i = i->nex) {
+		struct ModeValidation *validation = i->val;
+		if (validation->width == mode->width &&
+				validation->height == mode->height &&
+				validation->refresh_mhz == mode->refresh_mhz &&
+				strcmp(validation->head_identity, identity) == 0) {
+			validity = validation->validity;
+			break;
+		}
+	}
+
+	return validity;
+}
+
+void mode_validations_load(void) {
+	char path[PATH_MAX];
+
+	if (!cache_path("modes_failed", path, sizeof(path)))
+		return;
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+
+	time_t now = time(NULL);
+	unsigned int loaded = 0;
+	unsigned int expired = 0;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		long recorded;
+		int32_t width, height, refresh_mhz;
+		int identity_at = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		// exactly one space before the identity, which may itself start with one
+		if (sscanf(line, "%ld %d %d %d%n", &recorded, &width, &height, &refresh_mhz, &identity_at) != 4 || line[identity_at] != ' ' || !line[identity_at + 1]) {
+			continue;
+		}
+		identity_at++;
+
+		if (now - recorded > MODE_VALIDATION_EXPIRY_SEC) {
+			expired++;
+			continue;
+		}
+
+		struct ModeValidation *validation = calloc(1, sizeof(struct ModeValidation));
+		validation->head_identity = strdup(line + identity_at);
+		validation->width = width;
+		validation->height = height;
+		validation->refresh_mhz = refresh_mhz;
+		validation->recorded = recorded;
+		validation->validity = MODE_INVALID;
+
+		slist_remove_all_free(&mode_validations, equal_mode_validation, validation, mode_validation_free);
+		slist_append(&mode_validations, validation);
+		loaded++;
+	}
+
+	fclose(f);
+
+	log_info("\nLoaded %u failed modes from %s", loaded, path);
+
+	if (expired) {
+		log_info("  %u expired", expired);
+		modes_failed_write();
+	}
+}
+
+void mode_validations_forget(void) {
+	char path[PATH_MAX];
+
+	slist_free_vals(&mode_validations, mode_validation_free);
+
+	if (cache_path("modes_failed", path, sizeof(path)) && unlink(path) == -1 && errno != ENOENT) {
+		log_warn_errno("\nUnable to remove %s", path);
+	}
+}
+
+void mode_validation_free(void *data) {
+	struct ModeValidation *validation = data;
+
+	if (!validation)
+		return;
+
+	free(validation->head_identity);
+	free(validation);
+}
+
+void mode_validations_destroy(void) {
+	slist_free_vals(&mode_validations, mode_validation_free);
 }
 
 void mode_free(void *data) {
@@ -105,7 +514,7 @@ void mode_free(void *data) {
 	if (!mode)
 		return;
 
-	free(mode);
+	pool_free(POOL_MODE, mode);
 }
 
 void mode_res_refresh_free(void *data) {
@@ -114,7 +523,7 @@ void mode_res_refresh_free(void *data) {
 	if (!modes_res_refresh)
 		return;
 
-	slist_free(&modes_res_refresh->modes);
+	slist_header_free(&modes_res_refresh->modes);
 	free(modes_res_refresh);
 }
 
@@ -0,0 +1,131 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+#include "head.h"
+#include "list.h"
+#include "mode.h"
+
+#define SLAB_OBJECTS 64
+
+#define ALIGN_UP(n) (((n) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+// threaded through free objects
+struct PoolFree {
+	struct PoolFree *nex;
+};
+
+// header, followed by SLAB_OBJECTS objects
+struct PoolSlab {
+	struct PoolSlab *nex;
+};
+
+struct Pool {
+	size_t size;
+	struct PoolFree *free;
+	struct PoolSlab *slabs;
+	struct PoolStats stats;
+};
+
+static struct Pool pools[] = {
+	[POOL_SLIST] = { .size = sizeof(struct SList), },
+	[POOL_MODE]  = { .size = sizeof(struct Mode),  },
+	[POOL_HEAD]  = { .size = sizeof(struct Head),  },
+};
+
+struct Pool *pool(enum PoolType type) {
+	if (type < POOL_SLIST || type > POOL_HEAD) {
+		return NULL;
+	}
+	return &pools[type];
+}
+
+void pool_add_slab(struct Pool *pool) {
+	size_t size = ALIGN_UP(pool->size);
+
+	struct PoolSlab *slab = calloc(1, ALIGN_UP(sizeof(struct PoolSlab)) + SLAB_OBJECTS * size);
+	if (!slab) {
+		return;
+	}
+
+	slab->nex = pool->slabs;
+	pool->slabs = slab;
+
+	char *objs = (char*)slab + ALIGN_UP(sizeof(struct PoolSlab));
+	for (size_t i = SLAB_OBJECTS; i > 0; i--) {
+		struct PoolFree *f = (struct PoolFree*)(objs + (i - 1) * size);
+		f->nex = pool->free;
+		pool->free = f;
+	}
+
+	pool->stats.capacity += SLAB_OBJECTS;
+}
+
+void *pool_alloc(enum PoolType type) {
+	struct Pool *p = pool(type);
+	if (!p) {
+		return NULL;
+	}
+
+	if (!p->free) {
+		pool_add_slab(p);
+		if (!p->free) {
+			return NULL;
+		}
+	}
+
+	struct PoolFree *obj = p->free;
+	p->free = obj->nex;
+
+	memset(obj, 0, p->size);
+
+	p->stats.live++;
+	if (p->stats.live > p->stats.high_water) {
+		p->stats.high_water = p->stats.live;
+	}
+
+	return obj;
+}
+
+void pool_free(enum PoolType type, void *obj) {
+	struct Pool *p = pool(type);
+	if (!p || !obj) {
+		return;
+	}
+
+	struct PoolFree *f = obj;
+	f->nex = p->free;
+	p->free = f;
+
+	p->stats.live--;
+}
+
+struct PoolStats pool_stats(enum PoolType type) {
+	struct PoolStats stats = { 0 };
+
+	struct Pool *p = pool(type);
+	if (p) {
+		stats = p->stats;
+	}
+
+	return stats;
+}
+
+void pool_destroy(void) {
+	for (enum PoolType type = POOL_SLIST; type <= POOL_HEAD; type++) {
+		struct Pool *p = pool(type);
+
+		struct PoolSlab *slab;
+		while ((slab = p->slabs)) {
+			p->slabs = slab->nex;
+			free(slab);
+		}
+
+		p->free = NULL;
+		memset(&p->stats, 0, sizeof(struct PoolStats));
+	}
+}
+
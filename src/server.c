@@ -1,15 +1,16 @@
-#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/signalfd.h>
 #include <unistd.h>
+#include <wayland-client-core.h>
 
 #include "wl_wrappers.h"
 
 #include "server.h"
 
+#include "cache.h"
 #include "cfg.h"
 #include "convert.h"
 #include "displ.h"
@@ -20,93 +21,200 @@
 #include "layout.h"
 #include "lid.h"
 #include "log.h"
+#include "mode.h"
+#include "pool.h"
 #include "process.h"
+#include "sockets.h"
+
+// discarded from subscribers each time they are readable
+#define SUBSCRIBER_READ_MAX 65536
 
 struct Displ *displ = NULL;
 struct Lid *lid = NULL;
 struct Cfg *cfg = NULL;
 
+// all client connections
+struct SList *ipc_connections = NULL;
+
+// mutating requests, started one at a time in order
+struct SListHeader ipc_queue = { 0 };
+
+// the started request and its response, until done
+struct IpcConnection *ipc_active = NULL;
 struct IpcResponse *ipc_response = NULL;
 
-void handle_ipc_in_progress(int fd_sock) {
-	struct IpcRequest *request = ipc_request_receive(fd_sock);
-	if (!request) {
-		log_error("\nFailed to read IPC request");
-		return;
+// connections streaming events, until they disconnect
+struct SList *ipc_subscribers = NULL;
+
+int signalled = 0;
+
+// subscribed signals are mostly a clean exit
+void handle_signal(int fd, void *data) {
+	struct signalfd_siginfo fdsi;
+	if (read(fd, &fdsi, sizeof(fdsi)) == sizeof(fdsi)) {
+		if (fdsi.ssi_signo != SIGPIPE) {
+			signalled = fdsi.ssi_signo;
+		}
 	}
+}
 
-	struct IpcResponse *response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
-	response->fd = request->fd;
-	response->done = true;
-	response->rc = IPC_RC_REQUEST_IN_PROGRESS;
+void handle_cfg_dir(int fd, void *data) {
+	if (cfg_file_modified(cfg->file_name)) {
+		if (cfg->written) {
+			cfg->written = false;
+		} else {
+			cfg_file_reload();
+		}
+	}
+}
 
-	ipc_response_send(response);
+void handle_lid(int fd, void *data) {
+	lid_update();
+}
 
-	close(response->fd);
+// log streams watched for writability while lines remain
+bool logs_pending[STDERR_FILENO + 1] = { 0 };
 
-	free_ipc_response(response);
+void handle_log_writable(int fd, void *data) {
+	log_sink_flush(fd);
 }
 
-void handle_ipc_response(void) {
-	if (!ipc_response) {
-		return;
+// write what logs we can, waking when the remainder can be written
+void flush_logs(void) {
+	for (int fd = STDOUT_FILENO; fd <= STDERR_FILENO; fd++) {
+		bool pending = log_sink_flush(fd);
+		if (pending && !logs_pending[fd]) {
+			logs_pending[fd] = fds_register_writable(fd, handle_log_writable, NULL);
+		} else if (!pending && logs_pending[fd]) {
+			fds_unregister_writable(fd);
+			logs_pending[fd] = false;
+		}
 	}
+}
 
-	ipc_response_send(ipc_response);
+// swap the capture with the connection's own, leaving the active connection's lines untouched
+void capture_swap(struct IpcConnection *connection) {
+	struct LogCap *lines = log_cap;
+	log_cap = connection->messages;
+	connection->messages = lines;
+}
 
-	if (ipc_response->done) {
+void capture_begin(struct IpcConnection *connection) {
+	capture_swap(connection);
+	log_capture_start();
+}
+
+void capture_end(struct IpcConnection *connection) {
+	capture_swap(connection);
+	if (!ipc_active) {
 		log_capture_stop();
-		log_capture_clear();
+	}
+}
+
+// the active request's client is finished with; the next may start
+void ipc_active_release(void) {
+	log_capture_stop();
+	log_capture_clear();
+
+	ipc_active = NULL;
 
-		close(ipc_response->fd);
+	free_ipc_response(ipc_response);
+	ipc_response = NULL;
+}
 
-		free_ipc_response(ipc_response);
-		ipc_response = NULL;
+void ipc_close(struct IpcConnection *connection) {
+	if (connection == ipc_active) {
+		ipc_active_release();
 	}
+
+	fds_unregister(connection->fd);
+	close(connection->fd);
+
+	slist_remove_all(&ipc_connections, NULL, connection);
+	slist_remove_all(&ipc_subscribers, NULL, connection);
+	slist_header_remove_all(&ipc_queue, NULL, connection);
+
+	free_ipc_connection(connection);
 }
 
-void handle_ipc_request(int fd_sock) {
-	if (ipc_response) {
-		handle_ipc_in_progress(fd_sock);
+// write what the client will take, closing when failed or when finished and drained
+void handle_ipc_writable(int fd, void *data) {
+	struct IpcConnection *connection = data;
+
+	if (!ipc_connection_flush(connection)) {
+		ipc_close(connection);
 		return;
 	}
 
-	log_capture_clear();
-	log_capture_start();
+	if (!connection->out_len) {
+		if (connection->state == IPC_CLOSING) {
+			ipc_close(connection);
+		} else {
+			fds_unregister_writable(fd);
+		}
+	}
+}
 
-	struct IpcRequest *ipc_request = ipc_request_receive(fd_sock);
-	if (!ipc_request) {
-		log_error("\nFailed to read IPC request");
-		log_capture_stop();
-		log_capture_clear();
+// wait for the client to take any output that remains
+void ipc_watch_output(struct IpcConnection *connection) {
+	if (connection->out_len) {
+		fds_register_writable(connection->fd, handle_ipc_writable, connection);
+	}
+}
+
+// nothing further to send; close once the client has taken what remains
+void ipc_finish(struct IpcConnection *connection) {
+	if (!connection->out_len) {
+		ipc_close(connection);
 		return;
 	}
 
-	ipc_response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
-	ipc_response->fd = ipc_request->fd;
-	ipc_response->done = true;
-	ipc_response->messages = true;
-	ipc_response->status = true;
+	if (connection == ipc_active) {
+		ipc_active_release();
+	}
+
+	slist_remove_all(&ipc_subscribers, NULL, connection);
+	connection->state = IPC_CLOSING;
+
+	fds_unregister(connection->fd);
+	ipc_watch_output(connection);
+}
 
-	if (ipc_request->bad) {
-		ipc_response->rc = IPC_RC_BAD_REQUEST;
-		ipc_response->status = false;
-		goto send;
+struct IpcResponse *ipc_response_create(struct IpcConnection *connection) {
+	struct IpcResponse *response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
+	response->connection = connection;
+	response->framed = connection->framed;
+	response->encoding = connection->encoding;
+	response->done = true;
+	response->messages = true;
+	response->status = true;
+	if (connection->request) {
+		response->delta = connection->request->delta;
+		response->since = connection->request->since;
 	}
+	return response;
+}
 
-	log_info("\nServer received request: %s", ipc_request_command_friendly(ipc_request->command));
-	if (ipc_request->cfg) {
-		print_cfg(INFO, ipc_request->cfg, ipc_request->command == CFG_DEL);
+void handle_ipc_request(struct IpcRequest *request, struct IpcResponse *response) {
+	if (request->bad) {
+		response->rc = IPC_RC_BAD_REQUEST;
+		response->status = false;
+		return;
 	}
 
-	switch (ipc_request->command) {
+	log_info("\nServer received request: %s", ipc_request_command_friendly(request->command));
+	if (request->cfg) {
+		print_cfg(INFO, request->cfg, request->command == CFG_DEL);
+	}
+
+	switch (request->command) {
 		case CFG_DEL:
 		case CFG_SET:
 			{
-				struct Cfg *cfg_merged = cfg_merge(cfg, ipc_request->cfg, ipc_request->command == CFG_DEL);
+				struct Cfg *cfg_merged = cfg_merge(cfg, request->cfg, request->command == CFG_DEL);
 				if (cfg_merged) {
 					// ongoing
-					ipc_response->done = false;
+					response->done = false;
 					cfg_free(cfg);
 					cfg = cfg_merged;
 					log_info("\nNew configuration:");
@@ -124,6 +232,24 @@ void handle_ipc_request(int fd_sock) {
 				log_info("\nWrote configuration file: %s", cfg->file_path);
 				break;
 			}
+		case MODES_FORGET:
+			{
+				// ongoing, retrying desired modes
+				response->done = false;
+				mode_validations_forget();
+				for (struct SList *i = heads; i; i = i->nex) {
+					head_forget_failed_modes(i->val);
+				}
+				log_info("\nForgot failed modes");
+				break;
+			}
+		case SUBSCRIBE:
+			{
+				// ongoing until the client disconnects
+				response->done = false;
+				log_info("\nSubscribed to events");
+				break;
+			}
 		case GET:
 		default:
 			{
@@ -134,90 +260,313 @@ void handle_ipc_request(int fd_sock) {
 				break;
 			}
 	}
+}
+
+void handle_ipc_response(void) {
+	if (!ipc_response) {
+		return;
+	}
+
+	ipc_response_send(ipc_response);
+
+	if (ipc_response->done) {
+		ipc_finish(ipc_active);
+	} else {
+		ipc_watch_output(ipc_active);
+	}
+}
+
+// whether the active client has anything new: completion, messages or a changed STATE
+bool ipc_response_pending(void) {
+	if (ipc_response->done || log_cap_line(log_cap, 0)) {
+		return true;
+	}
 
-send:
-	free_ipc_request(ipc_request);
+	state_revise();
 
-	handle_ipc_response();
+	return ipc_response->status && state_revision != ipc_response->since;
+}
+
+// GET and bad requests don't change anything; respond right away
+void ipc_respond_immediately(struct IpcConnection *connection) {
+	capture_begin(connection);
+
+	struct IpcResponse *response = ipc_response_create(connection);
+
+	handle_ipc_request(connection->request, response);
+
+	response->done = true;
+	ipc_response_send(response);
+
+	free_ipc_response(response);
+
+	log_capture_clear();
+
+	capture_end(connection);
+
+	ipc_finish(connection);
+}
+
+// subscribers send nothing further; discard anything and notice when they go away
+void handle_ipc_subscriber(int fd, void *data) {
+	struct IpcConnection *connection = data;
+
+	connection->len = 0;
+	if (socket_read_nonblock(fd, &connection->buf, &connection->len, SUBSCRIBER_READ_MAX, &connection->eof) == -1 || connection->eof) {
+		ipc_close(connection);
+	}
+}
+
+// send the full state then keep the connection for events
+void ipc_subscribe(struct IpcConnection *connection) {
+	capture_begin(connection);
+
+	struct IpcResponse *response = ipc_response_create(connection);
+
+	handle_ipc_request(connection->request, response);
+
+	ipc_response_send(response);
+	bool failed = response->done;
+	connection->request->since = response->since;
+
+	free_ipc_response(response);
+
+	log_capture_clear();
+
+	capture_end(connection);
+
+	if (failed) {
+		ipc_close(connection);
+		return;
+	}
+
+	connection->state = IPC_SUBSCRIBED;
+	slist_append(&ipc_subscribers, connection);
+	fds_register(connection->fd, handle_ipc_subscriber, connection);
+	ipc_watch_output(connection);
+}
+
+// push the events and the affected CFG and STATE to each subscriber
+void ipc_notify(unsigned int events) {
+	if (!events) {
+		return;
+	}
+
+	struct SList *i = ipc_subscribers;
+	while (i) {
+		struct IpcConnection *connection = i->val;
+		i = i->nex;
+
+		struct IpcResponse *response = ipc_response_create(connection);
+		response->done = false;
+		response->messages = false;
+		response->events = events;
+
+		ipc_response_send(response);
+
+		// send failed
+		if (response->done) {
+			ipc_close(connection);
+		} else {
+			connection->request->since = response->since;
+			ipc_watch_output(connection);
+		}
+
+		free_ipc_response(response);
+	}
+}
+
+// start queued requests in order until one remains in progress, true if any started
+bool ipc_queue_next(void) {
+	bool started = false;
+
+	while (!ipc_active && ipc_queue.first) {
+		struct IpcConnection *connection = ipc_queue.first->val;
+		slist_header_remove_all(&ipc_queue, NULL, connection);
+
+		// messages captured while queued lead the response
+		log_capture_clear();
+		capture_swap(connection);
+		log_capture_start();
+
+		connection->state = IPC_ACTIVE;
+		ipc_active = connection;
+		ipc_response = ipc_response_create(connection);
+
+		handle_ipc_request(connection->request, ipc_response);
+
+		handle_ipc_response();
+
+		started = true;
+	}
+
+	return started;
+}
+
+void handle_ipc_connection(int fd, void *data) {
+	struct IpcConnection *connection = data;
+
+	capture_begin(connection);
+	bool complete = ipc_connection_read(connection);
+	capture_end(connection);
+
+	if (connection->state == IPC_CLOSED) {
+		ipc_close(connection);
+		return;
+	}
+
+	if (!complete) {
+		return;
+	}
+
+	// nothing more to read
+	fds_unregister(connection->fd);
+
+	if (connection->request->bad || connection->request->command == GET) {
+		ipc_respond_immediately(connection);
+	} else if (connection->request->command == SUBSCRIBE) {
+		ipc_subscribe(connection);
+	} else {
+		connection->state = IPC_QUEUED;
+		slist_header_append(&ipc_queue, connection);
+	}
+}
+
+// clients sending a request or taking their final response must keep going
+bool ipc_connection_may_stall(struct IpcConnection *connection) {
+	return connection->state == IPC_READING || connection->state == IPC_CLOSING;
+}
+
+// milliseconds until the first such client stalls, -1 when none
+int ipc_stall_timeout(void) {
+	long timeout = -1;
+
+	for (struct SList *i = ipc_connections; i; i = i->nex) {
+		struct IpcConnection *connection = i->val;
+		if (ipc_connection_may_stall(connection)) {
+			long remaining = ipc_connection_idle_remaining_ms(connection);
+			if (timeout == -1 || remaining < timeout) {
+				timeout = remaining;
+			}
+		}
+	}
+
+	return (int)timeout;
+}
+
+void ipc_close_stalled(void) {
+	struct SList *i = ipc_connections;
+	while (i) {
+		struct IpcConnection *connection = i->val;
+		i = i->nex;
+
+		if (ipc_connection_may_stall(connection) && !ipc_connection_idle_remaining_ms(connection)) {
+			log_warn("\nIPC client stalled, closing");
+			ipc_close(connection);
+		}
+	}
+}
+
+void handle_ipc_accept(int fd_sock, void *data) {
+	struct IpcConnection *connection;
+	while ((connection = ipc_connection_accept(fd_sock))) {
+		slist_append(&ipc_connections, connection);
+		fds_register(connection->fd, handle_ipc_connection, connection);
+	}
 }
 
 // see Wayland Protocol docs Appendix B wl_display_prepare_read_queue
 int loop(void) {
 
+	// always layout on the first pass
+	bool changed = true;
+
 	for (;;) {
-		init_pfds();
+
+		// inputs that may change the layout
+		int dispatched = 0;
+		unsigned long cfg_generation = cfg->generation;
+		unsigned long lid_generation = lid ? lid->generation : 0;
+		unsigned long heads_gen = heads_generation;
 
 
 		// prepare for reading wayland events
 		while (_wl_display_prepare_read(displ->display, FL) != 0) {
-			_wl_display_dispatch_pending(displ->display, FL);
+			dispatched += _wl_display_dispatch_pending(displ->display, FL);
 		}
 		_wl_display_flush(displ->display, FL);
 
 
-		// poll for all events
-		if (poll(pfds, npfds, -1) < 0) {
-			log_error_errno("\npoll failed, exiting");
+		// wait for any registered fd or a stalled client, or just check when a queued request can start
+		if (fds_wait(!ipc_active && ipc_queue.first ? 0 : ipc_stall_timeout()) < 0) {
+			log_error_errno("\nepoll_wait failed, exiting");
 			exit_fail();
 		}
 
 
 		// always read and dispatch wayland events; stop the file descriptor from getting stale
 		_wl_display_read_events(displ->display, FL);
-		_wl_display_dispatch_pending(displ->display, FL);
+		dispatched += _wl_display_dispatch_pending(displ->display, FL);
 		if (!displ->output_manager) {
 			log_info("\nDisplay's output manager has departed, exiting");
 			exit(EXIT_SUCCESS);
 		}
 
 
-		// subscribed signals are mostly a clean exit
-		if (pfd_signal && pfd_signal->revents & pfd_signal->events) {
-			struct signalfd_siginfo fdsi;
-			if (read(fd_signal, &fdsi, sizeof(fdsi)) == sizeof(fdsi)) {
-				if (fdsi.ssi_signo != SIGPIPE) {
-					return fdsi.ssi_signo;
-				}
-			}
+		// signals, cfg dir, lid, ipc
+		fds_dispatch();
+		if (signalled) {
+			return signalled;
 		}
+		ipc_close_stalled();
 
 
-		// cfg directory change
-		if (pfd_cfg_dir && pfd_cfg_dir->revents & pfd_cfg_dir->events) {
-			if (cfg_file_modified(cfg->file_name)) {
-				if (cfg->written) {
-					cfg->written = false;
-				} else {
-					cfg_file_reload();
-				}
-			}
-		}
+		// maybe start the next queued ipc request
+		changed |= ipc_queue_next();
 
 
-		// libinput lid event
-		if (pfd_lid && pfd_lid->revents & pfd_lid->events) {
-			lid_update();
+		// maybe make some changes, only when something relevant happened
+		changed |= dispatched > 0;
+		changed |= cfg->generation != cfg_generation;
+		changed |= (lid ? lid->generation : 0) != lid_generation;
+		enum ConfigState config_state = displ->config_state;
+		if (changed) {
+			layout();
+			changed = false;
 		}
 
 
-		// ipc client message
-		if (pfd_ipc && (pfd_ipc->revents & pfd_ipc->events)) {
-			handle_ipc_request(fd_ipc);
+		// tell subscribers what happened
+		unsigned int events = 0;
+		if (heads_generation != heads_gen) {
+			events |= IPC_EVENT_BIT(IPC_EVENT_HEADS);
 		}
-
-
-		// maybe make some changes
-		layout();
+		if ((lid ? lid->generation : 0) != lid_generation) {
+			events |= IPC_EVENT_BIT(IPC_EVENT_LID);
+		}
+		if (cfg->generation != cfg_generation) {
+			events |= IPC_EVENT_BIT(IPC_EVENT_CFG);
+		}
+		if (config_state != displ->config_state && config_state == SUCCEEDED) {
+			events |= IPC_EVENT_BIT(IPC_EVENT_SUCCEEDED);
+		}
+		if (config_state != displ->config_state && config_state == FAILED) {
+			events |= IPC_EVENT_BIT(IPC_EVENT_FAILED);
+		}
+		ipc_notify(events);
 
 
 		// inform the client
 		if (ipc_response) {
-			ipc_response->done = displ->config_state == IDLE;
-			handle_ipc_response();
+			ipc_response->done = layout_idle();
+			if (ipc_response_pending()) {
+				handle_ipc_response();
+			}
 		};
 
 
-		destroy_pfds();
+		// never block on a slow log reader
+		flush_logs();
 	}
 }
 
@@ -225,6 +574,9 @@ int
 server(void) {
 	log_set_times(true);
 
+	// logs are written by the loop
+	log_sink_start();
+
 	// only one instance
 	pid_file_create();
 
@@ -239,6 +591,7 @@ server(void) {
 
 	// play back captured logs from cfg parse
 	log_set_threshold(cfg->log_threshold, false);
+	log_set_format(cfg->log_format, false);
 	log_suppress_stop();
 	log_capture_stop();
 	log_capture_playback();
@@ -248,17 +601,46 @@ server(void) {
 	lid_init();
 	lid_update();
 
+	// modes that failed previously
+	mode_validations_load();
+
+	// layouts converged previously
+	cache_layouts_load();
+
 	// discover the output manager; it will call back
 	displ_init();
 
+	// event sources; wayland is read by the loop itself
+	fds_init();
+	fds_register(wl_display_get_fd(displ->display), NULL, NULL);
+	fds_register(fd_signal, handle_signal, NULL);
+	fds_register(fd_ipc, handle_ipc_accept, NULL);
+	fds_register(fd_cfg_dir, handle_cfg_dir, NULL);
+	if (lid) {
+		fds_register(lid->libinput_fd, handle_lid, NULL);
+	}
+
 	// only stops when signalled or display goes away
 	int sig = loop();
 
 	// release what remote resources we can
+	free_ipc_response(ipc_response);
+	slist_header_free(&ipc_queue);
+	slist_free(&ipc_subscribers);
+	for (struct SList *i = ipc_connections; i; i = i->nex) {
+		close(((struct IpcConnection*)i->val)->fd);
+	}
+	slist_free_vals(&ipc_connections, free_ipc_connection);
+	free_log_cap(log_cap);
+	log_cap = NULL;
 	heads_destroy();
+	mode_validations_destroy();
+	cache_layouts_destroy();
 	lid_destroy();
 	cfg_destroy();
 	displ_destroy();
+	fds_destroy();
+	pool_destroy();
 
 	return sig;
 }
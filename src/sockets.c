@@ -1,9 +1,10 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/un.h>
@@ -11,7 +12,6 @@
 
 #include "log.h"
 
-#define SERVER_TIMEOUT_SEC 2
 #define CLIENT_TIMEOUT_SEC 10
 
 bool set_socket_timeout(int fd, struct timeval timeout) {
@@ -24,68 +24,135 @@ bool set_socket_timeout(int fd, struct timeval timeout) {
 	return true;
 }
 
+// reads block until data arrives
+bool set_socket_no_timeout(int fd) {
+	struct timeval timeout = { .tv_sec = 0, .tv_usec = 0, };
+	return set_socket_timeout(fd, timeout);
+}
+
+bool set_socket_nonblock(int fd) {
+
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		log_error_errno("\nSocket set non-blocking failed");
+		return false;
+	}
+
+	return true;
+}
+
 int socket_accept(int fd_sock) {
 
 	int fd = accept(fd_sock, NULL, NULL);
 	if (fd == -1) {
-		log_error_errno("\nSocket accept failed");
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			log_error_errno("\nSocket accept failed");
+		}
 		return -1;
 	}
 
-	struct timeval timeout = { .tv_sec = SERVER_TIMEOUT_SEC, .tv_usec = 0, };
-	if (!set_socket_timeout(fd, timeout)) {
+	if (!set_socket_nonblock(fd)) {
+		close(fd);
 		return -1;
 	}
 
 	return fd;
 }
 
-char *socket_read(int fd) {
+// append what is currently available until len reaches max, NUL terminated; eof set when the peer has closed
+ssize_t socket_read_nonblock(int fd, char **buf, size_t *len, size_t max, bool *eof) {
+	char chunk[4096];
+	ssize_t total = 0;
+	ssize_t n;
+
+	*eof = false;
+
+	while (*len < max) {
+		n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			log_error_errno("\nSocket recv failed");
+			return -1;
+		}
+		if (n == 0) {
+			*eof = true;
+			break;
+		}
+
+		*buf = realloc(*buf, *len + n + 1);
+		memcpy(*buf + *len, chunk, n);
+		*len += n;
+		(*buf)[*len] = '\0';
+		total += n;
+	}
+
+	log_debug_nocap("\nRead %zd bytes from socket", total);
+
+	return total;
+}
+
+// as socket_read_nonblock, first waiting for the socket timeout if nothing is available
+ssize_t socket_read_wait(int fd, char **buf, size_t *len, bool *eof) {
 
-	// peek, as the sender may experience delay between connecting and sending
 	if (recv(fd, NULL, 0, MSG_PEEK) == -1) {
-		if (errno == EAGAIN) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
 			log_error("\nSocket read timeout");
 		} else {
 			log_error_errno("\nSocket recv failed");
 		}
-		return NULL;
+		return -1;
 	}
 
-	// total message size right now; further data will be disregarded
-	int n = 0;
-	if (ioctl(fd, FIONREAD, &n) == -1) {
-		log_error_errno("\nServer FIONREAD failed");
-		return NULL;
-	}
-	if (n == 0) {
-		log_error("\nSocket no data");
-		return NULL;
-	}
+	return socket_read_nonblock(fd, buf, len, SIZE_MAX, eof);
+}
 
-	// read it
-	char *buf = calloc(n + 1, sizeof(char));
-	if (recv(fd, buf, n, 0) == -1) {
-		log_error_errno("\nSocket recv failed");
-		return NULL;
+ssize_t socket_write(int fd, char *data, size_t len) {
+
+	size_t written = 0;
+	ssize_t n;
+	while (written < len) {
+		if ((n = write(fd, data + written, len - written)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_error_errno("\nSocket write failed");
+			return -1;
+		}
+		written += n;
 	}
 
-	log_debug_nocap("\nRead %d bytes from socket", n);
+	log_debug_nocap("\nWrote %zu bytes to socket", written);
 
-	return buf;
+	return written;
 }
 
-ssize_t socket_write(int fd, char *data, size_t len) {
+// write what the socket will take right now; returns the number written, possibly 0, or -1
+ssize_t socket_write_nonblock(int fd, const char *data, size_t len) {
 
+	size_t written = 0;
 	ssize_t n;
-	if ((n = write(fd, data, len)) == -1) {
-		log_error_errno("\nSocket write failed");
-		return -1;
+	while (written < len) {
+		if ((n = send(fd, data + written, len - written, MSG_DONTWAIT | MSG_NOSIGNAL)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			log_error_errno("\nSocket write failed");
+			return -1;
+		}
+		written += n;
 	}
 
-	log_debug_nocap("\nWrote %d bytes to socket", n);
+	log_debug_nocap("\nWrote %zu of %zu bytes to socket", written, len);
 
-	return n;
+	return written;
 }
 
 void socket_path(struct sockaddr_un *addr) {
@@ -129,8 +196,7 @@ int create_fd_ipc_server(void) {
 		return -1;
 	}
 
-	struct timeval timeout = { .tv_sec = SERVER_TIMEOUT_SEC, .tv_usec = 0, };
-	if (!set_socket_timeout(fd, timeout)) {
+	if (!set_socket_nonblock(fd)) {
 		close(fd);
 		return -1;
 	}
@@ -0,0 +1,955 @@
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlv.h"
+
+#include "cfg.h"
+#include "convert.h"
+#include "head.h"
+#include "info.h"
+#include "ipc.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+
+struct TlvBuf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+struct TlvReader {
+	const char *pos;
+	const char *end;
+	bool bad;
+};
+
+struct Tlv {
+	enum TlvType type;
+	uint32_t len;
+	const char *val;
+};
+
+//
+// writing
+//
+
+void put_raw(struct TlvBuf *buf, const void *val, size_t len) {
+	if (buf->len + len > buf->size) {
+		while (buf->len + len > buf->size) {
+			buf->size = buf->size ? buf->size * 2 : 256;
+		}
+		buf->data = realloc(buf->data, buf->size);
+	}
+
+	memcpy(buf->data + buf->len, val, len);
+	buf->len += len;
+}
+
+size_t put_header(struct TlvBuf *buf, enum TlvType type, uint32_t len) {
+	size_t at = buf->len;
+
+	uint16_t type_n = htons(type);
+	uint32_t len_n = htonl(len);
+
+	put_raw(buf, &type_n, sizeof(type_n));
+	put_raw(buf, &len_n, sizeof(len_n));
+
+	return at;
+}
+
+void put(struct TlvBuf *buf, enum TlvType type, const void *val, uint32_t len) {
+	put_header(buf, type, len);
+	put_raw(buf, val, len);
+}
+
+void put_u8(struct TlvBuf *buf, enum TlvType type, uint8_t val) {
+	put(buf, type, &val, sizeof(val));
+}
+
+void put_u32(struct TlvBuf *buf, enum TlvType type, uint32_t val) {
+	uint32_t val_n = htonl(val);
+	put(buf, type, &val_n, sizeof(val_n));
+}
+
+void put_u64(struct TlvBuf *buf, enum TlvType type, uint64_t val) {
+	uint32_t val_n[2] = { htonl(val >> 32), htonl(val & UINT32_MAX), };
+	put(buf, type, val_n, sizeof(val_n));
+}
+
+void put_i32(struct TlvBuf *buf, enum TlvType type, int32_t val) {
+	put_u32(buf, type, (uint32_t)val);
+}
+
+void put_float(struct TlvBuf *buf, enum TlvType type, float val) {
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	put_u32(buf, type, bits);
+}
+
+void put_str(struct TlvBuf *buf, enum TlvType type, const char *val) {
+	if (val) {
+		put(buf, type, val, strlen(val));
+	}
+}
+
+// start a container, returning its position for end()
+size_t begin(struct TlvBuf *buf, enum TlvType type) {
+	return put_header(buf, type, 0);
+}
+
+void end(struct TlvBuf *buf, size_t at) {
+	uint32_t len_n = htonl(buf->len - at - TLV_HEADER_SIZE);
+	memcpy(buf->data + at + sizeof(uint16_t), &len_n, sizeof(len_n));
+}
+
+//
+// reading
+//
+
+struct TlvReader reader(const char *buf, size_t len) {
+	struct TlvReader r = { .pos = buf, .end = buf + len, .bad = false, };
+	return r;
+}
+
+struct TlvReader reader_container(const struct Tlv *tlv) {
+	return reader(tlv->val, tlv->len);
+}
+
+// false at the end or when truncated, the latter marking the reader bad
+bool next(struct TlvReader *r, struct Tlv *tlv) {
+	if (r->bad || r->pos == r->end) {
+		return false;
+	}
+
+	uint16_t type_n;
+	uint32_t len_n;
+
+	if ((size_t)(r->end - r->pos) < TLV_HEADER_SIZE) {
+		r->bad = true;
+		return false;
+	}
+
+	memcpy(&type_n, r->pos, sizeof(type_n));
+	memcpy(&len_n, r->pos + sizeof(type_n), sizeof(len_n));
+
+	tlv->type = ntohs(type_n);
+	tlv->len = ntohl(len_n);
+	tlv->val = r->pos + TLV_HEADER_SIZE;
+
+	if ((size_t)(r->end - tlv->val) < tlv->len) {
+		r->bad = true;
+		return false;
+	}
+
+	r->pos = tlv->val + tlv->len;
+
+	return true;
+}
+
+uint8_t get_u8(const struct Tlv *tlv) {
+	return tlv->len == sizeof(uint8_t) ? (uint8_t)tlv->val[0] : 0;
+}
+
+uint32_t get_u32(const struct Tlv *tlv) {
+	uint32_t val_n = 0;
+	if (tlv->len == sizeof(val_n)) {
+		memcpy(&val_n, tlv->val, sizeof(val_n));
+	}
+	return ntohl(val_n);
+}
+
+uint64_t get_u64(const struct Tlv *tlv) {
+	uint32_t val_n[2] = { 0, 0, };
+	if (tlv->len == sizeof(val_n)) {
+		memcpy(val_n, tlv->val, sizeof(val_n));
+	}
+	return (uint64_t)ntohl(val_n[0]) << 32 | ntohl(val_n[1]);
+}
+
+int32_t get_i32(const struct Tlv *tlv) {
+	return (int32_t)get_u32(tlv);
+}
+
+float get_float(const struct Tlv *tlv) {
+	float val;
+	uint32_t bits = get_u32(tlv);
+	memcpy(&val, &bits, sizeof(val));
+	return val;
+}
+
+char *get_str(const struct Tlv *tlv) {
+	return strndup(tlv->val, tlv->len);
+}
+
+// the version must lead and be one we understand
+bool read_version(struct TlvReader *r, const char *desc) {
+	struct Tlv tlv;
+
+	if (!next(r, &tlv) || tlv.type != TLV_VERSION) {
+		log_error("\nunmarshalling binary %s: missing version", desc);
+		return false;
+	}
+	if (get_u8(&tlv) > TLV_FORMAT_VERSION) {
+		log_error("\nunmarshalling binary %s: unsupported version %d", desc, get_u8(&tlv));
+		return false;
+	}
+
+	return true;
+}
+
+//
+// CFG
+//
+
+void put_cfg(struct TlvBuf *buf, struct Cfg *cfg) {
+	size_t at = begin(buf, TLV_CFG);
+	struct SList *i;
+
+	if (cfg->arrange) {
+		put_u8(buf, TLV_ARRANGE, cfg->arrange);
+	}
+
+	if (cfg->align) {
+		put_u8(buf, TLV_ALIGN, cfg->align);
+	}
+
+	for (i = cfg->order_name_desc; i; i = i->nex) {
+		put_str(buf, TLV_ORDER, i->val);
+	}
+
+	if (cfg->auto_scale) {
+		put_u8(buf, TLV_AUTO_SCALE, cfg->auto_scale);
+	}
+
+	for (i = cfg->user_scales; i; i = i->nex) {
+		struct UserScale *user_scale = i->val;
+		size_t at_scale = begin(buf, TLV_SCALE);
+		put_str(buf, TLV_NAME_DESC, user_scale->name_desc);
+		put_float(buf, TLV_SCALE, user_scale->scale);
+		end(buf, at_scale);
+	}
+
+	for (i = cfg->user_modes; i; i = i->nex) {
+		struct UserMode *user_mode = i->val;
+		size_t at_mode = begin(buf, TLV_MODE);
+		put_str(buf, TLV_NAME_DESC, user_mode->name_desc);
+		if (user_mode->max) {
+			put_u8(buf, TLV_MAX, true);
+		} else {
+			put_i32(buf, TLV_WIDTH, user_mode->width);
+			put_i32(buf, TLV_HEIGHT, user_mode->height);
+			if (user_mode->refresh_hz != -1) {
+				put_i32(buf, TLV_HZ, user_mode->refresh_hz);
+			}
+		}
+		end(buf, at_mode);
+	}
+
+	for (i = cfg->user_transform; i; i = i->nex) {
+		struct UserTransform *user_transform = i->val;
+		size_t at_transform = begin(buf, TLV_TRANSFORM);
+		put_str(buf, TLV_NAME_DESC, user_transform->name_desc);
+		put_i32(buf, TLV_DEGREE, user_transform->transform);
+		end(buf, at_transform);
+	}
+
+	put_str(buf, TLV_LAPTOP_DISPLAY_PREFIX, cfg->laptop_display_prefix);
+
+	for (i = cfg->max_preferred_refresh_name_desc; i; i = i->nex) {
+		put_str(buf, TLV_MAX_PREFERRED_REFRESH, i->val);
+	}
+
+	for (i = cfg->disabled_name_desc; i; i = i->nex) {
+		put_str(buf, TLV_DISABLED, i->val);
+	}
+
+	if (cfg->log_threshold) {
+		put_u8(buf, TLV_LOG_THRESHOLD, cfg->log_threshold);
+	}
+
+	if (cfg->log_format) {
+		put_u8(buf, TLV_LOG_FORMAT, cfg->log_format);
+	}
+
+	end(buf, at);
+}
+
+void parse_name_desc(struct SList **list, const struct Tlv *tlv) {
+	char *name_desc = get_str(tlv);
+	if (slist_find_equal(*list, slist_equal_strcasecmp, name_desc)) {
+		free(name_desc);
+	} else {
+		slist_append(list, name_desc);
+	}
+}
+
+void parse_user_scale(struct Cfg *cfg, const struct Tlv *container) {
+	struct UserScale *user_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
+	bool has_scale = false;
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_NAME_DESC:
+				free(user_scale->name_desc);
+				user_scale->name_desc = get_str(&tlv);
+				break;
+			case TLV_SCALE:
+				user_scale->scale = get_float(&tlv);
+				has_scale = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!user_scale->name_desc || !has_scale) {
+		log_warn("Ignoring incomplete SCALE %s", user_scale->name_desc ? user_scale->name_desc : "");
+		cfg_user_scale_free(user_scale);
+		return;
+	}
+
+	slist_remove_all_free(&cfg->user_scales, cfg_equal_user_scale_name, user_scale, cfg_user_scale_free);
+	slist_append(&cfg->user_scales, user_scale);
+}
+
+void parse_user_mode(struct Cfg *cfg, const struct Tlv *container) {
+	struct UserMode *user_mode = cfg_user_mode_default();
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_NAME_DESC:
+				free(user_mode->name_desc);
+				user_mode->name_desc = get_str(&tlv);
+				break;
+			case TLV_MAX:
+				user_mode->max = get_u8(&tlv);
+				break;
+			case TLV_WIDTH:
+				user_mode->width = get_i32(&tlv);
+				break;
+			case TLV_HEIGHT:
+				user_mode->height = get_i32(&tlv);
+				break;
+			case TLV_HZ:
+				user_mode->refresh_hz = get_i32(&tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!user_mode->name_desc) {
+		log_warn("Ignoring missing MODE NAME_DESC");
+		cfg_user_mode_free(user_mode);
+		return;
+	}
+
+	slist_remove_all_free(&cfg->user_modes, cfg_equal_user_mode_name, user_mode, cfg_user_mode_free);
+	slist_append(&cfg->user_modes, user_mode);
+}
+
+void parse_user_transform(struct Cfg *cfg, const struct Tlv *container) {
+	struct UserTransform *user_transform = cfg_user_transform_default();
+	bool has_degree = false;
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_NAME_DESC:
+				free(user_transform->name_desc);
+				user_transform->name_desc = get_str(&tlv);
+				break;
+			case TLV_DEGREE:
+				user_transform->transform = get_i32(&tlv);
+				has_degree = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!user_transform->name_desc || !has_degree) {
+		log_warn("Ignoring incomplete TRANSFORM %s", user_transform->name_desc ? user_transform->name_desc : "");
+		cfg_user_transform_free(user_transform);
+		return;
+	}
+
+	slist_remove_all_free(&cfg->user_transform, cfg_equal_user_transform_name, user_transform, cfg_user_transform_free);
+	slist_append(&cfg->user_transform, user_transform);
+}
+
+// as cfg_parse_node
+bool parse_cfg(struct Cfg *cfg, const struct Tlv *container) {
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_ARRANGE:
+				cfg->arrange = get_u8(&tlv);
+				if (!arrange_name(cfg->arrange)) {
+					log_warn("Ignoring invalid ARRANGE %d, using default %s", cfg->arrange, arrange_name(ARRANGE_DEFAULT));
+					cfg->arrange = ARRANGE_DEFAULT;
+				}
+				break;
+			case TLV_ALIGN:
+				cfg->align = get_u8(&tlv);
+				if (!align_name(cfg->align)) {
+					log_warn("Ignoring invalid ALIGN %d, using default %s", cfg->align, align_name(ALIGN_DEFAULT));
+					cfg->align = ALIGN_DEFAULT;
+				}
+				break;
+			case TLV_ORDER:
+				parse_name_desc(&cfg->order_name_desc, &tlv);
+				break;
+			case TLV_AUTO_SCALE:
+				cfg->auto_scale = get_u8(&tlv) == ON ? ON : OFF;
+				break;
+			case TLV_SCALE:
+				parse_user_scale(cfg, &tlv);
+				break;
+			case TLV_MODE:
+				parse_user_mode(cfg, &tlv);
+				break;
+			case TLV_TRANSFORM:
+				parse_user_transform(cfg, &tlv);
+				break;
+			case TLV_LAPTOP_DISPLAY_PREFIX:
+				free(cfg->laptop_display_prefix);
+				cfg->laptop_display_prefix = get_str(&tlv);
+				break;
+			case TLV_MAX_PREFERRED_REFRESH:
+				parse_name_desc(&cfg->max_preferred_refresh_name_desc, &tlv);
+				break;
+			case TLV_DISABLED:
+				parse_name_desc(&cfg->disabled_name_desc, &tlv);
+				break;
+			case TLV_LOG_THRESHOLD:
+				cfg->log_threshold = get_u8(&tlv);
+				if (!log_threshold_name(cfg->log_threshold)) {
+					log_warn("Ignoring invalid LOG_THRESHOLD %d, using default %s", cfg->log_threshold, log_threshold_name(LOG_THRESHOLD_DEFAULT));
+					cfg->log_threshold = 0;
+				}
+				break;
+			case TLV_LOG_FORMAT:
+				cfg->log_format = get_u8(&tlv);
+				if (!log_format_name(cfg->log_format)) {
+					log_warn("Ignoring invalid LOG_FORMAT %d, using default %s", cfg->log_format, log_format_name(LOG_FORMAT_DEFAULT));
+					cfg->log_format = 0;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+//
+// STATE
+//
+
+void put_head_state(struct TlvBuf *buf, enum TlvType type, struct HeadState *head_state) {
+	size_t at = begin(buf, type);
+
+	put_i32(buf, TLV_SCALE, head_state->scale);
+	put_u8(buf, TLV_ENABLED, head_state->enabled);
+	put_i32(buf, TLV_X, head_state->x);
+	put_i32(buf, TLV_Y, head_state->y);
+
+	end(buf, at);
+}
+
+void put_head(struct TlvBuf *buf, struct Head *head) {
+	size_t at = begin(buf, TLV_HEAD);
+
+	put_str(buf, TLV_NAME, head->name);
+	put_str(buf, TLV_DESCRIPTION, head->description);
+	put_i32(buf, TLV_WIDTH_MM, head->width_mm);
+	put_i32(buf, TLV_HEIGHT_MM, head->height_mm);
+	put_str(buf, TLV_MAKE, head->make);
+	put_str(buf, TLV_MODEL, head->model);
+	put_str(buf, TLV_SERIAL_NUMBER, head->serial_number);
+
+	put_head_state(buf, TLV_CURRENT, &head->current);
+	put_head_state(buf, TLV_DESIRED, &head->desired);
+
+	for (struct SList *i = head->modes.first; i; i = i->nex) {
+		struct Mode *mode = i->val;
+		size_t at_mode = begin(buf, TLV_MODE);
+		put_i32(buf, TLV_WIDTH, mode->width);
+		put_i32(buf, TLV_HEIGHT, mode->height);
+		put_i32(buf, TLV_REFRESH_MHZ, mode->refresh_mhz);
+		put_u8(buf, TLV_PREFERRED, mode->preferred);
+		put_u8(buf, TLV_CURRENT, head->current.mode == mode);
+		end(buf, at_mode);
+	}
+
+	end(buf, at);
+}
+
+// marshalled once per head revision, see state_revise
+void put_head_serialized(struct TlvBuf *buf, struct Head *head) {
+	if (!head->serialized.tlv) {
+		struct TlvBuf own = { 0 };
+		put_head(&own, head);
+		head->serialized.tlv = own.data;
+		head->serialized.tlv_len = own.len;
+	}
+	put_raw(buf, head->serialized.tlv, head->serialized.tlv_len);
+}
+
+// the active cfg marshalled once per instance
+static struct {
+	unsigned long instance;
+	struct TlvBuf buf;
+} cfg_serialized = { 0 };
+
+void put_cfg_serialized(struct TlvBuf *buf, struct Cfg *cfg) {
+	if (!cfg->instance || cfg->instance != cfg_serialized.instance || !cfg_serialized.buf.len) {
+		cfg_serialized.buf.len = 0;
+		put_cfg(&cfg_serialized.buf, cfg);
+		cfg_serialized.instance = cfg->instance;
+	}
+	put_raw(buf, cfg_serialized.buf.data, cfg_serialized.buf.len);
+}
+
+void put_state(struct TlvBuf *buf, struct IpcResponse *response) {
+	size_t at = begin(buf, TLV_STATE);
+
+	put_u64(buf, TLV_REVISION, state_revision);
+	if (response->delta) {
+		put_u8(buf, TLV_DELTA, ipc_response_state_delta(response));
+	}
+
+	if (lid && ipc_response_state_includes(response, state_revision_lid)) {
+		size_t at_lid = begin(buf, TLV_LID);
+		put_u8(buf, TLV_CLOSED, lid->closed);
+		put_str(buf, TLV_DEVICE_PATH, lid->device_path);
+		end(buf, at_lid);
+	}
+
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+		if (ipc_response_state_includes(response, head->revision)) {
+			put_head_serialized(buf, head);
+		}
+	}
+
+	for (int t = POOL_SLIST; t <= POOL_HEAD; t++) {
+		struct PoolStats stats = pool_stats((enum PoolType)t);
+		size_t at_pool = begin(buf, TLV_POOL);
+		put_str(buf, TLV_NAME, pool_type_name((enum PoolType)t));
+		put_u32(buf, TLV_LIVE, stats.live);
+		put_u32(buf, TLV_HIGH_WATER, stats.high_water);
+		put_u32(buf, TLV_CAPACITY, stats.capacity);
+		end(buf, at_pool);
+	}
+
+	end(buf, at);
+}
+
+bool parse_head_state(struct HeadState *head_state, const struct Tlv *container) {
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_SCALE:
+				head_state->scale = get_i32(&tlv);
+				break;
+			case TLV_ENABLED:
+				head_state->enabled = get_u8(&tlv);
+				break;
+			case TLV_X:
+				head_state->x = get_i32(&tlv);
+				break;
+			case TLV_Y:
+				head_state->y = get_i32(&tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+bool parse_mode(struct Head *head, const struct Tlv *container) {
+	struct Mode *mode = pool_alloc(POOL_MODE);
+	mode->head = head;
+	slist_header_append(&head->modes, mode);
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_WIDTH:
+				mode->width = get_i32(&tlv);
+				break;
+			case TLV_HEIGHT:
+				mode->height = get_i32(&tlv);
+				break;
+			case TLV_REFRESH_MHZ:
+				mode->refresh_mhz = get_i32(&tlv);
+				break;
+			case TLV_PREFERRED:
+				mode->preferred = get_u8(&tlv);
+				if (mode->preferred) {
+					head->preferred_mode = mode;
+				}
+				break;
+			case TLV_CURRENT:
+				if (get_u8(&tlv)) {
+					head->current.mode = mode;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+// as put_head, the modes' zwlr objects absent
+bool parse_head(struct SList **heads, const struct Tlv *container) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+	slist_append(heads, head);
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_NAME:
+				free(head->name);
+				head->name = get_str(&tlv);
+				break;
+			case TLV_DESCRIPTION:
+				free(head->description);
+				head->description = get_str(&tlv);
+				break;
+			case TLV_WIDTH_MM:
+				head->width_mm = get_i32(&tlv);
+				break;
+			case TLV_HEIGHT_MM:
+				head->height_mm = get_i32(&tlv);
+				break;
+			case TLV_MAKE:
+				free(head->make);
+				head->make = get_str(&tlv);
+				break;
+			case TLV_MODEL:
+				free(head->model);
+				head->model = get_str(&tlv);
+				break;
+			case TLV_SERIAL_NUMBER:
+				free(head->serial_number);
+				head->serial_number = get_str(&tlv);
+				break;
+			case TLV_CURRENT:
+				r.bad |= !parse_head_state(&head->current, &tlv);
+				break;
+			case TLV_DESIRED:
+				r.bad |= !parse_head_state(&head->desired, &tlv);
+				break;
+			case TLV_MODE:
+				r.bad |= !parse_mode(head, &tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+bool parse_lid(struct IpcResponse *response, const struct Tlv *container) {
+	if (!response->lid) {
+		response->lid = (struct Lid*)calloc(1, sizeof(struct Lid));
+	}
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_CLOSED:
+				response->lid->closed = get_u8(&tlv);
+				break;
+			case TLV_DEVICE_PATH:
+				free(response->lid->device_path);
+				response->lid->device_path = get_str(&tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+// as put_state, less the POOL diagnostics
+bool parse_state(struct IpcResponse *response, const struct Tlv *container) {
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_REVISION:
+				response->revision = get_u64(&tlv);
+				break;
+			case TLV_DELTA:
+				response->delta = get_u8(&tlv);
+				break;
+			case TLV_LID:
+				r.bad |= !parse_lid(response, &tlv);
+				break;
+			case TLV_HEAD:
+				r.bad |= !parse_head(&response->heads, &tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return !r.bad;
+}
+
+//
+// IPC
+//
+
+char *tlv_marshal_ipc_request(struct IpcRequest *request, size_t *len) {
+	if (!request || !len) {
+		return NULL;
+	}
+
+	struct TlvBuf buf = { 0 };
+
+	put_u8(&buf, TLV_VERSION, TLV_FORMAT_VERSION);
+	put_u8(&buf, TLV_OP, request->command);
+
+	if (request->delta) {
+		put_u64(&buf, TLV_SINCE, request->since);
+	}
+
+	if (request->cfg) {
+		put_cfg(&buf, request->cfg);
+	}
+
+	*len = buf.len;
+
+	return buf.data;
+}
+
+struct IpcRequest *tlv_unmarshal_ipc_request(const char *data, size_t len) {
+	if (!data) {
+		return NULL;
+	}
+
+	struct IpcRequest *request = (struct IpcRequest*)calloc(1, sizeof(struct IpcRequest));
+
+	struct TlvReader r = reader(data, len);
+	struct Tlv tlv;
+
+	if (!read_version(&r, "ipc request")) {
+		goto bad;
+	}
+
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_OP:
+				request->command = get_u8(&tlv);
+				if (!ipc_request_command_name(request->command)) {
+					log_error("\nunmarshalling binary ipc request: invalid OP %d", request->command);
+					goto bad;
+				}
+				break;
+			case TLV_SINCE:
+				request->delta = true;
+				request->since = get_u64(&tlv);
+				break;
+			case TLV_CFG:
+				cfg_free(request->cfg);
+				request->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+				if (!parse_cfg(request->cfg, &tlv)) {
+					r.bad = true;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (r.bad) {
+		log_error("\nunmarshalling binary ipc request: truncated");
+		goto bad;
+	}
+
+	if (!request->command) {
+		log_error("\nunmarshalling binary ipc request: missing OP");
+		goto bad;
+	}
+
+	return request;
+
+bad:
+	free_ipc_request(request);
+	return NULL;
+}
+
+char *tlv_marshal_ipc_response(struct IpcResponse *response, size_t *len) {
+	if (!response || !len) {
+		return NULL;
+	}
+
+	struct TlvBuf buf = { 0 };
+
+	put_u8(&buf, TLV_VERSION, TLV_FORMAT_VERSION);
+	put_u8(&buf, TLV_DONE, response->done);
+	put_i32(&buf, TLV_RC, response->rc);
+
+	for (int ev = 1; ev <= IPC_EVENT_MAX; ev++) {
+		if (response->events & IPC_EVENT_BIT(ev)) {
+			put_u8(&buf, TLV_EVENT, ev);
+		}
+	}
+
+	if (response->status) {
+		if (cfg && ipc_response_has_cfg(response)) {
+			put_cfg_serialized(&buf, cfg);
+		}
+
+		if ((lid || heads) && ipc_response_has_state(response)) {
+			put_state(&buf, response);
+		}
+	}
+
+	if (response->messages) {
+		const struct LogCapLine *cap_line;
+		for (size_t i = 0; (cap_line = log_cap_line(log_cap, i)); i++) {
+			size_t at = begin(&buf, TLV_MESSAGE);
+			put_u8(&buf, TLV_THRESHOLD, cap_line->threshold);
+			put_str(&buf, TLV_LINE, cap_line->line);
+			end(&buf, at);
+
+			if (cap_line->threshold == WARNING && response->rc < IPC_RC_WARN) {
+				response->rc = IPC_RC_WARN;
+			}
+			if (cap_line->threshold == ERROR && response->rc < IPC_RC_ERROR) {
+				response->rc = IPC_RC_ERROR;
+			}
+		}
+	}
+
+	*len = buf.len;
+
+	return buf.data;
+}
+
+void print_message(const struct Tlv *container) {
+	enum LogThreshold threshold = 0;
+	char *line = NULL;
+
+	struct TlvReader r = reader_container(container);
+	struct Tlv tlv;
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_THRESHOLD:
+				threshold = get_u8(&tlv);
+				break;
+			case TLV_LINE:
+				free(line);
+				line = get_str(&tlv);
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (log_threshold_name(threshold) && line) {
+		log_(threshold, "%s", line);
+	}
+
+	free(line);
+}
+
+struct IpcResponse *tlv_unmarshal_ipc_response(const char *data, size_t len) {
+	if (!data) {
+		return NULL;
+	}
+
+	struct IpcResponse *response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
+	bool has_done = false, has_rc = false;
+
+	struct TlvReader r = reader(data, len);
+	struct Tlv tlv;
+
+	if (!read_version(&r, "ipc response")) {
+		goto bad;
+	}
+
+	while (next(&r, &tlv)) {
+		switch (tlv.type) {
+			case TLV_DONE:
+				response->done = get_u8(&tlv);
+				has_done = true;
+				break;
+			case TLV_RC:
+				response->rc = get_i32(&tlv);
+				has_rc = true;
+				break;
+			case TLV_MESSAGE:
+				print_message(&tlv);
+				break;
+			case TLV_CFG:
+				cfg_free(response->cfg);
+				response->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+				response->status = true;
+				if (!parse_cfg(response->cfg, &tlv)) {
+					r.bad = true;
+				}
+				break;
+			case TLV_STATE:
+				response->status = true;
+				if (!parse_state(response, &tlv)) {
+					r.bad = true;
+				}
+				break;
+			case TLV_EVENT:
+				if (ipc_event_name(get_u8(&tlv))) {
+					response->events |= IPC_EVENT_BIT(get_u8(&tlv));
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (r.bad) {
+		log_error("\nunmarshalling binary ipc response: truncated");
+		goto bad;
+	}
+
+	if (!has_done || !has_rc) {
+		log_error("\nunmarshalling binary ipc response: %s missing", has_done ? "RC" : "DONE");
+		goto bad;
+	}
+
+	return response;
+
+bad:
+	free_ipc_response(response);
+	return NULL;
+}
+
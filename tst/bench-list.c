@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "list.h"
+#include "mode.h"
+#include "pool.h"
+
+// mode.c
+bool greater_than_res_refresh(const void *a, const void *b);
+
+// sorted elements per size, enough to time the smallest
+#define ELEMENTS 1048576
+
+static const unsigned long sizes[] = { 16, 64, 256, 1024, 4096, 16384, };
+
+// deterministic, with duplicates to exercise stability
+struct Mode *modes_random(unsigned long n) {
+	struct Mode *modes = calloc(n, sizeof(struct Mode));
+	uint32_t r = 1;
+
+	for (unsigned long i = 0; i < n; i++) {
+		r = r * 1664525 + 1013904223;
+		modes[i].width = 640 + 160 * (r >> 28);
+		modes[i].height = 480 + 90 * ((r >> 24) & 0xf);
+		modes[i].refresh_mhz = 24000 + 1000 * ((r >> 18) & 0x3f);
+		modes[i].index = i;
+	}
+
+	return modes;
+}
+
+bool sorted_stable(void **vals, unsigned long n) {
+	for (unsigned long i = 1; i < n; i++) {
+		struct Mode *a = vals[i - 1];
+		struct Mode *b = vals[i];
+		if (greater_than_res_refresh(b, a)) {
+			return false;
+		}
+		if (!greater_than_res_refresh(a, b) && a->index > b->index) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool list_sorted_stable(struct SList *head, void **array, unsigned long n) {
+	unsigned long length = 0;
+	for (struct SList *i = head; i && length < n; i = i->nex) {
+		array[length++] = i->val;
+	}
+	return length == n && sorted_stable(array, n);
+}
+
+int main(void) {
+	bool ok = true;
+
+	printf("%8s %16s %16s %16s\n", "modes", "slist_sort us", "in_place us", "array us");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		unsigned long n = sizes[s];
+		unsigned long reps = ELEMENTS / n;
+
+		struct Mode *modes = modes_random(n);
+		struct SList *list = NULL;
+		for (unsigned long i = 0; i < n; i++) {
+			slist_append(&list, &modes[i]);
+		}
+
+		void **array = calloc(n, sizeof(void*));
+
+		// new list
+		double started = bench_us();
+		for (unsigned long r = 0; r < reps; r++) {
+			struct SList *sorted = slist_sort(list, greater_than_res_refresh);
+			if (r == 0) {
+				ok &= list_sorted_stable(sorted, array, n);
+			}
+			slist_free(&sorted);
+		}
+		double sort_us = (bench_us() - started) / reps;
+
+		// relinked, from unsorted clones made up front
+		struct SList **clones = calloc(reps, sizeof(struct SList*));
+		for (unsigned long r = 0; r < reps; r++) {
+			clones[r] = slist_shallow_clone(list);
+		}
+		started = bench_us();
+		for (unsigned long r = 0; r < reps; r++) {
+			slist_sort_in_place(&clones[r], greater_than_res_refresh);
+		}
+		double in_place_us = (bench_us() - started) / reps;
+		ok &= list_sorted_stable(clones[0], array, n);
+		for (unsigned long r = 0; r < reps; r++) {
+			slist_free(&clones[r]);
+		}
+		free(clones);
+
+		// contiguous
+		started = bench_us();
+		for (unsigned long r = 0; r < reps; r++) {
+			slist_sort_array(list, greater_than_res_refresh, array, n);
+		}
+		double array_us = (bench_us() - started) / reps;
+		ok &= sorted_stable(array, n);
+
+		printf("%8lu %16.2f %16.2f %16.2f\n", n, sort_us, in_place_us, array_us);
+
+		free(array);
+		slist_free(&list);
+		free(modes);
+	}
+
+	pool_destroy();
+
+	if (!ok) {
+		fprintf(stderr, "unstable or unsorted result\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,163 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-util.h>
+
+#include "bench.h"
+#include "cfg.h"
+#include "head.h"
+#include "info.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+
+#define HEADS 16
+#define MODES 50
+#define PRINTS_GATED 1000000
+#define PRINTS 1000
+
+static unsigned long evaluated = 0;
+
+// an argument whose formatting is observable
+int evaluate(void) {
+	return (int)++evaluated;
+}
+
+struct Head *head_modes(int n) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "DP-%d", n);
+	head->name = strdup(buf);
+	snprintf(buf, sizeof(buf), "Monitor Maker ABC%03d (DP-%d)", n, n);
+	head->description = strdup(buf);
+	head->width_mm = 600;
+	head->height_mm = 340;
+
+	for (int32_t i = 0; i < MODES; i++) {
+		struct Mode *mode = pool_alloc(POOL_MODE);
+		mode->head = head;
+		mode->width = 3840 - 64 * (i / 2);
+		mode->height = 2160 - 36 * (i / 2);
+		mode->refresh_mhz = 60000 - 10000 * (i % 2);
+		mode->preferred = i == 0;
+		slist_header_append(&head->modes, mode);
+	}
+	head->preferred_mode = head->modes.first->val;
+
+	head->current.mode = head->modes.first->val;
+	head->current.scale = wl_fixed_from_int(1);
+	head->current.enabled = true;
+	head->current.x = 3840 * n;
+
+	return head;
+}
+
+// stdout and stderr to f, saving the originals
+void redirect(FILE *f, int saved[2]) {
+	fflush(stdout);
+	fflush(stderr);
+	saved[0] = dup(STDOUT_FILENO);
+	saved[1] = dup(STDERR_FILENO);
+	dup2(fileno(f), STDOUT_FILENO);
+	dup2(fileno(f), STDERR_FILENO);
+}
+
+void restore(int saved[2]) {
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved[0], STDOUT_FILENO);
+	dup2(saved[1], STDERR_FILENO);
+	close(saved[0]);
+	close(saved[1]);
+}
+
+off_t written(FILE *f) {
+	struct stat st;
+	return fstat(fileno(f), &st) == 0 ? st.st_size : -1;
+}
+
+int main(void) {
+	bool ok = true;
+	int saved[2];
+
+	cfg = cfg_default();
+
+	for (int n = 0; n < HEADS; n++) {
+		slist_append(&heads, head_modes(n));
+	}
+
+	FILE *out = tmpfile();
+	if (!out) {
+		fprintf(stderr, "tmpfile failed\n");
+		return EXIT_FAILURE;
+	}
+
+	// below threshold: no arguments evaluated, nothing printed or captured
+	log_set_threshold(WARNING, true);
+	redirect(out, saved);
+
+	log_debug("%d", evaluate());
+	log_debug_nocap("%d", evaluate());
+	log_info("%d", evaluate());
+	log_(INFO, "%d", evaluate());
+
+	double started = bench_us();
+	for (int i = 0; i < PRINTS_GATED; i++) {
+		print_heads(INFO, NONE, heads);
+	}
+	double gated_us = (bench_us() - started) / PRINTS_GATED;
+
+	restore(saved);
+
+	ok &= evaluated == 0;
+	ok &= written(out) == 0;
+	ok &= !log_cap || !log_cap->count;
+
+	// at threshold, which must be formatted
+	redirect(out, saved);
+
+	log_warn("%d", evaluate());
+
+	restore(saved);
+
+	ok &= evaluated == 1;
+
+	// the work skipped
+	log_set_threshold(INFO, true);
+	redirect(out, saved);
+
+	started = bench_us();
+	for (int i = 0; i < PRINTS; i++) {
+		print_heads(INFO, NONE, heads);
+	}
+	double printed_us = (bench_us() - started) / PRINTS;
+
+	restore(saved);
+
+	ok &= written(out) > 0;
+
+	printf("print_heads INFO, %d heads x %d modes, us per call\n", HEADS, MODES);
+	printf("%16s %16s\n", "WARNING us", "INFO us");
+	printf("%16.4f %16.1f\n", gated_us, printed_us);
+
+	fclose(out);
+
+	cfg_destroy();
+	heads_destroy();
+	pool_destroy();
+
+	if (!ok) {
+		fprintf(stderr, "formatted below threshold\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
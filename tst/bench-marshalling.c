@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "bench.h"
+#include "cfg.h"
+#include "head.h"
+#include "info.h"
+#include "ipc.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "marshalling.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+#include "tlv.h"
+
+#define HEADS 16
+#define MODES 200
+#define GETS 1000
+
+// re-emitting everything is slow, time fewer
+#define GETS_UNCACHED 100
+
+struct Head *head_modes(int n) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "DP-%d", n);
+	head->name = strdup(buf);
+	snprintf(buf, sizeof(buf), "Monitor Maker ABC%03d (DP-%d)", n, n);
+	head->description = strdup(buf);
+	head->make = strdup("Monitor Maker");
+	snprintf(buf, sizeof(buf), "ABC%03d", n);
+	head->model = strdup(buf);
+	head->serial_number = strdup("0x00AA");
+	head->width_mm = 600;
+	head->height_mm = 340;
+
+	for (int32_t i = 0; i < MODES; i++) {
+		struct Mode *mode = pool_alloc(POOL_MODE);
+		mode->head = head;
+		mode->width = 7680 - 32 * (i / 4);
+		mode->height = 4320 - 18 * (i / 4);
+		mode->refresh_mhz = 144000 - 24000 * (i % 4);
+		mode->preferred = i == 0;
+		slist_header_append(&head->modes, mode);
+	}
+
+	head->current.mode = head->modes.first->val;
+	head->current.scale = wl_fixed_from_double(1.5);
+	head->current.enabled = true;
+	head->current.x = 5120 * n;
+	head->desired = head->current;
+
+	head->generation = 1;
+
+	return head;
+}
+
+// every head changed, as though no fragment was kept
+void invalidate(bool uncached) {
+	if (!uncached) {
+		return;
+	}
+	for (struct SList *i = heads; i; i = i->nex) {
+		((struct Head*)i->val)->generation++;
+	}
+}
+
+// GETs as the server answers them, returning the last payload
+char *get_responses(struct IpcResponse *response, int count, bool uncached, size_t *len, double *us) {
+	char *payload = NULL;
+
+	double started = bench_us();
+	for (int i = 0; i < count; i++) {
+		invalidate(uncached);
+		state_revise();
+
+		free(payload);
+		if (response->encoding == IPC_ENCODING_BINARY) {
+			payload = tlv_marshal_ipc_response(response, len);
+		} else if ((payload = marshal_ipc_response(response))) {
+			*len = strlen(payload);
+		}
+	}
+	*us = (bench_us() - started) / count;
+
+	return payload;
+}
+
+int main(void) {
+	bool ok = true;
+
+	log_set_threshold(ERROR, true);
+
+	cfg = cfg_default();
+	slist_append(&cfg->order_name_desc, strdup("DP-1"));
+	slist_append(&cfg->disabled_name_desc, strdup("HDMI-A-2"));
+
+	lid = (struct Lid*)calloc(1, sizeof(struct Lid));
+	lid->device_path = strdup("/dev/input/event2");
+
+	for (int n = 0; n < HEADS; n++) {
+		slist_append(&heads, head_modes(n));
+	}
+	heads_generation++;
+
+	struct IpcResponse response = {
+		.done = true,
+		.status = true,
+		.framed = true,
+	};
+
+	printf("%d GETs (%d uncached), %d heads x %d modes, us per GET\n", GETS, GETS_UNCACHED, HEADS, MODES);
+	printf("%8s %16s %16s %16s %12s\n", "encoding", "uncached us", "cached us", "cached total ms", "bytes");
+
+	for (int binary = 0; binary < 2; binary++) {
+		double uncached_us = 0, cached_us = 0;
+		size_t uncached_len = 0, cached_len = 0;
+
+		response.encoding = binary ? IPC_ENCODING_BINARY : IPC_ENCODING_YAML;
+
+		unsigned long instance = cfg->instance;
+		// cfg instance 0 is never cached
+		cfg->instance = 0;
+		char *uncached = get_responses(&response, GETS_UNCACHED, true, &uncached_len, &uncached_us);
+		cfg->instance = instance;
+
+		char *cached = get_responses(&response, GETS, false, &cached_len, &cached_us);
+
+		printf("%8s %16.1f %16.1f %16.1f %12zu\n", binary ? "binary" : "yaml", uncached_us, cached_us, cached_us * GETS / 1000, cached_len);
+
+		// reused fragments give the same response
+		ok &= uncached && cached && uncached_len == cached_len && memcmp(uncached, cached, cached_len) == 0;
+
+		free(uncached);
+		free(cached);
+	}
+
+	cfg_destroy();
+	free(lid->device_path);
+	free(lid);
+	lid = NULL;
+	heads_destroy();
+	pool_destroy();
+
+	if (!ok) {
+		fprintf(stderr, "cached response differs\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
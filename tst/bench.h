@@ -0,0 +1,14 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+// monotonic microseconds
+static inline double bench_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+#endif // BENCH_H
+
@@ -0,0 +1,1607 @@
+// Stand-in wlr-output-management compositor: runs way-displays headlessly
+// against scripted heads and reports how it converges.
+//
+// Usage: compositor [-q] [-v] <scenario> [<way-displays>]
+//   -q  print only reports
+//   -v  print the way-displays log
+//
+// A scenario is a directive per line, # for comments:
+//   cfg <line>                        append a line to cfg.yaml, before start
+//   head <name> [desc <d>] [make <m>] [model <m>] [serial <s>] [size <w>x<h>] [disabled]
+//   mode <name> <w>x<h>[@<Hz>] [preferred] [current] [fail] [fail-apply]
+//   latency <ms> [<test ms>]          delay configuration results
+//   quiet <ms>                        silence after which way-displays has converged
+//   start                             run way-displays
+//   stop                              stop way-displays, unplug all heads and clear its cache
+//   plug <name> ...                   announce heads, as one change
+//   unplug <name> ...                 remove heads, as one change
+//   storm <count> <ms> <name> ...     unplug and plug heads repeatedly, ms apart, ending plugged
+//   fail <count>                      fail the next applies
+//   cancel <count>                    cancel the next applies, as for a concurrent change
+//   sleep <ms>
+//   converge [<ms>]                   wait for way-displays to settle then report
+//   report <label>                    the previous converge as a table row
+//   expect <name> enabled|disabled [mode <w>x<h>[@<Hz>]] [scale <s>] [position <x>,<y>] [transform <t>]
+//   expect applies|failed|cancelled|tests <count>    since the previous converge
+//
+// Heads are enabled in their current, preferred or first mode when plugged.
+// Modes marked fail are rejected by test and apply, fail-apply by apply only.
+//
+// Converge times are from the last head change to the compositor's last answer
+// and, when way-displays logs at DEBUG, to its "Converged" line i.e. IDLE.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#include "wlr-output-management-unstable-v1-server.h"
+
+#define HEADS_MAX 16
+#define MODES_MAX 64
+#define ARGS_MAX 64
+
+#define CONVERGE_TIMEOUT_MS 10000
+#define QUIET_MS 250
+#define TERM_TIMEOUT_MS 2000
+
+struct MockHead;
+
+struct MockMode {
+	struct MockHead *head;
+	int32_t width;
+	int32_t height;
+	int32_t refresh;
+	bool preferred;
+	bool fail;
+	bool fail_apply;
+	struct wl_list resources;
+};
+
+struct MockHeadState {
+	bool enabled;
+	struct MockMode *mode;
+	int32_t x;
+	int32_t y;
+	int32_t transform;
+	wl_fixed_t scale;
+};
+
+struct MockHead {
+	char *name;
+	char *description;
+	char *make;
+	char *model;
+	char *serial_number;
+	int32_t width_mm;
+	int32_t height_mm;
+	struct MockMode modes[MODES_MAX];
+	size_t modes_len;
+	struct MockHeadState initial;
+	struct MockHeadState state;
+	bool plugged;
+	struct wl_list resources;
+};
+
+struct Configuration {
+	struct wl_resource *resource;
+	uint32_t serial;
+	bool used;
+	bool test;
+	struct wl_event_source *timer;
+	struct wl_list heads;
+};
+
+struct ConfigurationHead {
+	struct wl_list link;
+	struct wl_resource *resource;
+	struct MockHead *head;
+	bool enabled;
+	struct MockMode *mode;
+	bool mode_inert;
+	bool custom;
+	int32_t custom_width;
+	int32_t custom_height;
+	int32_t custom_refresh;
+	bool position_set;
+	int32_t x;
+	int32_t y;
+	bool transform_set;
+	int32_t transform;
+	bool scale_set;
+	wl_fixed_t scale;
+};
+
+struct Counts {
+	unsigned int applies;
+	unsigned int failed;
+	unsigned int cancelled;
+	unsigned int tests;
+	unsigned int tests_failed;
+};
+
+struct Mock {
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_list managers;
+	uint32_t serial;
+
+	struct MockHead heads[HEADS_MAX];
+	size_t heads_len;
+
+	long latency_ms;
+	long latency_test_ms;
+	long quiet_ms;
+	unsigned int fail_next;
+	unsigned int cancel_next;
+
+	unsigned int outstanding;
+	double activity_ms;
+	double changed_ms;
+	double answered_ms;
+	double idle_ms;
+	struct Counts counts;
+	struct Counts converged;
+	double converged_answered_ms;
+	double converged_idle_ms;
+	bool reported;
+
+	char dir[64];
+	char log_path[PATH_MAX];
+	char cache_path[PATH_MAX];
+	int log_fd;
+	int log_inotify_fd;
+	struct wl_event_source *log_source;
+	char log_line[4096];
+	size_t log_line_len;
+	char cfg_path[PATH_MAX];
+	char pid_path[PATH_MAX];
+	const char *way_displays;
+	pid_t pid;
+	bool started;
+
+	const char *scenario;
+	unsigned int line;
+	bool quiet;
+	bool verbose;
+	bool failed;
+} mock = { 0 };
+
+double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void fail(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "%s:%u: ", mock.scenario, mock.line);
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+
+	mock.failed = true;
+	exit(EXIT_FAILURE);
+}
+
+//
+// protocol
+//
+
+void managers_done(void) {
+	struct wl_resource *manager;
+
+	mock.serial++;
+	wl_resource_for_each(manager, &mock.managers) {
+		zwlr_output_manager_v1_send_done(manager, mock.serial);
+	}
+}
+
+static void resource_unlink(struct wl_resource *resource) {
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+// requests referencing an inert resource are ignored or cancelled
+void resource_inert(struct wl_resource *resource) {
+	wl_resource_set_user_data(resource, NULL);
+	wl_list_remove(wl_resource_get_link(resource));
+	wl_list_init(wl_resource_get_link(resource));
+}
+
+struct wl_resource *mode_resource(struct MockMode *mode, struct wl_client *client) {
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &mode->resources) {
+		if (wl_resource_get_client(resource) == client) {
+			return resource;
+		}
+	}
+	return NULL;
+}
+
+struct MockMode *head_preferred_mode(struct MockHead *head) {
+	for (size_t i = 0; i < head->modes_len; i++) {
+		if (head->modes[i].preferred) {
+			return &head->modes[i];
+		}
+	}
+	return head->modes_len ? &head->modes[0] : NULL;
+}
+
+bool head_state_equal(const struct MockHeadState *a, const struct MockHeadState *b) {
+	return a->enabled == b->enabled &&
+		a->mode == b->mode &&
+		a->x == b->x &&
+		a->y == b->y &&
+		a->transform == b->transform &&
+		a->scale == b->scale;
+}
+
+// everything without a previous state, otherwise only what changed
+void head_send_state(struct MockHead *head, struct wl_resource *resource, const struct MockHeadState *prev) {
+	const struct MockHeadState *state = &head->state;
+
+	if (!prev || prev->enabled != state->enabled) {
+		zwlr_output_head_v1_send_enabled(resource, state->enabled);
+	}
+	if (!state->enabled) {
+		return;
+	}
+
+	bool all = !prev || !prev->enabled;
+
+	struct wl_resource *mode = state->mode ? mode_resource(state->mode, wl_resource_get_client(resource)) : NULL;
+	if (mode && (all || prev->mode != state->mode)) {
+		zwlr_output_head_v1_send_current_mode(resource, mode);
+	}
+	if (all || prev->x != state->x || prev->y != state->y) {
+		zwlr_output_head_v1_send_position(resource, state->x, state->y);
+	}
+	if (all || prev->transform != state->transform) {
+		zwlr_output_head_v1_send_transform(resource, state->transform);
+	}
+	if (all || prev->scale != state->scale) {
+		zwlr_output_head_v1_send_scale(resource, state->scale);
+	}
+}
+
+void head_announce(struct MockHead *head, struct wl_resource *manager) {
+	struct wl_client *client = wl_resource_get_client(manager);
+	int version = wl_resource_get_version(manager);
+
+	struct wl_resource *resource = wl_resource_create(client, &zwlr_output_head_v1_interface, version, 0);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, NULL, head, resource_unlink);
+	wl_list_insert(head->resources.prev, wl_resource_get_link(resource));
+
+	zwlr_output_manager_v1_send_head(manager, resource);
+
+	zwlr_output_head_v1_send_name(resource, head->name);
+	zwlr_output_head_v1_send_description(resource, head->description);
+	if (head->width_mm && head->height_mm) {
+		zwlr_output_head_v1_send_physical_size(resource, head->width_mm, head->height_mm);
+	}
+
+	for (size_t i = 0; i < head->modes_len; i++) {
+		struct MockMode *mode = &head->modes[i];
+
+		struct wl_resource *mode_resource = wl_resource_create(client, &zwlr_output_mode_v1_interface, version, 0);
+		if (!mode_resource) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		wl_resource_set_implementation(mode_resource, NULL, mode, resource_unlink);
+		wl_list_insert(mode->resources.prev, wl_resource_get_link(mode_resource));
+
+		zwlr_output_head_v1_send_mode(resource, mode_resource);
+		zwlr_output_mode_v1_send_size(mode_resource, mode->width, mode->height);
+		if (mode->refresh) {
+			zwlr_output_mode_v1_send_refresh(mode_resource, mode->refresh);
+		}
+		if (mode->preferred) {
+			zwlr_output_mode_v1_send_preferred(mode_resource);
+		}
+	}
+
+	if (version >= ZWLR_OUTPUT_HEAD_V1_MAKE_SINCE_VERSION) {
+		if (head->make) {
+			zwlr_output_head_v1_send_make(resource, head->make);
+		}
+		if (head->model) {
+			zwlr_output_head_v1_send_model(resource, head->model);
+		}
+		if (head->serial_number) {
+			zwlr_output_head_v1_send_serial_number(resource, head->serial_number);
+		}
+	}
+
+	head_send_state(head, resource, NULL);
+}
+
+// done is up to the caller
+void head_plug(struct MockHead *head) {
+	if (head->plugged) {
+		fail("%s already plugged", head->name);
+	}
+
+	head->state = head->initial;
+	if (head->state.enabled && !head->state.mode) {
+		head->state.mode = head_preferred_mode(head);
+	}
+	head->plugged = true;
+
+	struct wl_resource *manager;
+	wl_resource_for_each(manager, &mock.managers) {
+		head_announce(head, manager);
+	}
+}
+
+// done is up to the caller
+void head_unplug(struct MockHead *head) {
+	if (!head->plugged) {
+		fail("%s not plugged", head->name);
+	}
+
+	struct wl_resource *resource, *tmp;
+	for (size_t i = 0; i < head->modes_len; i++) {
+		wl_resource_for_each_safe(resource, tmp, &head->modes[i].resources) {
+			zwlr_output_mode_v1_send_finished(resource);
+			resource_inert(resource);
+		}
+	}
+	wl_resource_for_each_safe(resource, tmp, &head->resources) {
+		zwlr_output_head_v1_send_finished(resource);
+		resource_inert(resource);
+	}
+
+	head->plugged = false;
+}
+
+struct MockMode *configuration_head_mode(struct ConfigurationHead *config_head) {
+	struct MockHead *head = config_head->head;
+
+	if (config_head->mode) {
+		return config_head->mode;
+	}
+
+	if (config_head->custom) {
+		for (size_t i = 0; i < head->modes_len; i++) {
+			struct MockMode *mode = &head->modes[i];
+			if (mode->width == config_head->custom_width &&
+					mode->height == config_head->custom_height &&
+					(!config_head->custom_refresh || mode->refresh == config_head->custom_refresh)) {
+				return mode;
+			}
+		}
+		return NULL;
+	}
+
+	return head->state.mode ? head->state.mode : head_preferred_mode(head);
+}
+
+bool configuration_valid(struct Configuration *configuration, bool test) {
+	struct ConfigurationHead *config_head;
+	wl_list_for_each(config_head, &configuration->heads, link) {
+		if (!config_head->head || config_head->mode_inert) {
+			return false;
+		}
+		if (!config_head->enabled) {
+			continue;
+		}
+
+		struct MockMode *mode = configuration_head_mode(config_head);
+		if (!mode || mode->fail || (!test && mode->fail_apply)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void configuration_commit(struct Configuration *configuration) {
+	bool changed = false;
+
+	struct ConfigurationHead *config_head;
+	wl_list_for_each(config_head, &configuration->heads, link) {
+		struct MockHead *head = config_head->head;
+		struct MockHeadState prev = head->state;
+
+		head->state.enabled = config_head->enabled;
+		if (config_head->enabled) {
+			head->state.mode = configuration_head_mode(config_head);
+			if (config_head->position_set) {
+				head->state.x = config_head->x;
+				head->state.y = config_head->y;
+			}
+			if (config_head->transform_set) {
+				head->state.transform = config_head->transform;
+			}
+			if (config_head->scale_set) {
+				head->state.scale = config_head->scale;
+			}
+		}
+
+		if (!head_state_equal(&prev, &head->state)) {
+			struct wl_resource *resource;
+			wl_resource_for_each(resource, &head->resources) {
+				head_send_state(head, resource, &prev);
+			}
+			changed = true;
+		}
+	}
+
+	if (changed) {
+		managers_done();
+	}
+}
+
+void configuration_answer(struct Configuration *configuration) {
+	if (configuration->timer) {
+		wl_event_source_remove(configuration->timer);
+		configuration->timer = NULL;
+	}
+
+	mock.outstanding--;
+	mock.activity_ms = mock.answered_ms = now_ms();
+
+	bool test = configuration->test;
+
+	if (configuration->serial != mock.serial) {
+		if (!test) {
+			mock.counts.cancelled++;
+		}
+		zwlr_output_configuration_v1_send_cancelled(configuration->resource);
+		return;
+	}
+
+	if (!test && mock.cancel_next) {
+		mock.cancel_next--;
+		mock.counts.cancelled++;
+		managers_done();
+		zwlr_output_configuration_v1_send_cancelled(configuration->resource);
+		return;
+	}
+
+	if ((!test && mock.fail_next) || !configuration_valid(configuration, test)) {
+		if (test) {
+			mock.counts.tests_failed++;
+		} else {
+			mock.counts.failed++;
+			if (mock.fail_next) {
+				mock.fail_next--;
+			}
+		}
+		zwlr_output_configuration_v1_send_failed(configuration->resource);
+		return;
+	}
+
+	zwlr_output_configuration_v1_send_succeeded(configuration->resource);
+
+	if (!test) {
+		configuration_commit(configuration);
+	}
+}
+
+static int configuration_timer(void *data) {
+	configuration_answer(data);
+	return 0;
+}
+
+static struct ConfigurationHead *configuration_head_add(struct wl_resource *resource, struct wl_resource *head_resource) {
+	struct Configuration *configuration = wl_resource_get_user_data(resource);
+	struct MockHead *head = wl_resource_get_user_data(head_resource);
+
+	if (configuration->used) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_V1_ERROR_ALREADY_USED, "configuration has been used");
+		return NULL;
+	}
+
+	struct ConfigurationHead *config_head;
+	wl_list_for_each(config_head, &configuration->heads, link) {
+		if (head && config_head->head == head) {
+			wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_V1_ERROR_ALREADY_CONFIGURED_HEAD, "head has been configured");
+			return NULL;
+		}
+	}
+
+	config_head = calloc(1, sizeof(struct ConfigurationHead));
+	config_head->head = head;
+	wl_list_insert(configuration->heads.prev, &config_head->link);
+
+	return config_head;
+}
+
+static bool already_set(struct wl_resource *resource, bool set) {
+	if (set) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_HEAD_V1_ERROR_ALREADY_SET, "property has already been set");
+	}
+	return set;
+}
+
+static void configuration_head_set_mode(struct wl_client *client,
+		struct wl_resource *resource,
+		struct wl_resource *mode_resource) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (!config_head || already_set(resource, config_head->mode || config_head->mode_inert || config_head->custom)) {
+		return;
+	}
+
+	struct MockMode *mode = wl_resource_get_user_data(mode_resource);
+	if (!mode || !config_head->head) {
+		config_head->mode_inert = true;
+		return;
+	}
+
+	if (mode->head != config_head->head) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_HEAD_V1_ERROR_INVALID_MODE, "mode doesn't belong to head");
+		return;
+	}
+
+	config_head->mode = mode;
+}
+
+static void configuration_head_set_custom_mode(struct wl_client *client,
+		struct wl_resource *resource,
+		int32_t width,
+		int32_t height,
+		int32_t refresh) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (!config_head || already_set(resource, config_head->mode || config_head->mode_inert || config_head->custom)) {
+		return;
+	}
+
+	if (width <= 0 || height <= 0 || refresh < 0) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_HEAD_V1_ERROR_INVALID_CUSTOM_MODE, "invalid custom mode");
+		return;
+	}
+
+	config_head->custom = true;
+	config_head->custom_width = width;
+	config_head->custom_height = height;
+	config_head->custom_refresh = refresh;
+
+	if (!config_head->head) {
+		config_head->mode_inert = true;
+	}
+}
+
+static void configuration_head_set_position(struct wl_client *client,
+		struct wl_resource *resource,
+		int32_t x,
+		int32_t y) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (!config_head || already_set(resource, config_head->position_set)) {
+		return;
+	}
+
+	config_head->position_set = true;
+	config_head->x = x;
+	config_head->y = y;
+}
+
+static void configuration_head_set_transform(struct wl_client *client,
+		struct wl_resource *resource,
+		int32_t transform) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (!config_head || already_set(resource, config_head->transform_set)) {
+		return;
+	}
+
+	if (transform < WL_OUTPUT_TRANSFORM_NORMAL || transform > WL_OUTPUT_TRANSFORM_FLIPPED_270) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_HEAD_V1_ERROR_INVALID_TRANSFORM, "invalid transform");
+		return;
+	}
+
+	config_head->transform_set = true;
+	config_head->transform = transform;
+}
+
+static void configuration_head_set_scale(struct wl_client *client,
+		struct wl_resource *resource,
+		wl_fixed_t scale) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (!config_head || already_set(resource, config_head->scale_set)) {
+		return;
+	}
+
+	if (scale <= 0) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_HEAD_V1_ERROR_INVALID_SCALE, "invalid scale");
+		return;
+	}
+
+	config_head->scale_set = true;
+	config_head->scale = scale;
+}
+
+static const struct zwlr_output_configuration_head_v1_interface configuration_head_impl = {
+	.set_mode = configuration_head_set_mode,
+	.set_custom_mode = configuration_head_set_custom_mode,
+	.set_position = configuration_head_set_position,
+	.set_transform = configuration_head_set_transform,
+	.set_scale = configuration_head_set_scale,
+};
+
+// the configuration owns its heads
+static void configuration_head_destroy(struct wl_resource *resource) {
+	struct ConfigurationHead *config_head = wl_resource_get_user_data(resource);
+	if (config_head) {
+		config_head->resource = NULL;
+	}
+}
+
+static void configuration_enable_head(struct wl_client *client,
+		struct wl_resource *resource,
+		uint32_t id,
+		struct wl_resource *head) {
+	struct ConfigurationHead *config_head = configuration_head_add(resource, head);
+	if (!config_head) {
+		return;
+	}
+
+	config_head->enabled = true;
+
+	config_head->resource = wl_resource_create(client, &zwlr_output_configuration_head_v1_interface, wl_resource_get_version(resource), id);
+	if (!config_head->resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(config_head->resource, &configuration_head_impl, config_head, configuration_head_destroy);
+}
+
+static void configuration_disable_head(struct wl_client *client,
+		struct wl_resource *resource,
+		struct wl_resource *head) {
+	configuration_head_add(resource, head);
+}
+
+static void configuration_submit(struct wl_resource *resource, bool test) {
+	struct Configuration *configuration = wl_resource_get_user_data(resource);
+
+	if (configuration->used) {
+		wl_resource_post_error(resource, ZWLR_OUTPUT_CONFIGURATION_V1_ERROR_ALREADY_USED, "configuration has been used");
+		return;
+	}
+	configuration->used = true;
+	configuration->test = test;
+
+	if (test) {
+		mock.counts.tests++;
+	} else {
+		mock.counts.applies++;
+	}
+	mock.outstanding++;
+	mock.activity_ms = now_ms();
+
+	long latency_ms = test ? mock.latency_test_ms : mock.latency_ms;
+	if (latency_ms) {
+		configuration->timer = wl_event_loop_add_timer(mock.loop, configuration_timer, configuration);
+		wl_event_source_timer_update(configuration->timer, latency_ms);
+	} else {
+		configuration_answer(configuration);
+	}
+}
+
+static void configuration_apply(struct wl_client *client,
+		struct wl_resource *resource) {
+	configuration_submit(resource, false);
+}
+
+static void configuration_test(struct wl_client *client,
+		struct wl_resource *resource) {
+	configuration_submit(resource, true);
+}
+
+static void configuration_destroy_request(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct zwlr_output_configuration_v1_interface configuration_impl = {
+	.enable_head = configuration_enable_head,
+	.disable_head = configuration_disable_head,
+	.apply = configuration_apply,
+	.test = configuration_test,
+	.destroy = configuration_destroy_request,
+};
+
+static void configuration_destroy(struct wl_resource *resource) {
+	struct Configuration *configuration = wl_resource_get_user_data(resource);
+
+	// abandoned before the answer
+	if (configuration->timer) {
+		wl_event_source_remove(configuration->timer);
+		mock.outstanding--;
+	}
+
+	struct ConfigurationHead *config_head, *tmp;
+	wl_list_for_each_safe(config_head, tmp, &configuration->heads, link) {
+		if (config_head->resource) {
+			wl_resource_set_user_data(config_head->resource, NULL);
+		}
+		wl_list_remove(&config_head->link);
+		free(config_head);
+	}
+
+	free(configuration);
+}
+
+static void manager_create_configuration(struct wl_client *client,
+		struct wl_resource *resource,
+		uint32_t id,
+		uint32_t serial) {
+	struct Configuration *configuration = calloc(1, sizeof(struct Configuration));
+	configuration->serial = serial;
+	wl_list_init(&configuration->heads);
+
+	configuration->resource = wl_resource_create(client, &zwlr_output_configuration_v1_interface, wl_resource_get_version(resource), id);
+	if (!configuration->resource) {
+		free(configuration);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(configuration->resource, &configuration_impl, configuration, configuration_destroy);
+
+	mock.activity_ms = now_ms();
+}
+
+static void manager_stop(struct wl_client *client,
+		struct wl_resource *resource) {
+	zwlr_output_manager_v1_send_finished(resource);
+	wl_resource_destroy(resource);
+}
+
+static const struct zwlr_output_manager_v1_interface manager_impl = {
+	.create_configuration = manager_create_configuration,
+	.stop = manager_stop,
+};
+
+static void manager_bind(struct wl_client *client,
+		void *data,
+		uint32_t version,
+		uint32_t id) {
+	struct wl_resource *manager = wl_resource_create(client, &zwlr_output_manager_v1_interface, version, id);
+	if (!manager) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(manager, &manager_impl, NULL, resource_unlink);
+	wl_list_insert(mock.managers.prev, wl_resource_get_link(manager));
+
+	for (size_t i = 0; i < mock.heads_len; i++) {
+		if (mock.heads[i].plugged) {
+			head_announce(&mock.heads[i], manager);
+		}
+	}
+
+	zwlr_output_manager_v1_send_done(manager, mock.serial);
+
+	mock.activity_ms = now_ms();
+}
+
+//
+// way-displays
+//
+
+// way-displays is IDLE once it logs that it has converged
+void log_line(const char *line) {
+	unsigned int round_trips;
+
+	const char *converged = strstr(line, "Converged in ");
+	if (converged && sscanf(converged, "Converged in %u round trips", &round_trips) == 1) {
+		mock.idle_ms = now_ms();
+	}
+}
+
+static int log_readable(int fd, uint32_t mask, void *data) {
+	char buf[4096];
+
+	// just a wakeup
+	while (read(mock.log_inotify_fd, buf, sizeof(buf)) > 0);
+
+	ssize_t n;
+	while ((n = read(mock.log_fd, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] == '\n') {
+				mock.log_line[mock.log_line_len] = '\0';
+				log_line(mock.log_line);
+				mock.log_line_len = 0;
+			} else if (mock.log_line_len < sizeof(mock.log_line) - 1) {
+				mock.log_line[mock.log_line_len++] = buf[i];
+			}
+		}
+	}
+
+	return 0;
+}
+
+void log_watch(void) {
+	mock.log_fd = open(mock.log_path, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (mock.log_fd == -1) {
+		fail("unable to open %s: %s", mock.log_path, strerror(errno));
+	}
+
+	mock.log_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mock.log_inotify_fd == -1 || inotify_add_watch(mock.log_inotify_fd, mock.log_path, IN_MODIFY) == -1) {
+		fail("unable to watch %s: %s", mock.log_path, strerror(errno));
+	}
+
+	mock.log_source = wl_event_loop_add_fd(mock.loop, mock.log_inotify_fd, WL_EVENT_READABLE, log_readable, NULL);
+}
+
+void way_displays_start(void) {
+	if (mock.started) {
+		fail("already started");
+	}
+
+	fflush(NULL);
+
+	mock.pid = fork();
+	if (mock.pid == -1) {
+		fail("fork failed: %s", strerror(errno));
+	}
+
+	if (mock.pid == 0) {
+		int fd = open(mock.log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (fd != -1) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		execl(mock.way_displays, mock.way_displays, (char*)NULL);
+		fprintf(stderr, "exec %s failed: %s\n", mock.way_displays, strerror(errno));
+		_exit(127);
+	}
+
+	mock.started = true;
+	mock.changed_ms = mock.activity_ms = now_ms();
+}
+
+// false when way-displays has gone
+bool way_displays_running(int *status) {
+	if (!mock.pid) {
+		return false;
+	}
+
+	if (waitpid(mock.pid, status, WNOHANG) == mock.pid) {
+		mock.pid = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void way_displays_stop(void) {
+	int status;
+
+	if (!way_displays_running(&status)) {
+		return;
+	}
+
+	kill(mock.pid, SIGTERM);
+
+	double deadline = now_ms() + TERM_TIMEOUT_MS;
+	while (way_displays_running(&status)) {
+		if (now_ms() > deadline) {
+			fprintf(stderr, "%s: way-displays did not exit, killing\n", mock.scenario);
+			kill(mock.pid, SIGKILL);
+			waitpid(mock.pid, &status, 0);
+			mock.pid = 0;
+			break;
+		}
+		wl_display_flush_clients(mock.display);
+		wl_event_loop_dispatch(mock.loop, 10);
+	}
+}
+
+// dispatch requests for one slice, failing when way-displays has gone
+void pump(long ms) {
+	int status = 0;
+
+	wl_display_flush_clients(mock.display);
+
+	if (mock.started && !way_displays_running(&status)) {
+		if (WIFEXITED(status)) {
+			fail("way-displays exited with status %d", WEXITSTATUS(status));
+		} else {
+			fail("way-displays terminated by signal %d", WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+		}
+	}
+
+	wl_event_loop_dispatch(mock.loop, ms < 0 ? 0 : ms > 10 ? 10 : ms);
+	wl_display_flush_clients(mock.display);
+}
+
+void pump_for(long ms) {
+	double deadline = now_ms() + ms;
+	do {
+		pump(deadline - now_ms());
+	} while (now_ms() < deadline);
+}
+
+//
+// scenario
+//
+
+struct MockHead *head_named(const char *name) {
+	for (size_t i = 0; i < mock.heads_len; i++) {
+		if (strcmp(mock.heads[i].name, name) == 0) {
+			return &mock.heads[i];
+		}
+	}
+	fail("unknown head %s", name);
+	return NULL;
+}
+
+long parse_long(const char *s, long min) {
+	char *end;
+	long l = strtol(s, &end, 10);
+	if (*s == '\0' || *end != '\0' || l < min) {
+		fail("invalid number %s", s);
+	}
+	return l;
+}
+
+// <w>x<h>[@<Hz>], refresh 0 when unspecified
+void parse_mode(const char *s, int32_t *width, int32_t *height, int32_t *refresh) {
+	double hz = 0;
+	int n = 0;
+	if (sscanf(s, "%dx%d%n@%lf%n", width, height, &n, &hz, &n) < 2 || s[n] != '\0' || *width <= 0 || *height <= 0 || hz < 0) {
+		fail("invalid mode %s", s);
+	}
+	*refresh = (int32_t)lround(hz * 1000);
+}
+
+void cmd_cfg(const char *yaml) {
+	if (mock.started) {
+		fail("cfg after start");
+	}
+
+	FILE *f = fopen(mock.cfg_path, "a");
+	if (!f) {
+		fail("unable to write %s: %s", mock.cfg_path, strerror(errno));
+	}
+	fprintf(f, "%s\n", yaml);
+	fclose(f);
+}
+
+void cmd_head(int argc, char **argv) {
+	if (argc < 2) {
+		fail("usage: head <name> [desc <d>] [make <m>] [model <m>] [serial <s>] [size <w>x<h>] [disabled]");
+	}
+	if (mock.heads_len == HEADS_MAX) {
+		fail("too many heads");
+	}
+	for (size_t i = 0; i < mock.heads_len; i++) {
+		if (strcmp(mock.heads[i].name, argv[1]) == 0) {
+			fail("duplicate head %s", argv[1]);
+		}
+	}
+
+	struct MockHead *head = &mock.heads[mock.heads_len++];
+	head->name = strdup(argv[1]);
+	head->initial.enabled = true;
+	head->initial.scale = wl_fixed_from_int(1);
+	wl_list_init(&head->resources);
+
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "disabled") == 0) {
+			head->initial.enabled = false;
+			continue;
+		}
+
+		if (i + 1 == argc) {
+			fail("missing value for %s", argv[i]);
+		}
+		const char *val = argv[++i];
+
+		if (strcmp(argv[i - 1], "desc") == 0) {
+			head->description = strdup(val);
+		} else if (strcmp(argv[i - 1], "make") == 0) {
+			head->make = strdup(val);
+		} else if (strcmp(argv[i - 1], "model") == 0) {
+			head->model = strdup(val);
+		} else if (strcmp(argv[i - 1], "serial") == 0) {
+			head->serial_number = strdup(val);
+		} else if (strcmp(argv[i - 1], "size") == 0) {
+			if (sscanf(val, "%dx%d", &head->width_mm, &head->height_mm) != 2) {
+				fail("invalid size %s", val);
+			}
+		} else {
+			fail("unknown head property %s", argv[i - 1]);
+		}
+	}
+
+	if (!head->description) {
+		head->description = strdup(head->name);
+	}
+}
+
+void cmd_mode(int argc, char **argv) {
+	if (argc < 3) {
+		fail("usage: mode <name> <w>x<h>[@<Hz>] [preferred] [current] [fail] [fail-apply]");
+	}
+
+	struct MockHead *head = head_named(argv[1]);
+	if (head->plugged) {
+		fail("%s is plugged", head->name);
+	}
+	if (head->modes_len == MODES_MAX) {
+		fail("too many modes");
+	}
+
+	struct MockMode *mode = &head->modes[head->modes_len++];
+	mode->head = head;
+	wl_list_init(&mode->resources);
+	parse_mode(argv[2], &mode->width, &mode->height, &mode->refresh);
+
+	for (int i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "preferred") == 0) {
+			mode->preferred = true;
+		} else if (strcmp(argv[i], "current") == 0) {
+			head->initial.mode = mode;
+		} else if (strcmp(argv[i], "fail") == 0) {
+			mode->fail = true;
+		} else if (strcmp(argv[i], "fail-apply") == 0) {
+			mode->fail_apply = true;
+		} else {
+			fail("unknown mode property %s", argv[i]);
+		}
+	}
+}
+
+void cmd_latency(int argc, char **argv) {
+	if (argc != 2 && argc != 3) {
+		fail("usage: latency <ms> [<test ms>]");
+	}
+	mock.latency_ms = parse_long(argv[1], 0);
+	mock.latency_test_ms = argc == 3 ? parse_long(argv[2], 0) : mock.latency_ms;
+}
+
+void cmd_quiet(int argc, char **argv) {
+	if (argc != 2) {
+		fail("usage: quiet <ms>");
+	}
+	mock.quiet_ms = parse_long(argv[1], 1);
+}
+
+void cmd_start(int argc, char **argv) {
+	if (argc != 1) {
+		fail("usage: start");
+	}
+	way_displays_start();
+}
+
+void cmd_plug(int argc, char **argv) {
+	if (argc < 2) {
+		fail("usage: plug <name> ...");
+	}
+	for (int i = 1; i < argc; i++) {
+		head_plug(head_named(argv[i]));
+	}
+	managers_done();
+	mock.changed_ms = mock.activity_ms = now_ms();
+}
+
+void cmd_unplug(int argc, char **argv) {
+	if (argc < 2) {
+		fail("usage: unplug <name> ...");
+	}
+	for (int i = 1; i < argc; i++) {
+		head_unplug(head_named(argv[i]));
+	}
+	managers_done();
+	mock.changed_ms = mock.activity_ms = now_ms();
+}
+
+// ends with the heads plugged
+void cmd_storm(int argc, char **argv) {
+	if (argc < 4) {
+		fail("usage: storm <count> <ms> <name> ...");
+	}
+
+	long count = parse_long(argv[1], 1);
+	long ms = parse_long(argv[2], 0);
+
+	for (long i = 0; i < count; i++) {
+		bool unplugged = false;
+		for (int j = 3; j < argc; j++) {
+			struct MockHead *head = head_named(argv[j]);
+			if (head->plugged) {
+				head_unplug(head);
+				unplugged = true;
+			}
+		}
+		if (unplugged) {
+			managers_done();
+			mock.changed_ms = mock.activity_ms = now_ms();
+			pump_for(ms);
+		}
+
+		cmd_plug(argc - 2, argv + 2);
+		pump_for(ms);
+	}
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+	remove(path);
+	return 0;
+}
+
+void remove_tree(const char *path) {
+	nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+void cmd_stop(int argc, char **argv) {
+	if (argc != 1) {
+		fail("usage: stop");
+	}
+	if (!mock.started) {
+		fail("not started");
+	}
+
+	way_displays_stop();
+	mock.started = false;
+
+	// all its resources go with it
+	wl_display_destroy_clients(mock.display);
+
+	for (size_t i = 0; i < mock.heads_len; i++) {
+		if (mock.heads[i].plugged) {
+			head_unplug(&mock.heads[i]);
+		}
+	}
+
+	// cold start
+	remove_tree(mock.cache_path);
+
+	mock.fail_next = 0;
+	mock.cancel_next = 0;
+	memset(&mock.counts, 0, sizeof(mock.counts));
+}
+
+void cmd_fail(int argc, char **argv) {
+	if (argc != 2) {
+		fail("usage: fail <count>");
+	}
+	mock.fail_next = parse_long(argv[1], 0);
+}
+
+void cmd_cancel(int argc, char **argv) {
+	if (argc != 2) {
+		fail("usage: cancel <count>");
+	}
+	mock.cancel_next = parse_long(argv[1], 0);
+}
+
+void cmd_sleep(int argc, char **argv) {
+	if (argc != 2) {
+		fail("usage: sleep <ms>");
+	}
+	pump_for(parse_long(argv[1], 0));
+}
+
+void cmd_converge(int argc, char **argv) {
+	if (argc > 2) {
+		fail("usage: converge [<ms>]");
+	}
+	if (!mock.started) {
+		fail("not started");
+	}
+
+	long timeout = argc == 2 ? parse_long(argv[1], 1) : CONVERGE_TIMEOUT_MS;
+	double deadline = now_ms() + timeout;
+
+	// bound, nothing outstanding and nothing asked for a while
+	while (wl_list_empty(&mock.managers) || mock.outstanding || now_ms() - mock.activity_ms < mock.quiet_ms) {
+		if (now_ms() > deadline) {
+			fail("not converged after %ld ms, %u outstanding", timeout, mock.outstanding);
+		}
+		pump(mock.quiet_ms);
+	}
+
+	// from the last change to the last answer and to IDLE
+	mock.converged_answered_ms = mock.answered_ms > mock.changed_ms ? mock.answered_ms - mock.changed_ms : 0;
+	mock.converged_idle_ms = mock.idle_ms > mock.changed_ms ? mock.idle_ms - mock.changed_ms : -1;
+
+	mock.converged = mock.counts;
+	memset(&mock.counts, 0, sizeof(mock.counts));
+
+	if (mock.quiet) {
+		return;
+	}
+
+	struct Counts *counts = &mock.converged;
+	printf("%s:%u: %u applies (%u failed, %u cancelled), %u tests (%u failed), %.1f ms",
+			mock.scenario, mock.line,
+			counts->applies, counts->failed, counts->cancelled,
+			counts->tests, counts->tests_failed,
+			mock.converged_answered_ms);
+	if (mock.converged_idle_ms >= 0) {
+		printf(", idle after %.1f ms", mock.converged_idle_ms);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+void cmd_report(int argc, char **argv) {
+	if (argc != 2) {
+		fail("usage: report <label>");
+	}
+
+	if (!mock.reported) {
+		printf("%-12s %8s %8s %10s %6s %12s %9s\n", "", "applies", "failed", "cancelled", "tests", "answered ms", "idle ms");
+		mock.reported = true;
+	}
+
+	char idle[32] = "-";
+	if (mock.converged_idle_ms >= 0) {
+		snprintf(idle, sizeof(idle), "%.1f", mock.converged_idle_ms);
+	}
+
+	struct Counts *counts = &mock.converged;
+	printf("%-12s %8u %8u %10u %6u %12.1f %9s\n", argv[1],
+			counts->applies, counts->failed, counts->cancelled, counts->tests,
+			mock.converged_answered_ms, idle);
+	fflush(stdout);
+}
+
+void expect_count(const char *name, unsigned int actual, const char *expected) {
+	long count = parse_long(expected, 0);
+	if (actual != count) {
+		fail("expected %ld %s, got %u", count, name, actual);
+	}
+}
+
+void expect_head(int argc, char **argv) {
+	struct MockHead *head = head_named(argv[1]);
+	struct MockHeadState *state = &head->state;
+
+	bool enabled = strcmp(argv[2], "enabled") == 0;
+	if (!enabled && strcmp(argv[2], "disabled") != 0) {
+		fail("expected enabled or disabled, got %s", argv[2]);
+	}
+	if (!head->plugged) {
+		fail("%s is not plugged", head->name);
+	}
+	if (state->enabled != enabled) {
+		fail("expected %s %s", head->name, argv[2]);
+	}
+
+	if ((argc - 3) % 2) {
+		fail("usage: expect <name> enabled|disabled [mode <w>x<h>[@<Hz>]] [scale <s>] [position <x>,<y>] [transform <t>]");
+	}
+
+	for (int i = 3; i < argc; i += 2) {
+		const char *val = argv[i + 1];
+
+		if (strcmp(argv[i], "mode") == 0) {
+			int32_t width, height, refresh;
+			parse_mode(val, &width, &height, &refresh);
+			struct MockMode *mode = state->mode;
+			if (!mode || mode->width != width || mode->height != height || (refresh && mode->refresh != refresh)) {
+				fail("expected %s mode %s, got %dx%d@%d mHz", head->name, val,
+						mode ? mode->width : 0, mode ? mode->height : 0, mode ? mode->refresh : 0);
+			}
+		} else if (strcmp(argv[i], "scale") == 0) {
+			double scale = strtod(val, NULL);
+			if (fabs(wl_fixed_to_double(state->scale) - scale) > 0.005) {
+				fail("expected %s scale %s, got %g", head->name, val, wl_fixed_to_double(state->scale));
+			}
+		} else if (strcmp(argv[i], "position") == 0) {
+			int32_t x, y;
+			if (sscanf(val, "%d,%d", &x, &y) != 2) {
+				fail("invalid position %s", val);
+			}
+			if (state->x != x || state->y != y) {
+				fail("expected %s position %s, got %d,%d", head->name, val, state->x, state->y);
+			}
+		} else if (strcmp(argv[i], "transform") == 0) {
+			if (state->transform != parse_long(val, 0)) {
+				fail("expected %s transform %s, got %d", head->name, val, state->transform);
+			}
+		} else {
+			fail("unknown expectation %s", argv[i]);
+		}
+	}
+}
+
+void cmd_expect(int argc, char **argv) {
+	if (argc < 3) {
+		fail("usage: expect <name> enabled|disabled ... or expect applies|failed|cancelled|tests <count>");
+	}
+
+	if (strcmp(argv[1], "applies") == 0) {
+		expect_count(argv[1], mock.converged.applies, argv[2]);
+	} else if (strcmp(argv[1], "failed") == 0) {
+		expect_count(argv[1], mock.converged.failed, argv[2]);
+	} else if (strcmp(argv[1], "cancelled") == 0) {
+		expect_count(argv[1], mock.converged.cancelled, argv[2]);
+	} else if (strcmp(argv[1], "tests") == 0) {
+		expect_count(argv[1], mock.converged.tests, argv[2]);
+	} else {
+		expect_head(argc, argv);
+	}
+}
+
+struct Command {
+	const char *name;
+	void (*fn)(int argc, char **argv);
+};
+
+static const struct Command commands[] = {
+	{ "head", cmd_head, },
+	{ "mode", cmd_mode, },
+	{ "latency", cmd_latency, },
+	{ "quiet", cmd_quiet, },
+	{ "start", cmd_start, },
+	{ "stop", cmd_stop, },
+	{ "plug", cmd_plug, },
+	{ "unplug", cmd_unplug, },
+	{ "storm", cmd_storm, },
+	{ "fail", cmd_fail, },
+	{ "cancel", cmd_cancel, },
+	{ "sleep", cmd_sleep, },
+	{ "converge", cmd_converge, },
+	{ "report", cmd_report, },
+	{ "expect", cmd_expect, },
+};
+
+// whitespace separated, double quotes group
+int tokenise(char *line, char **argv) {
+	int argc = 0;
+	char *p = line;
+
+	for (;;) {
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (*p == '\0' || *p == '#') {
+			break;
+		}
+		if (argc == ARGS_MAX) {
+			fail("too many arguments");
+		}
+
+		if (*p == '"') {
+			argv[argc++] = ++p;
+			while (*p && *p != '"') {
+				p++;
+			}
+			if (*p != '"') {
+				fail("unterminated quote");
+			}
+		} else {
+			argv[argc++] = p;
+			while (*p && *p != ' ' && *p != '\t') {
+				p++;
+			}
+		}
+		if (*p) {
+			*p++ = '\0';
+		}
+	}
+
+	return argc;
+}
+
+void run(FILE *f) {
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	char *argv[ARGS_MAX];
+
+	while ((len = getline(&line, &size, f)) != -1) {
+		mock.line++;
+
+		if (len && line[len - 1] == '\n') {
+			line[--len] = '\0';
+		}
+
+		// cfg lines are verbatim yaml
+		char *rest = line;
+		while (*rest == ' ' || *rest == '\t') {
+			rest++;
+		}
+		if (strncmp(rest, "cfg", 3) == 0 && (rest[3] == ' ' || rest[3] == '\t')) {
+			cmd_cfg(rest + 4);
+			continue;
+		}
+
+		int argc = tokenise(line, argv);
+		if (!argc) {
+			continue;
+		}
+
+		const struct Command *command = NULL;
+		for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+			if (strcmp(commands[i].name, argv[0]) == 0) {
+				command = &commands[i];
+			}
+		}
+		if (!command) {
+			fail("unknown directive %s", argv[0]);
+		}
+
+		command->fn(argc, argv);
+
+		// keep way-displays fed between directives
+		if (mock.started) {
+			pump(0);
+		}
+	}
+
+	free(line);
+}
+
+//
+// setup
+//
+
+void print_log(void) {
+	FILE *f = fopen(mock.log_path, "r");
+	if (!f) {
+		return;
+	}
+
+	fprintf(stderr, "---- %s way-displays log\n", mock.scenario);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		fwrite(buf, 1, n, stderr);
+	}
+	fprintf(stderr, "---- %s end\n", mock.scenario);
+
+	fclose(f);
+}
+
+void teardown(void) {
+	if (mock.display) {
+		way_displays_stop();
+		if (mock.log_source) {
+			wl_event_source_remove(mock.log_source);
+			close(mock.log_inotify_fd);
+			close(mock.log_fd);
+		}
+		wl_display_destroy_clients(mock.display);
+		wl_display_destroy(mock.display);
+		mock.display = NULL;
+	}
+
+	if (mock.failed || mock.verbose) {
+		print_log();
+	}
+
+	if (mock.dir[0]) {
+		remove_tree(mock.dir);
+		mock.dir[0] = '\0';
+	}
+	if (mock.pid_path[0]) {
+		unlink(mock.pid_path);
+	}
+}
+
+void setup(void) {
+	snprintf(mock.dir, sizeof(mock.dir), "/tmp/way-displays-mock.XXXXXX");
+	if (!mkdtemp(mock.dir)) {
+		mock.dir[0] = '\0';
+		fail("mkdtemp failed: %s", strerror(errno));
+	}
+
+	char path[PATH_MAX];
+	char vtnr[32];
+
+	// isolate way-displays' runtime, cfg, cache and pid file
+	snprintf(vtnr, sizeof(vtnr), "mock%d", getpid());
+	setenv("XDG_VTNR", vtnr, 1);
+	setenv("XDG_RUNTIME_DIR", mock.dir, 1);
+	setenv("HOME", mock.dir, 1);
+	snprintf(path, sizeof(path), "%s/cfg", mock.dir);
+	setenv("XDG_CONFIG_HOME", path, 1);
+	snprintf(path, sizeof(path), "%s/cache", mock.dir);
+	setenv("XDG_CACHE_HOME", path, 1);
+	snprintf(mock.pid_path, sizeof(mock.pid_path), "/tmp/way-displays.%s.pid", vtnr);
+
+	snprintf(path, sizeof(path), "%s/cfg", mock.dir);
+	mkdir(path, 0700);
+	snprintf(path, sizeof(path), "%s/cfg/way-displays", mock.dir);
+	mkdir(path, 0700);
+	snprintf(mock.cfg_path, sizeof(mock.cfg_path), "%s/cfg/way-displays/cfg.yaml", mock.dir);
+	snprintf(mock.log_path, sizeof(mock.log_path), "%s/way-displays.log", mock.dir);
+	snprintf(mock.cache_path, sizeof(mock.cache_path), "%s/cache", mock.dir);
+
+	// an empty cfg is not valid yaml
+	FILE *f = fopen(mock.cfg_path, "w");
+	if (!f) {
+		fail("unable to write %s: %s", mock.cfg_path, strerror(errno));
+	}
+	fprintf(f, "---\n");
+	fclose(f);
+
+	mock.display = wl_display_create();
+	if (!mock.display) {
+		fail("wl_display_create failed");
+	}
+	mock.loop = wl_display_get_event_loop(mock.display);
+
+	log_watch();
+
+	const char *socket = wl_display_add_socket_auto(mock.display);
+	if (!socket) {
+		fail("wl_display_add_socket_auto failed");
+	}
+	setenv("WAYLAND_DISPLAY", socket, 1);
+
+	wl_list_init(&mock.managers);
+	if (!wl_global_create(mock.display, &zwlr_output_manager_v1_interface, 2, NULL, manager_bind)) {
+		fail("wl_global_create failed");
+	}
+
+	mock.quiet_ms = QUIET_MS;
+}
+
+void usage(FILE *stream) {
+	fprintf(stream, "Usage: compositor [-q] [-v] <scenario> [<way-displays>]\n");
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "hqv")) != -1) {
+		switch (opt) {
+			case 'q':
+				mock.quiet = true;
+				break;
+			case 'v':
+				mock.verbose = true;
+				break;
+			case 'h':
+				usage(stdout);
+				return EXIT_SUCCESS;
+			default:
+				usage(stderr);
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1 && optind != argc - 2) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	mock.scenario = argv[optind];
+	mock.way_displays = optind == argc - 2 ? argv[optind + 1] : "./way-displays";
+
+	FILE *f = fopen(mock.scenario, "r");
+	if (!f) {
+		fprintf(stderr, "unable to open %s: %s\n", mock.scenario, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	atexit(teardown);
+
+	// way-displays exiting is noticed by the loop
+	signal(SIGPIPE, SIG_IGN);
+
+	setup();
+
+	run(f);
+
+	fclose(f);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include "tst.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "cfg.h"
+#include "head.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+
+static char dir[] = "/tmp/tst-cache.XXXXXX";
+
+struct Head *head_identified(const char *make, const char *model, const char *serial_number) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+
+	head->name = strdup("DP-1");
+	head->make = make ? strdup(make) : NULL;
+	head->model = model ? strdup(model) : NULL;
+	head->serial_number = serial_number ? strdup(serial_number) : NULL;
+
+	struct Mode *mode = pool_alloc(POOL_MODE);
+	mode->head = head;
+	mode->width = 3840;
+	mode->height = 2160;
+	mode->refresh_mhz = 60000;
+	slist_header_append(&head->modes, mode);
+
+	return head;
+}
+
+void remove_cached(const char *name) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/way-displays/%s", dir, name);
+	unlink(path);
+}
+
+// the current layout oldest, followed by others
+void write_layouts(struct Head *head, unsigned long others) {
+	char path[PATH_MAX];
+	assert_true(cache_path("layouts", path, sizeof(path)));
+
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+
+	fprintf(f, "L %016llx %d\n", (unsigned long long)cache_layout_fingerprint(), 1);
+	fprintf(f, "H 1 3840 2160 60000 256 0 0 0 %s\n", head_identity(head));
+
+	for (unsigned long i = 0; i < others; i++) {
+		fprintf(f, "L %016lx %d\n", i + 1, 2);
+		fprintf(f, "H 1 3840 2160 60000 256 0 0 0 other\n");
+	}
+
+	fclose(f);
+}
+
+int before_all(void **state) {
+	log_set_threshold(ERROR, true);
+
+	if (!mkdtemp(dir)) {
+		return 1;
+	}
+	setenv("XDG_CACHE_HOME", dir, 1);
+
+	return 0;
+}
+
+int after_all(void **state) {
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/way-displays", dir);
+	rmdir(path);
+	rmdir(dir);
+
+	return 0;
+}
+
+int after_each(void **state) {
+	mode_validations_destroy();
+	cache_layouts_destroy();
+	cfg_destroy();
+	heads_destroy();
+
+	remove_cached("modes_failed");
+	remove_cached("layouts");
+
+	return 0;
+}
+
+// rejected modes for heads with and without a make survive a restart
+void modes_failed_reloaded(void **state) {
+	struct Head *identified[] = {
+		head_identified("Monitor Maker", "ABC123", "0x01"),
+		head_identified(NULL, "ABC123", "0x01"),
+		head_identified("", "", "0x01"),
+	};
+	const size_t n = sizeof(identified) / sizeof(identified[0]);
+
+	for (size_t i = 0; i < n; i++) {
+		mode_validated(identified[i]->modes.first->val, MODE_INVALID);
+	}
+
+	mode_validations_destroy();
+	mode_validations_load();
+
+	for (size_t i = 0; i < n; i++) {
+		assert_int_equal(mode_validity(identified[i]->modes.first->val), MODE_INVALID);
+		head_free(identified[i]);
+	}
+}
+
+// a layout including a head without a make survives a restart
+void layouts_reloaded(void **state) {
+	cfg = cfg_default();
+
+	struct Head *head = head_identified(NULL, "ABC123", "0x01");
+	head->current.mode = head->modes.first->val;
+	head->current.enabled = true;
+	head->current.scale = wl_fixed_from_int(2);
+	head->current.x = 100;
+	head->desired = head->current;
+	slist_append(&heads, head);
+
+	cache_layout_store();
+
+	cache_layouts_destroy();
+	cache_layouts_load();
+
+	memset(&head->desired, 0, sizeof(head->desired));
+
+	assert_true(cache_layout_desire());
+	assert_true(head->desired.enabled);
+	assert_ptr_equal(head->desired.mode, head->modes.first->val);
+	assert_int_equal(head->desired.scale, wl_fixed_from_int(2));
+	assert_int_equal(head->desired.x, 100);
+}
+
+// loading never keeps more than the maximum, dropping the oldest
+void layouts_load_trimmed(void **state) {
+	cfg = cfg_default();
+
+	struct Head *head = head_identified("Monitor Maker", "ABC123", "0x01");
+	slist_append(&heads, head);
+
+	write_layouts(head, CACHE_LAYOUTS_MAX - 1);
+	cache_layouts_load();
+	assert_true(cache_layout_desire());
+
+	cache_layouts_destroy();
+
+	write_layouts(head, CACHE_LAYOUTS_MAX);
+	cache_layouts_load();
+	assert_false(cache_layout_desire());
+}
+
+// an invalid XDG_CACHE_HOME falls back to ~/.cache
+void path_xdg_cache_home_invalid(void **state) {
+	static const char *invalid[] = { "", "relative/cache", };
+	char path[PATH_MAX];
+	char expected[PATH_MAX];
+
+	setenv("HOME", dir, 1);
+	snprintf(expected, sizeof(expected), "%s/.cache/way-displays/name", dir);
+
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		setenv("XDG_CACHE_HOME", invalid[i], 1);
+		assert_true(cache_path("name", path, sizeof(path)));
+		assert_string_equal(path, expected);
+	}
+
+	setenv("XDG_CACHE_HOME", dir, 1);
+	assert_true(cache_path("name", path, sizeof(path)));
+	snprintf(expected, sizeof(expected), "%s/way-displays/name", dir);
+	assert_string_equal(path, expected);
+
+	snprintf(path, sizeof(path), "%s/.cache/way-displays", dir);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/.cache", dir);
+	rmdir(path);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(modes_failed_reloaded, NULL, after_each),
+		cmocka_unit_test_setup_teardown(layouts_reloaded, NULL, after_each),
+		cmocka_unit_test_setup_teardown(layouts_load_trimmed, NULL, after_each),
+		cmocka_unit_test_setup_teardown(path_xdg_cache_home_invalid, NULL, after_each),
+	};
+
+	return cmocka_run_group_tests(tests, before_all, after_all);
+}
+
@@ -0,0 +1,199 @@
+#include "tst.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "head.h"
+#include "list.h"
+#include "log.h"
+#include "pool.h"
+#include "server.h"
+
+struct Head *head_named(const char *name, const char *description) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+
+	head->name = name ? strdup(name) : NULL;
+	head->description = description ? strdup(description) : NULL;
+
+	return head;
+}
+
+struct UserScale *user_scale(const char *name_desc, float scale) {
+	struct UserScale *user_scale = calloc(1, sizeof(struct UserScale));
+
+	user_scale->name_desc = strdup(name_desc);
+	user_scale->scale = scale;
+
+	return user_scale;
+}
+
+struct UserMode *user_mode(const char *name_desc, int32_t width) {
+	struct UserMode *user_mode = calloc(1, sizeof(struct UserMode));
+
+	user_mode->name_desc = strdup(name_desc);
+	user_mode->width = width;
+
+	return user_mode;
+}
+
+int before_each(void **state) {
+	log_set_threshold(ERROR, true);
+
+	cfg = cfg_default();
+
+	return 0;
+}
+
+int after_each(void **state) {
+	cfg_destroy();
+
+	heads_destroy();
+
+	return 0;
+}
+
+void bind_order(void **state) {
+	slist_append(&cfg->order_name_desc, strdup("HDMI-A-1"));
+	slist_append(&cfg->order_name_desc, strdup("Monitor Maker"));
+	slist_append(&cfg->order_name_desc, strdup("DP-1"));
+
+	struct Head *dp1 = head_named("DP-1", "Monitor Maker ABC123 (DP-1)");
+	struct Head *hdmi = head_named("HDMI-A-1", "Other Maker XYZ");
+	struct Head *dp2 = head_named("DP-2", "Other Maker XYZ");
+	slist_append(&heads, dp1);
+	slist_append(&heads, hdmi);
+	slist_append(&heads, dp2);
+
+	head_bind(dp1);
+	head_bind(hdmi);
+	head_bind(dp2);
+
+	// first matching position
+	assert_int_equal(dp1->bindings.order, 1);
+	assert_int_equal(hdmi->bindings.order, 0);
+	assert_int_equal(dp2->bindings.order, UINT_MAX);
+}
+
+void bind_case_insensitive(void **state) {
+	slist_append(&cfg->order_name_desc, strdup("dp-1"));
+	slist_append(&cfg->user_scales, user_scale("mONITOR mAKER", 2));
+	slist_append(&cfg->user_modes, user_mode("MONITOR MAKER abc123", 1920));
+	slist_append(&cfg->disabled_name_desc, strdup("hdmi-a-1"));
+	slist_append(&cfg->max_preferred_refresh_name_desc, strdup("OTHER maker"));
+
+	struct Head *dp1 = head_named("DP-1", "Monitor Maker ABC123 (DP-1)");
+	struct Head *hdmi = head_named("HDMI-A-1", "Other Maker XYZ");
+	slist_append(&heads, dp1);
+	slist_append(&heads, hdmi);
+
+	head_bind(dp1);
+	head_bind(hdmi);
+
+	assert_int_equal(dp1->bindings.order, 0);
+	assert_non_null(dp1->bindings.user_scale);
+	assert_true(dp1->bindings.user_scale->scale == 2);
+	assert_non_null(dp1->bindings.user_mode);
+	assert_false(dp1->bindings.disabled);
+	assert_false(dp1->bindings.max_preferred_refresh);
+
+	assert_int_equal(hdmi->bindings.order, UINT_MAX);
+	assert_null(hdmi->bindings.user_scale);
+	assert_null(hdmi->bindings.user_mode);
+	assert_true(hdmi->bindings.disabled);
+	assert_true(hdmi->bindings.max_preferred_refresh);
+}
+
+void bind_name_exact(void **state) {
+	slist_append(&cfg->order_name_desc, strdup("DP"));
+	slist_append(&cfg->order_name_desc, strdup("dp-10"));
+
+	struct Head *dp1 = head_named("DP-1", NULL);
+	struct Head *dp10 = head_named("DP-10", NULL);
+	slist_append(&heads, dp1);
+	slist_append(&heads, dp10);
+
+	head_bind(dp1);
+	head_bind(dp10);
+
+	// names are not matched within
+	assert_int_equal(dp1->bindings.order, UINT_MAX);
+	assert_int_equal(dp10->bindings.order, 1);
+}
+
+void bind_first_wins(void **state) {
+	slist_append(&cfg->user_scales, user_scale("Maker ABC", 1.5));
+	slist_append(&cfg->user_scales, user_scale("DP-1", 3));
+
+	struct Head *dp1 = head_named("DP-1", "Monitor Maker ABC123 (DP-1)");
+	slist_append(&heads, dp1);
+
+	head_bind(dp1);
+
+	assert_non_null(dp1->bindings.user_scale);
+	assert_true(dp1->bindings.user_scale->scale == 1.5);
+}
+
+void bind_laptop(void **state) {
+	struct Head *edp = head_named("eDP-1", NULL);
+	struct Head *lvds = head_named("LVDS-1", NULL);
+	slist_append(&heads, edp);
+	slist_append(&heads, lvds);
+
+	head_bind(edp);
+	head_bind(lvds);
+
+	assert_true(edp->bindings.laptop);
+	assert_false(lvds->bindings.laptop);
+
+	cfg_destroy();
+	cfg = cfg_default();
+	cfg->laptop_display_prefix = strdup("lvds");
+
+	head_bind(edp);
+	head_bind(lvds);
+
+	assert_false(edp->bindings.laptop);
+	assert_true(lvds->bindings.laptop);
+}
+
+void bind_cfg_changed(void **state) {
+	slist_append(&cfg->order_name_desc, strdup("DP-2"));
+	slist_append(&cfg->order_name_desc, strdup("DP-1"));
+
+	struct Head *dp1 = head_named("DP-1", NULL);
+	slist_append(&heads, dp1);
+
+	head_bind(dp1);
+	assert_int_equal(dp1->bindings.order, 1);
+
+	// a new instance is matched afresh
+	cfg_destroy();
+	cfg = cfg_default();
+	slist_append(&cfg->order_name_desc, strdup("dp-1"));
+
+	head_bind(dp1);
+	assert_int_equal(dp1->bindings.order, 0);
+
+	cfg_destroy();
+	cfg = cfg_default();
+
+	head_bind(dp1);
+	assert_int_equal(dp1->bindings.order, UINT_MAX);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(bind_order, before_each, after_each),
+		cmocka_unit_test_setup_teardown(bind_case_insensitive, before_each, after_each),
+		cmocka_unit_test_setup_teardown(bind_name_exact, before_each, after_each),
+		cmocka_unit_test_setup_teardown(bind_first_wins, before_each, after_each),
+		cmocka_unit_test_setup_teardown(bind_laptop, before_each, after_each),
+		cmocka_unit_test_setup_teardown(bind_cfg_changed, before_each, after_each),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
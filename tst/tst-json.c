@@ -0,0 +1,133 @@
+#include "tst.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "json.h"
+#include "log.h"
+
+// log.c
+size_t json_line_end(struct Json *json, enum LogThreshold threshold);
+void json_line_begin(struct Json *json, char *buf, size_t nbuf, enum LogThreshold threshold);
+
+// a line with just a message, in a buffer of size
+size_t message_line(char *buf, size_t size, const char *message) {
+	struct Json json;
+
+	json_line_begin(&json, buf, size, INFO);
+	json_string(&json, "message", message);
+
+	return json_line_end(&json, INFO);
+}
+
+void escape_quotes_backslashes(void **state) {
+	char buf[128];
+	struct Json json;
+
+	json_init(&json, buf, sizeof(buf));
+	json_object_begin(&json, NULL);
+	json_string(&json, "k\"ey", "a \"quoted\" C:\\path\\");
+	json_object_end(&json);
+
+	assert_false(json.truncated);
+	assert_string_equal(buf, "{\"k\\\"ey\":\"a \\\"quoted\\\" C:\\\\path\\\\\"}");
+	assert_int_equal(json.len, strlen(buf));
+}
+
+void escape_control_characters(void **state) {
+	char buf[128];
+	struct Json json;
+
+	json_init(&json, buf, sizeof(buf));
+	json_string(&json, NULL, "a\nb\tc\rd\x01" "e\x1f" "f\x7f");
+
+	assert_false(json.truncated);
+	assert_string_equal(buf, "\"a\\nb\\tc\\u000dd\\u0001e\\u001ff\x7f\"");
+}
+
+void utf8_passed_through(void **state) {
+	char buf[128];
+	struct Json json;
+
+	json_init(&json, buf, sizeof(buf));
+	json_string(&json, NULL, "caf\xc3\xa9 \xe2\x86\x92");
+
+	assert_string_equal(buf, "\"caf\xc3\xa9 \xe2\x86\x92\"");
+}
+
+void values_separated(void **state) {
+	char buf[128];
+	struct Json json;
+
+	json_init(&json, buf, sizeof(buf));
+	json_object_begin(&json, NULL);
+	json_string(&json, "s", NULL);
+	json_int(&json, "i", -3);
+	json_double(&json, "d", 1.5);
+	json_array_begin(&json, "a");
+	json_bool(&json, NULL, true);
+	json_null(&json, NULL);
+	json_object_begin(&json, NULL);
+	json_object_end(&json);
+	json_array_end(&json);
+	json_object_end(&json);
+
+	assert_string_equal(buf, "{\"s\":null,\"i\":-3,\"d\":1.500,\"a\":[true,null,{}]}");
+}
+
+void truncated_terminated(void **state) {
+	char buf[8];
+	struct Json json;
+
+	json_init(&json, buf, sizeof(buf));
+	json_string(&json, NULL, "abcdefgh");
+	json_int(&json, NULL, 1);
+
+	assert_true(json.truncated);
+	assert_true(json.len < sizeof(buf));
+	assert_int_equal(strlen(buf), json.len);
+}
+
+void line_fits(void **state) {
+	char buf[64];
+
+	size_t n = message_line(buf, sizeof(buf), "abcdefghij");
+
+	assert_string_equal(buf, "{\"level\":\"INFO\",\"message\":\"abcdefghij\"}\n");
+	assert_int_equal(n, strlen(buf));
+}
+
+void line_truncated(void **state) {
+	char buf[40];
+
+	size_t n = message_line(buf, sizeof(buf), "abcdefghijklmnopqrstuvwxyz");
+
+	assert_string_equal(buf, "{\"level\":\"INFO\",\"truncated\":true}\n");
+	assert_int_equal(n, strlen(buf));
+}
+
+void line_truncated_newline(void **state) {
+	// the object fits with its terminator, the newline does not
+	char buf[sizeof("{\"level\":\"INFO\",\"message\":\"abcdefghij\"}")];
+
+	size_t n = message_line(buf, sizeof(buf), "abcdefghij");
+
+	assert_string_equal(buf, "{\"level\":\"INFO\",\"truncated\":true}\n");
+	assert_int_equal(n, strlen(buf));
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(escape_quotes_backslashes),
+		cmocka_unit_test(escape_control_characters),
+		cmocka_unit_test(utf8_passed_through),
+		cmocka_unit_test(values_separated),
+		cmocka_unit_test(truncated_terminated),
+		cmocka_unit_test(line_fits),
+		cmocka_unit_test(line_truncated),
+		cmocka_unit_test(line_truncated_newline),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
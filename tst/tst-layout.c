@@ -0,0 +1,174 @@
+#include "tst.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "cfg.h"
+#include "head.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+
+// layout.c
+void desire(void);
+
+// never computed by desire
+#define SENTINEL_SCALE 12345
+
+struct Head *head_modes(const char *name) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+
+	head->name = strdup(name);
+	head->width_mm = 600;
+	head->height_mm = 340;
+
+	for (int32_t i = 0; i < 2; i++) {
+		struct Mode *mode = pool_alloc(POOL_MODE);
+		mode->head = head;
+		mode->width = 2560 - 640 * i;
+		mode->height = 1440 - 360 * i;
+		mode->refresh_mhz = 60000;
+		mode->preferred = i == 0;
+		slist_header_append(&head->modes, mode);
+	}
+
+	head_modes_changed(head);
+
+	head->current.mode = head->modes.last->val;
+	head->current.scale = wl_fixed_from_int(1);
+	head->current.enabled = true;
+
+	return head;
+}
+
+struct Head *head_nth(unsigned long n) {
+	struct SList *i = heads;
+	while (i && n--) {
+		i = i->nex;
+	}
+	return i ? i->val : NULL;
+}
+
+void sentinel(void) {
+	for (struct SList *i = heads; i; i = i->nex) {
+		((struct Head*)i->val)->desired.scale = SENTINEL_SCALE;
+	}
+}
+
+int before_each(void **state) {
+	log_set_threshold(ERROR, true);
+
+	cfg = cfg_default();
+	cfg->auto_scale = OFF;
+
+	slist_append(&heads, head_modes("DP-1"));
+	slist_append(&heads, head_modes("DP-2"));
+	heads_generation++;
+
+	// everything desired once
+	desire();
+
+	return 0;
+}
+
+int after_each(void **state) {
+	cfg_destroy();
+
+	heads_destroy();
+
+	return 0;
+}
+
+void desire_initial(void **state) {
+	struct Head *a = head_nth(0);
+	struct Head *b = head_nth(1);
+
+	assert_true(a->desired.enabled);
+	assert_ptr_equal(a->desired.mode, a->modes.first->val);
+	assert_int_equal(a->desired.scale, wl_fixed_from_int(1));
+	assert_int_equal(a->desired.x, 0);
+
+	assert_true(b->desired.enabled);
+	assert_ptr_equal(b->desired.mode, b->modes.first->val);
+	assert_int_equal(b->desired.x, 2560);
+
+	assert_int_equal(a->desired_generation, a->generation);
+	assert_int_equal(b->desired_generation, b->generation);
+}
+
+void desire_unchanged_skipped(void **state) {
+	sentinel();
+
+	desire();
+
+	assert_int_equal(head_nth(0)->desired.scale, SENTINEL_SCALE);
+	assert_int_equal(head_nth(1)->desired.scale, SENTINEL_SCALE);
+}
+
+void desire_head_changed(void **state) {
+	struct Head *a = head_nth(0);
+	struct Head *b = head_nth(1);
+
+	sentinel();
+
+	a->generation++;
+
+	desire();
+
+	// only the changed head
+	assert_int_equal(a->desired.scale, wl_fixed_from_int(1));
+	assert_int_equal(a->desired_generation, a->generation);
+	assert_int_equal(b->desired.scale, SENTINEL_SCALE);
+
+	// and skipped again
+	sentinel();
+
+	desire();
+
+	assert_int_equal(a->desired.scale, SENTINEL_SCALE);
+	assert_int_equal(b->desired.scale, SENTINEL_SCALE);
+}
+
+void desire_cfg_changed(void **state) {
+	sentinel();
+
+	cfg->generation++;
+
+	desire();
+
+	assert_int_equal(head_nth(0)->desired.scale, wl_fixed_from_int(1));
+	assert_int_equal(head_nth(1)->desired.scale, wl_fixed_from_int(1));
+}
+
+void desire_heads_changed(void **state) {
+	sentinel();
+
+	struct SList *first = heads;
+	head_free(slist_remove(&heads, &first));
+	heads_generation++;
+
+	desire();
+
+	// the remaining head moves to the left
+	struct Head *b = head_nth(0);
+	assert_string_equal(b->name, "DP-2");
+	assert_int_equal(b->desired.scale, wl_fixed_from_int(1));
+	assert_int_equal(b->desired.x, 0);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(desire_initial, before_each, after_each),
+		cmocka_unit_test_setup_teardown(desire_unchanged_skipped, before_each, after_each),
+		cmocka_unit_test_setup_teardown(desire_head_changed, before_each, after_each),
+		cmocka_unit_test_setup_teardown(desire_cfg_changed, before_each, after_each),
+		cmocka_unit_test_setup_teardown(desire_heads_changed, before_each, after_each),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
@@ -0,0 +1,441 @@
+#include "tst.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "cfg.h"
+#include "head.h"
+#include "info.h"
+#include "ipc.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "marshalling.h"
+#include "mode.h"
+#include "pool.h"
+#include "server.h"
+#include "tlv.h"
+
+// cfg.c
+bool equal_cfg(struct Cfg *a, struct Cfg *b);
+
+struct Cfg *cfg_populated(void) {
+	struct Cfg *c = cfg_default();
+
+	c->arrange = COL;
+	c->align = MIDDLE;
+	c->auto_scale = OFF;
+	c->log_threshold = DEBUG;
+	c->log_format = LOG_FORMAT_DEFAULT;
+
+	free(c->laptop_display_prefix);
+	c->laptop_display_prefix = strdup("eDP");
+
+	slist_append(&c->order_name_desc, strdup("DP-1"));
+	slist_append(&c->order_name_desc, strdup("!^HDMI"));
+
+	struct UserScale *user_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
+	user_scale->name_desc = strdup("DP-1");
+	user_scale->scale = 1.75f;
+	slist_append(&c->user_scales, user_scale);
+
+	struct UserMode *user_mode = cfg_user_mode_default();
+	user_mode->name_desc = strdup("HDMI-A-1");
+	user_mode->width = 2560;
+	user_mode->height = 1440;
+	user_mode->refresh_hz = 144;
+	slist_append(&c->user_modes, user_mode);
+
+	struct UserTransform *user_transform = cfg_user_transform_default();
+	user_transform->name_desc = strdup("DP-2");
+	user_transform->transform = WL_OUTPUT_TRANSFORM_90;
+	slist_append(&c->user_transform, user_transform);
+
+	slist_append(&c->max_preferred_refresh_name_desc, strdup("DP-2"));
+	slist_append(&c->disabled_name_desc, strdup("HDMI-A-2"));
+
+	return c;
+}
+
+struct Head *head_populated(const char *name, int32_t x) {
+	struct Head *head = pool_alloc(POOL_HEAD);
+
+	head->name = strdup(name);
+	head->description = strdup("Monitor Maker ABC123 (DP-1 via HDMI)");
+	head->make = strdup("Monitor Maker");
+	head->model = strdup("ABC123");
+	head->serial_number = strdup("0x00AA");
+	head->width_mm = 600;
+	head->height_mm = 340;
+
+	for (int32_t i = 0; i < 3; i++) {
+		struct Mode *mode = pool_alloc(POOL_MODE);
+		mode->head = head;
+		mode->width = 3840 - 640 * i;
+		mode->height = 2160 - 360 * i;
+		mode->refresh_mhz = 59940 + 1000 * i;
+		mode->preferred = i == 0;
+		slist_header_append(&head->modes, mode);
+	}
+
+	head->current.mode = head->modes.first->nex->val;
+	head->current.scale = wl_fixed_from_double(1.5);
+	head->current.enabled = true;
+	head->current.x = x;
+	head->current.y = 0;
+
+	head->desired = head->current;
+	head->desired.scale = wl_fixed_from_double(1.75);
+
+	head->generation = 1;
+
+	return head;
+}
+
+void assert_head_state_equal(struct HeadState *expected, struct HeadState *actual) {
+	assert_int_equal(actual->scale, expected->scale);
+	assert_int_equal(actual->enabled, expected->enabled);
+	assert_int_equal(actual->x, expected->x);
+	assert_int_equal(actual->y, expected->y);
+}
+
+void assert_head_equal(struct Head *expected, struct Head *actual) {
+	assert_string_equal(actual->name, expected->name);
+	assert_string_equal(actual->description, expected->description);
+	assert_string_equal(actual->make, expected->make);
+	assert_string_equal(actual->model, expected->model);
+	assert_string_equal(actual->serial_number, expected->serial_number);
+	assert_int_equal(actual->width_mm, expected->width_mm);
+	assert_int_equal(actual->height_mm, expected->height_mm);
+
+	assert_head_state_equal(&expected->current, &actual->current);
+	assert_head_state_equal(&expected->desired, &actual->desired);
+
+	struct SList *e = expected->modes.first;
+	struct SList *a = actual->modes.first;
+	for (; e && a; e = e->nex, a = a->nex) {
+		struct Mode *me = e->val;
+		struct Mode *ma = a->val;
+		assert_int_equal(ma->width, me->width);
+		assert_int_equal(ma->height, me->height);
+		assert_int_equal(ma->refresh_mhz, me->refresh_mhz);
+		assert_int_equal(ma->preferred, me->preferred);
+		assert_int_equal(actual->current.mode == ma, expected->current.mode == me);
+		assert_ptr_equal(ma->head, actual);
+	}
+	assert_null(e);
+	assert_null(a);
+}
+
+void assert_heads_equal(struct SList *expected, struct SList *actual) {
+	assert_int_equal(slist_length(actual), slist_length(expected));
+	for (; expected && actual; expected = expected->nex, actual = actual->nex) {
+		assert_head_equal(expected->val, actual->val);
+	}
+}
+
+// marshalled and unmarshalled in each encoding
+struct IpcRequest *request_yaml(struct IpcRequest *request) {
+	char *yaml = marshal_ipc_request(request);
+	assert_non_null(yaml);
+
+	struct IpcRequest *unmarshalled = unmarshal_ipc_request(yaml);
+	assert_non_null(unmarshalled);
+
+	free(yaml);
+
+	return unmarshalled;
+}
+
+struct IpcRequest *request_tlv(struct IpcRequest *request) {
+	size_t len = 0;
+	char *tlv = tlv_marshal_ipc_request(request, &len);
+	assert_non_null(tlv);
+
+	struct IpcRequest *unmarshalled = tlv_unmarshal_ipc_request(tlv, len);
+	assert_non_null(unmarshalled);
+
+	free(tlv);
+
+	return unmarshalled;
+}
+
+struct IpcResponse *response_yaml(struct IpcResponse *response) {
+	char *yaml = marshal_ipc_response(response);
+	assert_non_null(yaml);
+
+	struct IpcResponse *unmarshalled = unmarshal_ipc_response(yaml);
+	assert_non_null(unmarshalled);
+
+	free(yaml);
+
+	return unmarshalled;
+}
+
+struct IpcResponse *response_tlv(struct IpcResponse *response) {
+	size_t len = 0;
+	char *tlv = tlv_marshal_ipc_response(response, &len);
+	assert_non_null(tlv);
+
+	struct IpcResponse *unmarshalled = tlv_unmarshal_ipc_response(tlv, len);
+	assert_non_null(unmarshalled);
+
+	free(tlv);
+
+	return unmarshalled;
+}
+
+typedef struct IpcRequest *(*RequestRoundTrip)(struct IpcRequest *request);
+typedef struct IpcResponse *(*ResponseRoundTrip)(struct IpcResponse *response);
+
+static const RequestRoundTrip request_round_trips[] = { request_yaml, request_tlv, };
+static const ResponseRoundTrip response_round_trips[] = { response_yaml, response_tlv, };
+
+#define ROUND_TRIPS 2
+
+int before_each(void **state) {
+	log_set_threshold(ERROR, true);
+
+	cfg = cfg_populated();
+
+	lid = (struct Lid*)calloc(1, sizeof(struct Lid));
+	lid->closed = true;
+	lid->device_path = strdup("/dev/input/event2");
+	lid->generation = 1;
+
+	slist_append(&heads, head_populated("DP-1", 0));
+	slist_append(&heads, head_populated("HDMI-A-1", 2560));
+	heads_generation++;
+
+	state_revise();
+
+	return 0;
+}
+
+int after_each(void **state) {
+	cfg_destroy();
+
+	free(lid->device_path);
+	free(lid);
+	lid = NULL;
+
+	heads_destroy();
+
+	return 0;
+}
+
+void request_cfg(void **state) {
+	struct IpcRequest request = {
+		.command = CFG_SET,
+		.cfg = cfg_populated(),
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcRequest *actual = request_round_trips[i](&request);
+
+		assert_int_equal(actual->command, CFG_SET);
+		assert_non_null(actual->cfg);
+		assert_true(equal_cfg(actual->cfg, request.cfg));
+		assert_false(actual->delta);
+
+		free_ipc_request(actual);
+	}
+
+	cfg_free(request.cfg);
+}
+
+void request_since(void **state) {
+	struct IpcRequest request = {
+		.command = SUBSCRIBE,
+		.delta = true,
+
+		// beyond 32 bits
+		.since = 0x100000002UL,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcRequest *actual = request_round_trips[i](&request);
+
+		assert_int_equal(actual->command, SUBSCRIBE);
+		assert_null(actual->cfg);
+		assert_true(actual->delta);
+		assert_true(actual->since == request.since);
+
+		free_ipc_request(actual);
+	}
+}
+
+void response_cfg_state(void **state) {
+	struct IpcResponse response = {
+		.done = true,
+		.rc = IPC_RC_WARN,
+		.status = true,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_true(actual->done);
+		assert_int_equal(actual->rc, IPC_RC_WARN);
+		assert_int_equal(actual->events, 0);
+		assert_true(actual->status);
+
+		assert_non_null(actual->cfg);
+		assert_true(equal_cfg(actual->cfg, cfg));
+
+		assert_true(actual->revision == state_revision);
+		assert_false(actual->delta);
+
+		assert_non_null(actual->lid);
+		assert_true(actual->lid->closed);
+		assert_string_equal(actual->lid->device_path, lid->device_path);
+
+		assert_heads_equal(heads, actual->heads);
+
+		free_ipc_response(actual);
+	}
+}
+
+void response_no_status(void **state) {
+	struct IpcResponse response = {
+		.done = false,
+		.rc = IPC_RC_SUCCESS,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_false(actual->done);
+		assert_false(actual->status);
+		assert_null(actual->cfg);
+		assert_null(actual->lid);
+		assert_null(actual->heads);
+		assert_true(actual->revision == 0);
+
+		free_ipc_response(actual);
+	}
+}
+
+void response_event_cfg(void **state) {
+	struct IpcResponse response = {
+		.status = true,
+		.events = IPC_EVENT_BIT(IPC_EVENT_CFG),
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_int_equal(actual->events, IPC_EVENT_BIT(IPC_EVENT_CFG));
+		assert_non_null(actual->cfg);
+		assert_true(equal_cfg(actual->cfg, cfg));
+
+		// state unaffected
+		assert_true(actual->revision == 0);
+		assert_null(actual->lid);
+		assert_null(actual->heads);
+
+		free_ipc_response(actual);
+	}
+}
+
+void response_delta(void **state) {
+	unsigned long since = state_revision;
+
+	// one head moves
+	struct Head *head = heads->nex->val;
+	head->current.x = 3840;
+	head->desired.x = 3840;
+	head->generation++;
+
+	state_revise();
+	assert_true(state_revision == since + 1);
+
+	struct IpcResponse response = {
+		.status = true,
+		.events = IPC_EVENT_BIT(IPC_EVENT_HEADS),
+		.delta = true,
+		.since = since,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_int_equal(actual->events, IPC_EVENT_BIT(IPC_EVENT_HEADS));
+		assert_null(actual->cfg);
+
+		assert_true(actual->delta);
+		assert_true(actual->revision == state_revision);
+
+		// unchanged
+		assert_null(actual->lid);
+
+		assert_int_equal(slist_length(actual->heads), 1);
+		assert_head_equal(head, actual->heads->val);
+
+		free_ipc_response(actual);
+	}
+}
+
+void response_delta_unchanged(void **state) {
+	struct IpcResponse response = {
+		.status = true,
+		.delta = true,
+		.since = state_revision,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_true(actual->delta);
+		assert_true(actual->revision == state_revision);
+		assert_null(actual->lid);
+		assert_null(actual->heads);
+
+		free_ipc_response(actual);
+	}
+}
+
+void response_delta_departed(void **state) {
+	unsigned long since = state_revision;
+
+	// a departure can't be expressed as a delta
+	slist_remove_all_free(&heads, NULL, heads->nex->val, head_free);
+	heads_generation++;
+
+	state_revise();
+
+	struct IpcResponse response = {
+		.status = true,
+		.events = IPC_EVENT_BIT(IPC_EVENT_HEADS),
+		.delta = true,
+		.since = since,
+	};
+
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		struct IpcResponse *actual = response_round_trips[i](&response);
+
+		assert_false(actual->delta);
+		assert_non_null(actual->lid);
+		assert_heads_equal(heads, actual->heads);
+
+		free_ipc_response(actual);
+	}
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(request_cfg, before_each, after_each),
+		cmocka_unit_test_setup_teardown(request_since, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_cfg_state, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_no_status, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_event_cfg, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_delta, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_delta_unchanged, before_each, after_each),
+		cmocka_unit_test_setup_teardown(response_delta_departed, before_each, after_each),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
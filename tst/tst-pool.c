@@ -0,0 +1,131 @@
+#include "tst.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "head.h"
+#include "list.h"
+#include "mode.h"
+#include "pool.h"
+
+// pool.c
+#define SLAB_OBJECTS 64
+
+void assert_stats(enum PoolType type, unsigned long live, unsigned long high_water, unsigned long capacity) {
+	struct PoolStats stats = pool_stats(type);
+
+	assert_int_equal(stats.live, live);
+	assert_int_equal(stats.high_water, high_water);
+	assert_int_equal(stats.capacity, capacity);
+}
+
+int before_each(void **state) {
+	pool_destroy();
+
+	return 0;
+}
+
+int after_each(void **state) {
+	pool_destroy();
+
+	return 0;
+}
+
+void stats_alloc_free(void **state) {
+	struct Mode *modes[SLAB_OBJECTS + 1];
+
+	assert_stats(POOL_MODE, 0, 0, 0);
+
+	// a second slab for the last
+	for (int i = 0; i < SLAB_OBJECTS + 1; i++) {
+		modes[i] = pool_alloc(POOL_MODE);
+		assert_non_null(modes[i]);
+	}
+	assert_stats(POOL_MODE, SLAB_OBJECTS + 1, SLAB_OBJECTS + 1, 2 * SLAB_OBJECTS);
+
+	for (int i = 0; i < 30; i++) {
+		pool_free(POOL_MODE, modes[i]);
+	}
+	assert_stats(POOL_MODE, SLAB_OBJECTS - 29, SLAB_OBJECTS + 1, 2 * SLAB_OBJECTS);
+
+	// freed objects are reused before another slab
+	for (int i = 0; i < 10; i++) {
+		modes[i] = pool_alloc(POOL_MODE);
+	}
+	assert_stats(POOL_MODE, SLAB_OBJECTS - 19, SLAB_OBJECTS + 1, 2 * SLAB_OBJECTS);
+
+	// types are counted apart
+	assert_stats(POOL_SLIST, 0, 0, 0);
+	assert_stats(POOL_HEAD, 0, 0, 0);
+}
+
+void stats_high_water(void **state) {
+	struct Head *a = pool_alloc(POOL_HEAD);
+	struct Head *b = pool_alloc(POOL_HEAD);
+	struct Head *c = pool_alloc(POOL_HEAD);
+	assert_stats(POOL_HEAD, 3, 3, SLAB_OBJECTS);
+
+	pool_free(POOL_HEAD, a);
+	pool_free(POOL_HEAD, b);
+	assert_stats(POOL_HEAD, 1, 3, SLAB_OBJECTS);
+
+	a = pool_alloc(POOL_HEAD);
+	assert_stats(POOL_HEAD, 2, 3, SLAB_OBJECTS);
+
+	b = pool_alloc(POOL_HEAD);
+	struct Head *d = pool_alloc(POOL_HEAD);
+	assert_stats(POOL_HEAD, 4, 4, SLAB_OBJECTS);
+
+	pool_free(POOL_HEAD, a);
+	pool_free(POOL_HEAD, b);
+	pool_free(POOL_HEAD, c);
+	pool_free(POOL_HEAD, d);
+	assert_stats(POOL_HEAD, 0, 4, SLAB_OBJECTS);
+}
+
+void alloc_reused_zeroed(void **state) {
+	struct SList *a = pool_alloc(POOL_SLIST);
+	a->val = a;
+	a->nex = a;
+
+	pool_free(POOL_SLIST, a);
+
+	struct SList *b = pool_alloc(POOL_SLIST);
+	assert_ptr_equal(b, a);
+	assert_null(b->val);
+	assert_null(b->nex);
+
+	pool_free(POOL_SLIST, b);
+}
+
+void free_null_ignored(void **state) {
+	pool_free(POOL_MODE, NULL);
+	assert_stats(POOL_MODE, 0, 0, 0);
+
+	assert_null(pool_alloc(0));
+}
+
+void destroy_resets(void **state) {
+	pool_alloc(POOL_SLIST);
+	pool_alloc(POOL_MODE);
+	pool_alloc(POOL_HEAD);
+
+	pool_destroy();
+
+	assert_stats(POOL_SLIST, 0, 0, 0);
+	assert_stats(POOL_MODE, 0, 0, 0);
+	assert_stats(POOL_HEAD, 0, 0, 0);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(stats_alloc_free, before_each, after_each),
+		cmocka_unit_test_setup_teardown(stats_high_water, before_each, after_each),
+		cmocka_unit_test_setup_teardown(alloc_reused_zeroed, before_each, after_each),
+		cmocka_unit_test_setup_teardown(free_null_ignored, before_each, after_each),
+		cmocka_unit_test_setup_teardown(destroy_resets, before_each, after_each),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
@@ -0,0 +1,13 @@
+#ifndef TST_H
+#define TST_H
+
+// cmocka requires these before its own header
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmocka.h>
+
+#endif // TST_H
+